@@ -0,0 +1,54 @@
+#ifndef AABB_H
+#define AABB_H
+
+#include <glm/glm.hpp>
+#include <limits>
+
+using namespace std;
+using glm::vec3;
+using glm::vec4;
+
+// Axis aligned bounding box. Kept header only so the slab test inlines into
+// the BVH traversal loop
+struct AABB {
+    vec3 lower;
+    vec3 upper;
+
+    // An empty box, growing it by any point gives a box around that point
+    AABB() : lower(numeric_limits<float>::max()), upper(-numeric_limits<float>::max()) {}
+    AABB(vec3 lower, vec3 upper) : lower(lower), upper(upper) {}
+
+    void grow(vec3 p) {
+        lower = glm::min(lower, p);
+        upper = glm::max(upper, p);
+    }
+
+    void grow(const AABB& box) {
+        lower = glm::min(lower, box.lower);
+        upper = glm::max(upper, box.upper);
+    }
+
+    vec3 centroid() const {
+        return 0.5f * (lower + upper);
+    }
+
+    float surfaceArea() const {
+        vec3 e = upper - lower;
+        if (e.x < 0 || e.y < 0 || e.z < 0) return 0.0f;
+        return 2.0f * (e.x * e.y + e.y * e.z + e.z * e.x);
+    }
+
+    // Slab test. Returns the entry distance along the ray, or -1 if the ray
+    // misses the box or only reaches it beyond tmax
+    float intersects(const vec3& start, const vec3& invDir, float tmax) const {
+        vec3 t1 = (lower - start) * invDir;
+        vec3 t2 = (upper - start) * invDir;
+        vec3 tNear = glm::min(t1, t2);
+        vec3 tFar = glm::max(t1, t2);
+        float tEnter = glm::max(glm::max(tNear.x, tNear.y), glm::max(tNear.z, 0.0f));
+        float tExit = glm::min(glm::min(tFar.x, tFar.y), glm::min(tFar.z, tmax));
+        return tEnter <= tExit ? tEnter : -1.0f;
+    }
+};
+
+#endif
@@ -0,0 +1,66 @@
+#include "AliasTable.h"
+
+#include <algorithm>
+
+// CONSTRUCTOR
+AliasTable::AliasTable() {
+    total = 0;
+}
+
+//Vose's method: weights are split into those under and over the average, and
+//each slot pairs an under weight with the over weight topping it up
+AliasTable::AliasTable(const vector<float>& weights) {
+    int n = weights.size();
+    total = 0;
+    for (int i = 0 ; i < n ; i++) {
+        total += weights[i];
+    }
+    probability.assign(n, 1.0f);
+    alias.resize(n);
+    pmf.resize(n);
+    vector<float> scaled(n);
+    vector<int> under;
+    vector<int> over;
+    for (int i = 0 ; i < n ; i++) {
+        alias[i] = i;
+        pmf[i] = total > 0 ? weights[i] / total : 1.0f / n;
+        scaled[i] = pmf[i] * n;
+        if (scaled[i] < 1.0f) under.push_back(i);
+        else over.push_back(i);
+    }
+    while (!under.empty() && !over.empty()) {
+        int small = under.back();
+        int large = over.back();
+        under.pop_back();
+        probability[small] = scaled[small];
+        alias[small] = large;
+        scaled[large] -= 1.0f - scaled[small];
+        if (scaled[large] < 1.0f) {
+            over.pop_back();
+            under.push_back(large);
+        }
+    }
+    //Whatever is left is 1 up to rounding
+}
+
+int AliasTable::Sample(float u, float& pmf) {
+    int n = probability.size();
+    float scaled = u * n;
+    int slot = min((int) scaled, n - 1);
+    int index = scaled - slot < probability[slot] ? slot : alias[slot];
+    pmf = this->pmf[index];
+    return index;
+}
+
+// GETTERS
+int AliasTable::getSize() {
+    return probability.size();
+}
+
+float AliasTable::getTotal() {
+    return total;
+}
+
+float AliasTable::getProbability(int index) {
+    return pmf[index];
+}
@@ -0,0 +1,33 @@
+#ifndef ALIAS_TABLE_H
+#define ALIAS_TABLE_H
+
+#include <vector>
+
+using namespace std;
+
+// Walker's alias table: picks index i in proportion to weights[i] in constant
+// time. Slot i keeps i with probability probability[i], otherwise alias[i]
+class AliasTable {
+
+    private:
+        vector<float> probability;
+        vector<int> alias;
+        vector<float> pmf;
+        float total;
+
+    public:
+        // CONSTRUCTOR
+        AliasTable();
+        // All zero weights are picked uniformly
+        AliasTable(const vector<float>& weights);
+
+        // Picks an index with u uniform in [0, 1), setting pmf to its chance
+        int Sample(float u, float& pmf);
+
+        // GETTERS
+        int getSize();
+        float getTotal();
+        float getProbability(int index);
+};
+
+#endif
@@ -0,0 +1,437 @@
+#include "BVH.h"
+
+#include <algorithm>
+#include <iostream>
+#include <omp.h>
+
+// CONSTRUCTOR
+BVH::BVH() {
+}
+
+//Builds the hierarchy top down, choosing each split with the surface area heuristic
+void BVH::Build(vector<AABB> boxes) {
+    nodes.clear();
+    primitiveIndices.clear();
+    parents.clear();
+
+    int n = boxes.size();
+    if (n == 0) return;
+
+    vector<vec3> centroids(n);
+    for (int i = 0 ; i < n ; i++) {
+        //Pad every box so that flat shapes (e.g. axis aligned walls) are not
+        //missed by the slab test through rounding
+        boxes[i].lower -= vec3(BVH_BOX_PADDING);
+        boxes[i].upper += vec3(BVH_BOX_PADDING);
+        centroids[i] = boxes[i].centroid();
+        primitiveIndices.push_back(i);
+    }
+
+    //A binary tree with n leaves has at most 2n - 1 nodes
+    nodes.reserve(2 * n);
+    BVHNode root;
+    root.leftFirst = 0;
+    root.count = n;
+    nodes.push_back(root);
+
+    Subdivide(0, 0, boxes, centroids);
+}
+
+//Recursively splits a node while that lowers its SAH cost
+void BVH::Subdivide(int nodeIndex, int depth, vector<AABB>& boxes, vector<vec3>& centroids) {
+    int first = nodes[nodeIndex].leftFirst;
+    int count = nodes[nodeIndex].count;
+
+    AABB bounds;
+    AABB centroidBounds;
+    for (int i = first ; i < first + count ; i++) {
+        bounds.grow(boxes[primitiveIndices[i]]);
+        centroidBounds.grow(centroids[primitiveIndices[i]]);
+    }
+    nodes[nodeIndex].bounds = bounds;
+
+    if (count <= 1) return;
+
+    int axis = 0;
+    int splitIndex = 0;
+    bool flat = false;
+    float splitCost = FindBestSplit(nodes[nodeIndex], boxes, centroids, axis, splitIndex, flat);
+    float leafCost = count * SAH_INTERSECTION_COST;
+    if (splitCost >= leafCost && count <= MAX_LEAF_PRIMITIVES) return;
+
+    //When every split of a large node costs the same (e.g. identical boxes)
+    //the sweep would peel off one primitive per level, so halve it instead
+    if ((flat && count > MAX_LEAF_PRIMITIVES) || depth >= BVH_MEDIAN_DEPTH) {
+        splitIndex = MedianSplit(first, count, centroidBounds, centroids);
+    }
+
+    //FindBestSplit leaves the primitives sorted along the chosen axis
+    BVHNode left;
+    left.leftFirst = first;
+    left.count = splitIndex;
+    BVHNode right;
+    right.leftFirst = first + splitIndex;
+    right.count = count - splitIndex;
+
+    int leftIndex = nodes.size();
+    nodes.push_back(left);
+    nodes.push_back(right);
+
+    nodes[nodeIndex].leftFirst = leftIndex;
+    nodes[nodeIndex].count = 0;
+
+    Subdivide(leftIndex, depth + 1, boxes, centroids);
+    Subdivide(leftIndex + 1, depth + 1, boxes, centroids);
+}
+
+//Sweeps the primitives sorted by centroid along each axis and returns the
+//lowest SAH cost of splitting them into [0, splitIndex) and [splitIndex, count).
+//flat is set if no split is any cheaper than the others
+float BVH::FindBestSplit(BVHNode& node, vector<AABB>& boxes, vector<vec3>& centroids, int& axis, int& splitIndex, bool& flat) {
+    int first = node.leftFirst;
+    int count = node.count;
+    vector<int>::iterator begin = primitiveIndices.begin() + first;
+    vector<int>::iterator end = begin + count;
+
+    float parentArea = max(node.bounds.surfaceArea(), numeric_limits<float>::min());
+    float bestCost = numeric_limits<float>::max();
+    float worstCost = 0;
+
+    //Surface area of the box around the first i + 1 primitives
+    vector<float> leftArea(count);
+
+    for (int a = 0 ; a < 3 ; a++) {
+        sort(begin, end, [&](int p, int q) { return centroids[p][a] < centroids[q][a]; });
+
+        AABB leftBox;
+        for (int i = 0 ; i < count ; i++) {
+            leftBox.grow(boxes[primitiveIndices[first + i]]);
+            leftArea[i] = leftBox.surfaceArea();
+        }
+
+        AABB rightBox;
+        for (int i = count - 1 ; i > 0 ; i--) {
+            rightBox.grow(boxes[primitiveIndices[first + i]]);
+            float cost = SAH_TRAVERSAL_COST + SAH_INTERSECTION_COST *
+                (leftArea[i - 1] * i + rightBox.surfaceArea() * (count - i)) / parentArea;
+            worstCost = max(worstCost, cost);
+            if (cost < bestCost) {
+                bestCost = cost;
+                axis = a;
+                splitIndex = i;
+            }
+        }
+    }
+
+    if (axis != 2) {
+        sort(begin, end, [&](int p, int q) { return centroids[p][axis] < centroids[q][axis]; });
+    }
+    flat = FlatCost(bestCost, worstCost);
+    return bestCost;
+}
+
+//Builds the hierarchy with binned SAH: each node only considers BVH_NUM_BINS
+//split planes per axis. Binning of the large top level nodes is spread over
+//all threads and every subtree above BVH_TASK_THRESHOLD is built as a task
+void BVH::BuildBinned(vector<AABB> boxes) {
+    nodes.clear();
+    primitiveIndices.clear();
+    parents.clear();
+
+    int n = boxes.size();
+    if (n == 0) return;
+
+    vector<vec3> centroids(n);
+    primitiveIndices.resize(n);
+
+    AABB bounds;
+    AABB centroidBounds;
+    #pragma omp parallel
+    {
+        AABB threadBounds;
+        AABB threadCentroidBounds;
+        #pragma omp for
+        for (int i = 0 ; i < n ; i++) {
+            boxes[i].lower -= vec3(BVH_BOX_PADDING);
+            boxes[i].upper += vec3(BVH_BOX_PADDING);
+            centroids[i] = boxes[i].centroid();
+            primitiveIndices[i] = i;
+            threadBounds.grow(boxes[i]);
+            threadCentroidBounds.grow(centroids[i]);
+        }
+        #pragma omp critical
+        {
+            bounds.grow(threadBounds);
+            centroidBounds.grow(threadCentroidBounds);
+        }
+    }
+
+    //Children are allocated in pairs from a counter so tasks can build
+    //subtrees concurrently; a binary tree over n primitives needs < 2n nodes
+    nodes.resize(2 * n);
+    nodes[0].bounds = bounds;
+    nodes[0].leftFirst = 0;
+    nodes[0].count = n;
+    atomic<int> nodesUsed(1);
+
+    #pragma omp parallel
+    {
+        #pragma omp single
+        SubdivideBinned(0, 0, centroidBounds, boxes, centroids, nodesUsed);
+    }
+
+    nodes.resize(nodesUsed);
+}
+
+//Splits a node at the best bin boundary. The parent has already set the
+//node's bounds, and the children's bounds are read off the bins
+void BVH::SubdivideBinned(int nodeIndex, int depth, AABB centroidBounds, vector<AABB>& boxes, vector<vec3>& centroids, atomic<int>& nodesUsed) {
+    int first = nodes[nodeIndex].leftFirst;
+    int count = nodes[nodeIndex].count;
+    if (count <= 1) return;
+
+    vector<BVHBin> bins;
+    FillBins(first, count, centroidBounds, boxes, centroids, bins);
+
+    int axis = 0;
+    int splitBin = 0;
+    bool flat = false;
+    float splitCost = FindBestBinnedSplit(bins, nodes[nodeIndex].bounds.surfaceArea(), axis, splitBin, flat);
+    float leafCost = count * SAH_INTERSECTION_COST;
+    if (splitCost >= leafCost && count <= MAX_LEAF_PRIMITIVES) return;
+
+    BVHBin left;
+    BVHBin right;
+    vector<int>::iterator begin = primitiveIndices.begin() + first;
+    vector<int>::iterator end = begin + count;
+
+    bool median = (flat && count > MAX_LEAF_PRIMITIVES) || depth >= BVH_MEDIAN_DEPTH;
+    if (splitCost < numeric_limits<float>::max() && !median) {
+        for (int b = 0 ; b < BVH_NUM_BINS ; b++) {
+            BVHBin& bin = bins[axis * BVH_NUM_BINS + b];
+            BVHBin& side = b < splitBin ? left : right;
+            side.bounds.grow(bin.bounds);
+            side.centroidBounds.grow(bin.centroidBounds);
+            side.count += bin.count;
+        }
+        float lower = centroidBounds.lower[axis];
+        float scale = BinScale(centroidBounds)[axis];
+        partition(begin, end, [&](int p) { return BinIndex(centroids[p][axis], lower, scale) < splitBin; });
+    }
+    else {
+        //No plane separates the centroids, or none is better than another
+        //and the tree could grow a level per primitive, so halve the node
+        int median = MedianSplit(first, count, centroidBounds, centroids);
+        for (int i = 0 ; i < count ; i++) {
+            int p = primitiveIndices[first + i];
+            BVHBin& side = i < median ? left : right;
+            side.bounds.grow(boxes[p]);
+            side.centroidBounds.grow(centroids[p]);
+            side.count++;
+        }
+    }
+
+    int leftIndex = nodesUsed.fetch_add(2);
+    nodes[leftIndex].bounds = left.bounds;
+    nodes[leftIndex].leftFirst = first;
+    nodes[leftIndex].count = left.count;
+    nodes[leftIndex + 1].bounds = right.bounds;
+    nodes[leftIndex + 1].leftFirst = first + left.count;
+    nodes[leftIndex + 1].count = right.count;
+
+    nodes[nodeIndex].leftFirst = leftIndex;
+    nodes[nodeIndex].count = 0;
+
+    if (count > BVH_TASK_THRESHOLD) {
+        #pragma omp task shared(boxes, centroids, nodesUsed)
+        SubdivideBinned(leftIndex, depth + 1, left.centroidBounds, boxes, centroids, nodesUsed);
+        SubdivideBinned(leftIndex + 1, depth + 1, right.centroidBounds, boxes, centroids, nodesUsed);
+    }
+    else {
+        SubdivideBinned(leftIndex, depth + 1, left.centroidBounds, boxes, centroids, nodesUsed);
+        SubdivideBinned(leftIndex + 1, depth + 1, right.centroidBounds, boxes, centroids, nodesUsed);
+    }
+}
+
+//Counts the primitives of a node into bins along each axis. Nodes above
+//BVH_PARALLEL_BIN_THRESHOLD are binned in chunks by separate tasks
+void BVH::FillBins(int first, int count, const AABB& centroidBounds, vector<AABB>& boxes, vector<vec3>& centroids, vector<BVHBin>& bins) {
+    vec3 scale = BinScale(centroidBounds);
+    vec3 lower = centroidBounds.lower;
+
+    int numChunks = count >= BVH_PARALLEL_BIN_THRESHOLD ? 2 * omp_get_num_threads() : 1;
+    vector< vector<BVHBin> > chunkBins(numChunks, vector<BVHBin>(3 * BVH_NUM_BINS));
+
+    for (int c = 0 ; c < numChunks ; c++) {
+        #pragma omp task shared(chunkBins, boxes, centroids, scale, lower) if(numChunks > 1)
+        {
+            int begin = first + (int)((long)count * c / numChunks);
+            int end = first + (int)((long)count * (c + 1) / numChunks);
+            vector<BVHBin>& chunk = chunkBins[c];
+            for (int i = begin ; i < end ; i++) {
+                int p = primitiveIndices[i];
+                for (int a = 0 ; a < 3 ; a++) {
+                    BVHBin& bin = chunk[a * BVH_NUM_BINS + BinIndex(centroids[p][a], lower[a], scale[a])];
+                    bin.bounds.grow(boxes[p]);
+                    bin.centroidBounds.grow(centroids[p]);
+                    bin.count++;
+                }
+            }
+        }
+    }
+    #pragma omp taskwait
+
+    bins = chunkBins[0];
+    for (int c = 1 ; c < numChunks ; c++) {
+        for (int b = 0 ; b < 3 * BVH_NUM_BINS ; b++) {
+            bins[b].bounds.grow(chunkBins[c][b].bounds);
+            bins[b].centroidBounds.grow(chunkBins[c][b].centroidBounds);
+            bins[b].count += chunkBins[c][b].count;
+        }
+    }
+}
+
+//Sweeps the bin boundaries of each axis and returns the lowest SAH cost of
+//putting bins [0, splitBin) on the left, or the largest float if no
+//boundary leaves primitives on both sides. flat is set if no boundary is
+//any cheaper than the others
+float BVH::FindBestBinnedSplit(vector<BVHBin>& bins, float parentArea, int& axis, int& splitBin, bool& flat) {
+    parentArea = max(parentArea, numeric_limits<float>::min());
+    float bestCost = numeric_limits<float>::max();
+    float worstCost = 0;
+
+    float leftArea[BVH_NUM_BINS];
+    int leftCount[BVH_NUM_BINS];
+
+    for (int a = 0 ; a < 3 ; a++) {
+        BVHBin* axisBins = &bins[a * BVH_NUM_BINS];
+
+        AABB leftBox;
+        int leftSum = 0;
+        for (int b = 0 ; b < BVH_NUM_BINS - 1 ; b++) {
+            leftBox.grow(axisBins[b].bounds);
+            leftSum += axisBins[b].count;
+            leftArea[b] = leftBox.surfaceArea();
+            leftCount[b] = leftSum;
+        }
+
+        AABB rightBox;
+        int rightSum = 0;
+        for (int b = BVH_NUM_BINS - 1 ; b > 0 ; b--) {
+            rightBox.grow(axisBins[b].bounds);
+            rightSum += axisBins[b].count;
+            if (leftCount[b - 1] == 0 || rightSum == 0) continue;
+            float cost = SAH_TRAVERSAL_COST + SAH_INTERSECTION_COST *
+                (leftArea[b - 1] * leftCount[b - 1] + rightBox.surfaceArea() * rightSum) / parentArea;
+            worstCost = max(worstCost, cost);
+            if (cost < bestCost) {
+                bestCost = cost;
+                axis = a;
+                splitBin = b;
+            }
+        }
+    }
+    flat = FlatCost(bestCost, worstCost);
+    return bestCost;
+}
+
+int BVH::MedianSplit(int first, int count, const AABB& centroidBounds, vector<vec3>& centroids) {
+    vec3 extent = centroidBounds.upper - centroidBounds.lower;
+    int axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : (extent.y >= extent.z ? 1 : 2);
+    vector<int>::iterator begin = primitiveIndices.begin() + first;
+    nth_element(begin, begin + count / 2, begin + count, [&](int p, int q) { return centroids[p][axis] < centroids[q][axis]; });
+    return count / 2;
+}
+
+//Costs within rounding of each other, as sums of the same areas in another
+//order come out
+bool BVH::FlatCost(float bestCost, float worstCost) {
+    return bestCost < numeric_limits<float>::max() && worstCost - bestCost <= 1e-5f * bestCost;
+}
+
+vec3 BVH::BinScale(const AABB& centroidBounds) {
+    vec3 extent = centroidBounds.upper - centroidBounds.lower;
+    vec3 scale;
+    for (int a = 0 ; a < 3 ; a++) {
+        scale[a] = extent[a] > 0 ? BVH_NUM_BINS / extent[a] : 0.0f;
+    }
+    return scale;
+}
+
+int BVH::BinIndex(float centroid, float lower, float scale) {
+    return min(BVH_NUM_BINS - 1, (int)((centroid - lower) * scale));
+}
+
+//Expected cost of tracing a ray through the tree: every node is weighted by
+//the probability (relative surface area) of a ray that hits the root hitting it
+float BVH::SAHCost() {
+    if (nodes.empty()) return 0.0f;
+
+    float rootArea = max(nodes[0].bounds.surfaceArea(), numeric_limits<float>::min());
+    float cost = 0.0f;
+    for (int i = 0 ; i < nodes.size() ; i++) {
+        float p = nodes[i].bounds.surfaceArea() / rootArea;
+        if (nodes[i].count > 0) {
+            cost += p * nodes[i].count * SAH_INTERSECTION_COST;
+        } else {
+            cost += p * SAH_TRAVERSAL_COST;
+        }
+    }
+    return cost;
+}
+
+//Node i contributes area * cost to the sum, and the tree's cost is the sum
+//over the root's area, so a refit only has to adjust the nodes it touches
+static double NodeAreaCost(const BVHNode& node) {
+    return node.bounds.surfaceArea() * (node.count > 0 ? node.count * SAH_INTERSECTION_COST : SAH_TRAVERSAL_COST);
+}
+
+void BVH::PrepareRefit() {
+    parents.assign(nodes.size(), -1);
+    areaCost = 0.0;
+    for (int i = 0 ; i < nodes.size() ; i++) {
+        if (nodes[i].count == 0) {
+            parents[nodes[i].leftFirst] = i;
+            parents[nodes[i].leftFirst + 1] = i;
+        }
+        areaCost += NodeAreaCost(nodes[i]);
+    }
+    builtCost = areaCost / max(nodes.empty() ? 0.0f : nodes[0].bounds.surfaceArea(), numeric_limits<float>::min());
+}
+
+bool BVH::isRefitPrepared() {
+    return parents.size() == nodes.size() && !nodes.empty();
+}
+
+void BVH::RefitLeaf(int node, AABB bounds) {
+    areaCost -= NodeAreaCost(nodes[node]);
+    nodes[node].bounds = bounds;
+    areaCost += NodeAreaCost(nodes[node]);
+
+    for (int i = parents[node] ; i >= 0 ; i = parents[i]) {
+        AABB box = nodes[nodes[i].leftFirst].bounds;
+        box.grow(nodes[nodes[i].leftFirst + 1].bounds);
+        if (box.lower == nodes[i].bounds.lower && box.upper == nodes[i].bounds.upper) break;
+        areaCost -= NodeAreaCost(nodes[i]);
+        nodes[i].bounds = box;
+        areaCost += NodeAreaCost(nodes[i]);
+    }
+}
+
+float BVH::RefitCostRatio() {
+    double cost = areaCost / max(nodes[0].bounds.surfaceArea(), numeric_limits<float>::min());
+    return cost / builtCost;
+}
+
+// GETTERS
+int BVH::getNumNodes() {
+    return nodes.size();
+}
+
+vector<BVHNode>& BVH::getNodes() {
+    return nodes;
+}
+
+vector<int>& BVH::getPrimitiveIndices() {
+    return primitiveIndices;
+}
@@ -0,0 +1,114 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <atomic>
+#include "AABB.h"
+
+using namespace std;
+using glm::vec3;
+using glm::mat3;
+using glm::vec4;
+using glm::mat4;
+
+// Relative costs of stepping into a node and of one primitive test, used by
+// the surface area heuristic
+#define SAH_TRAVERSAL_COST 1.0f
+#define SAH_INTERSECTION_COST 1.0f
+// Leaves are always split above this many primitives
+#define MAX_LEAF_PRIMITIVES 4
+#define BVH_STACK_SIZE 128
+// Below this depth nodes are split at the object median whatever their SAH
+// cost. Halving adds at most 31 levels more, so traversal never needs more
+// than BVH_STACK_SIZE entries
+#define BVH_MEDIAN_DEPTH (BVH_STACK_SIZE - 32)
+#define BVH_BOX_PADDING 1e-4f
+
+// Binned builder: candidate split planes per axis, the node size above which
+// binning is spread over all threads, and the subtree size above which the
+// children are built as separate tasks
+#define BVH_NUM_BINS 16
+#define BVH_PARALLEL_BIN_THRESHOLD 65536
+#define BVH_TASK_THRESHOLD 1024
+
+// Refitted trees are rebuilt once their SAH cost grows this many times over
+// the cost of the tree as built
+#define BVH_REFIT_REBUILD_RATIO 1.5f
+
+// A node is a leaf if count > 0, in which case its primitives are
+// primitiveIndices[leftFirst .. leftFirst + count). Otherwise its children are
+// nodes[leftFirst] and nodes[leftFirst + 1]
+struct BVHNode {
+    AABB bounds;
+    int leftFirst;
+    int count;
+};
+
+// Primitives whose centroids fall into one slab of a node's centroid bounds
+struct BVHBin {
+    AABB bounds;
+    AABB centroidBounds;
+    int count = 0;
+};
+
+class BVH {
+
+    private:
+        vector<BVHNode> nodes;
+        vector<int> primitiveIndices;
+
+        // Filled by PrepareRefit: each node's parent, -1 for the root, the
+        // SAH cost as built, and the sum of the nodes' area weighted costs
+        // that RefitLeaf keeps up to date
+        vector<int> parents;
+        double builtCost;
+        double areaCost;
+
+        void Subdivide(int nodeIndex, int depth, vector<AABB>& boxes, vector<vec3>& centroids);
+        float FindBestSplit(BVHNode& node, vector<AABB>& boxes, vector<vec3>& centroids, int& axis, int& splitIndex, bool& flat);
+
+        void SubdivideBinned(int nodeIndex, int depth, AABB centroidBounds, vector<AABB>& boxes, vector<vec3>& centroids, atomic<int>& nodesUsed);
+        void FillBins(int first, int count, const AABB& centroidBounds, vector<AABB>& boxes, vector<vec3>& centroids, vector<BVHBin>& bins);
+        float FindBestBinnedSplit(vector<BVHBin>& bins, float parentArea, int& axis, int& splitBin, bool& flat);
+        static vec3 BinScale(const AABB& centroidBounds);
+        static int BinIndex(float centroid, float lower, float scale);
+
+        // Sorts the node's primitives about their centroid median along the
+        // widest axis of centroidBounds and returns the median's offset
+        int MedianSplit(int first, int count, const AABB& centroidBounds, vector<vec3>& centroids);
+        static bool FlatCost(float bestCost, float worstCost);
+
+    public:
+        // CONSTRUCTOR
+        BVH();
+
+        // Build the hierarchy over primitives with the given bounding boxes using
+        // the surface area heuristic, either testing every split (slow, best
+        // trees) or binned and in parallel. Leaves refer to primitives by their
+        // index in boxes
+        void Build(vector<AABB> boxes);
+        void BuildBinned(vector<AABB> boxes);
+
+        // SAH cost of the built tree, in units of one primitive test
+        float SAHCost();
+
+        // Refitting. PrepareRefit must be called after each build, before the
+        // first RefitLeaf. RefitLeaf sets a leaf's bounds and updates its
+        // ancestors' bounds and the running SAH cost, stopping at the first
+        // ancestor that does not change, so refits cost time in proportion
+        // to the leaves that moved rather than the size of the tree
+        void PrepareRefit();
+        bool isRefitPrepared();
+        void RefitLeaf(int node, AABB bounds);
+
+        // SAH cost now over the SAH cost as built, without walking the tree
+        float RefitCostRatio();
+
+        // GETTERS
+        int getNumNodes();
+        vector<BVHNode>& getNodes();
+        vector<int>& getPrimitiveIndices();
+};
+
+#endif
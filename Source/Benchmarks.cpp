@@ -0,0 +1,1388 @@
+#include "Benchmarks.h"
+
+#include <iostream>
+#include <algorithm>
+#include <limits>
+#include <omp.h>
+
+#include "Camera.h"
+#include "Light.h"
+#include "Ray.h"
+#include "ImageBuffer.h"
+#include "LightSphere.h"
+#include "LightTree.h"
+#include "EmissiveShapes.h"
+#include "Material.h"
+#include "PhotonMap.h"
+#include "IrradianceCache.h"
+#include "KDTree.h"
+#include "Scene.h"
+#include "TrianglePackets.h"
+#include "WideBVH.h"
+#include "Mesh.h"
+
+using namespace std;
+using glm::vec3;
+using glm::mat3;
+using glm::vec4;
+using glm::mat4;
+
+/* ----------------------------------------------------------------------------*/
+/* SHARED WITH RAYTRACER.CPP                                                   */
+
+//LightsAndMaterials.h defines these, so only raytracer.cpp can include it
+extern LightSphere ls;
+extern Material defaultWhite;
+extern vec3 white;
+extern vec3 ambientColour;
+extern vec3 diffuseColour;
+extern vec3 specularColour;
+extern float power;
+
+void loadShapes(
+vector<Triangle>& triangles,
+vector<Sphere>& spheres,
+vector<Quad>& quads,
+vector<Box>& boxes,
+bool analytic
+);
+
+vec4 PrimaryRayDirection(
+int x,
+int y,
+const vec3& right,
+const vec3& up,
+const vec3& forward
+);
+
+/* ----------------------------------------------------------------------------*/
+/* FUNCTIONS                                                                   */
+
+void BenchmarkBVH();
+void BenchmarkPrimaryRays();
+void BenchmarkMeshMemory();
+void BenchmarkTriangleKernel();
+void BenchmarkInstancing();
+void BenchmarkRefit();
+void BenchmarkWideBVH();
+void BenchmarkAnalyticPrimitives();
+void BenchmarkWavefront();
+void BenchmarkLightSampling();
+void BenchmarkLightTree();
+void BenchmarkEmissiveShapes();
+void BenchmarkOccluderCache();
+void BenchmarkShadowPhotons();
+void BenchmarkPathCutoff();
+void BenchmarkGathers();
+void BenchmarkRayCones();
+void BenchmarkIrradianceCache();
+void BenchmarkFinalGather();
+
+static BenchmarkSettings settings;
+
+void RunBenchmarks(BenchmarkSettings benchmarkSettings) {
+    settings = benchmarkSettings;
+
+    BenchmarkTriangleKernel();
+    BenchmarkPrimaryRays();
+    BenchmarkMeshMemory();
+    BenchmarkInstancing();
+    BenchmarkRefit();
+    BenchmarkWideBVH();
+    BenchmarkAnalyticPrimitives();
+    BenchmarkWavefront();
+    BenchmarkLightSampling();
+    BenchmarkLightTree();
+    BenchmarkEmissiveShapes();
+    BenchmarkOccluderCache();
+    BenchmarkShadowPhotons();
+    BenchmarkPathCutoff();
+    BenchmarkGathers();
+    BenchmarkRayCones();
+    BenchmarkIrradianceCache();
+    BenchmarkFinalGather();
+    BenchmarkBVH();
+}
+
+void LoadCornellBox(CornellBox& room, bool analytic, vector<Quad> extraQuads) {
+    loadShapes(room.triangles, room.spheres, room.quads, room.boxes, analytic);
+    room.quads.insert(room.quads.end(), extraQuads.begin(), extraQuads.end());
+
+    //Taken once the vectors are done growing
+    room.shapes.clear();
+    for (int i = 0 ; i < room.triangles.size() ; i++) {
+        room.shapes.push_back(&room.triangles[i]);
+    }
+    for (int i = 0 ; i < room.spheres.size() ; i++) {
+        room.shapes.push_back(&room.spheres[i]);
+    }
+    for (int i = 0 ; i < room.quads.size() ; i++) {
+        room.shapes.push_back(&room.quads[i]);
+    }
+    for (int i = 0 ; i < room.boxes.size() ; i++) {
+        room.shapes.push_back(&room.boxes[i]);
+    }
+}
+
+
+//Measures BVH build time, tree quality and closest hit and shadow rays per
+//second for the sweep and binned builders against the linear loop over every
+//shape, for random triangle soups of increasing size
+vector<PathStart> PrimaryStarts(Scene& scene, Camera& camera, int stride, bool cones, bool diffuseOnly) {
+    vec3 right, up, forward;
+    camera.getBasis(right, up, forward);
+    vector<PathStart> starts;
+    for (int pixel = 0 ; pixel < SCREEN_WIDTH * SCREEN_HEIGHT ; pixel += stride) {
+        Intersection intersection;
+        if (!scene.closestIntersection(camera.getPosition(), PrimaryRayDirection(pixel / SCREEN_WIDTH, pixel % SCREEN_WIDTH, right, up, forward), intersection)) continue;
+        Material& material = scene.getMaterial(intersection.index);
+        if (diffuseOnly && (material.isReflective() || material.isTransparent() || material.getEmitted() != vec3(0))) continue;
+
+        //As DrawWavefront starts its paths, with the cone a pixel wide at the
+        //focal length
+        vec3 incidentDir = vec3(intersection.position - camera.getPosition());
+        Ray incidentRay(intersection.position, vec4(normalize(incidentDir), 1));
+        if (cones) {
+            float eyeDistance = length(incidentDir);
+            incidentRay.setCone(eyeDistance / settings.focalLength, 1.0f / settings.focalLength, eyeDistance);
+        }
+        starts.push_back({intersection, incidentRay, pixel, 1.0f});
+    }
+    return starts;
+}
+
+void BenchmarkBVH() {
+    int sizes[] = {33, 1000, 10000, 100000, 1000000};
+    int numRays = 10000;
+
+    for (int s = 0 ; s < 5 ; s++) {
+        int n = sizes[s];
+
+        //Keep the scene density roughly constant as the count grows
+        float size = 2.0f / cbrt((float)n);
+        vector<Triangle> triangles;
+        for (int i = 0 ; i < n ; i++) {
+            vec4 v0(((float) rand() / (RAND_MAX)) * 2 - 1, ((float) rand() / (RAND_MAX)) * 2 - 1, ((float) rand() / (RAND_MAX)) * 2 - 1, 1);
+            vec4 v1 = v0 + vec4(((float) rand() / (RAND_MAX)) * size, ((float) rand() / (RAND_MAX)) * size, 0, 0);
+            vec4 v2 = v0 + vec4(0, ((float) rand() / (RAND_MAX)) * size, ((float) rand() / (RAND_MAX)) * size, 0);
+            triangles.push_back(Triangle(v0, v1, v2, defaultWhite));
+        }
+        vector<Shape *> shapes;
+        for (int i = 0 ; i < triangles.size() ; i++) {
+            shapes.push_back(&triangles[i]);
+        }
+
+        vector<Ray> rays;
+        for (int i = 0 ; i < numRays ; i++) {
+            vec4 start(((float) rand() / (RAND_MAX)) * 2 - 1, ((float) rand() / (RAND_MAX)) * 2 - 1, ((float) rand() / (RAND_MAX)) * 2 - 1, 1);
+            vec4 dir(((float) rand() / (RAND_MAX)) - 0.5f, ((float) rand() / (RAND_MAX)) - 0.5f, ((float) rand() / (RAND_MAX)) - 0.5f, 1);
+            rays.push_back(Ray(start, dir));
+        }
+
+        cout << n << " shapes:" << endl;
+        for (int binned = 0 ; binned < 2 ; binned++) {
+            Scene scene(shapes, binned == 1);
+
+            int bvhHits = 0;
+            double bvhStart = omp_get_wtime();
+            for (int i = 0 ; i < numRays ; i++) {
+                Intersection intersection;
+                if (rays[i].closestIntersection(scene, intersection)) bvhHits++;
+            }
+            double bvhTime = omp_get_wtime() - bvhStart;
+            cout << "    " << (binned ? "binned" : "sweep ") << " BVH " << numRays / bvhTime << " rays/s (" << bvhHits << " hits)" << endl;
+
+            //Shadow rays to a point shadowDistance away, checked against the closest hit
+            float shadowDistance = 0.5f;
+            int occludedRays = 0;
+            double shadowStart = omp_get_wtime();
+            for (int i = 0 ; i < numRays ; i++) {
+                if (scene.occluded(rays[i].getStart(), rays[i].getDirection(), shadowDistance)) occludedRays++;
+            }
+            double shadowTime = omp_get_wtime() - shadowStart;
+            int shadowMismatches = 0;
+            for (int i = 0 ; i < numRays ; i++) {
+                Intersection intersection;
+                bool blocked = rays[i].closestIntersection(scene, intersection) && intersection.distance * SCREEN_HEIGHT < shadowDistance;
+                if (blocked != scene.occluded(rays[i].getStart(), rays[i].getDirection(), shadowDistance)) shadowMismatches++;
+            }
+            cout << "           shadow " << numRays / shadowTime << " rays/s (" << occludedRays << " occluded, " << shadowMismatches << " disagree with closest hit)" << endl;
+        }
+
+        //The linear loop is O(n) per ray so trace fewer rays through big scenes
+        int numLinearRays = min(numRays, max(100, 20000000 / n));
+        int linearHits = 0;
+        double linearStart = omp_get_wtime();
+        for (int i = 0 ; i < numLinearRays ; i++) {
+            Intersection intersection;
+            if (rays[i].closestIntersection(shapes, intersection)) linearHits++;
+        }
+        double linearTime = omp_get_wtime() - linearStart;
+        cout << "    linear     " << numLinearRays / linearTime << " rays/s (" << linearHits << " hits)" << endl;
+    }
+}
+
+
+//Checks the packet triangle kernel agrees with Triangle::intersects on hit or
+//miss for every ray and triangle pair, then compares the two in triangle
+//tests per second
+void BenchmarkTriangleKernel() {
+    int n = 4096;
+    int numRays = 2000;
+
+    vector<Triangle> triangles;
+    for (int i = 0 ; i < n ; i++) {
+        vec4 v0(((float) rand() / (RAND_MAX)) * 2 - 1, ((float) rand() / (RAND_MAX)) * 2 - 1, ((float) rand() / (RAND_MAX)) * 2 - 1, 1);
+        vec4 v1 = v0 + vec4(((float) rand() / (RAND_MAX)) - 0.5f, ((float) rand() / (RAND_MAX)) - 0.5f, ((float) rand() / (RAND_MAX)) - 0.5f, 0);
+        vec4 v2 = v0 + vec4(((float) rand() / (RAND_MAX)) - 0.5f, ((float) rand() / (RAND_MAX)) - 0.5f, ((float) rand() / (RAND_MAX)) - 0.5f, 0);
+        triangles.push_back(Triangle(v0, v1, v2, defaultWhite));
+    }
+
+    vector<vec4> starts;
+    vector<vec4> dirs;
+    for (int i = 0 ; i < numRays ; i++) {
+        starts.push_back(vec4(((float) rand() / (RAND_MAX)) * 2 - 1, ((float) rand() / (RAND_MAX)) * 2 - 1, ((float) rand() / (RAND_MAX)) * 2 - 1, 1));
+        dirs.push_back(vec4(normalize(vec3(((float) rand() / (RAND_MAX)) - 0.5f, ((float) rand() / (RAND_MAX)) - 0.5f, ((float) rand() / (RAND_MAX)) - 0.5f)), 1));
+    }
+
+    //Each triangle tested on its own so every pair can be compared
+    TrianglePackets single;
+    for (int i = 0 ; i < n ; i++) {
+        vector<vec3> run;
+        run.push_back(vec3(triangles[i].getV0()));
+        run.push_back(vec3(triangles[i].getV1()));
+        run.push_back(vec3(triangles[i].getV2()));
+        vector<int> runShapes(1, i);
+        single.AddRun(run, runShapes);
+    }
+    long hits = 0;
+    long mismatches = 0;
+    for (int r = 0 ; r < numRays ; r++) {
+        vec4 dirScaled = vec4(vec3(dirs[r]) * (float)SCREEN_HEIGHT, 1);
+        for (int i = 0 ; i < n ; i++) {
+            Intersection reference;
+            reference.distance = numeric_limits<float>::max();
+            Intersection packet;
+            packet.distance = numeric_limits<float>::max();
+            bool referenceHit = triangles[i].intersects(starts[r], dirs[r], reference, i);
+            bool packetHit = single.Intersect(i, 1, starts[r], dirScaled, packet);
+            if (referenceHit) hits++;
+            if (referenceHit != packetHit) mismatches++;
+        }
+    }
+    cout << "Triangle kernel: " << mismatches << " hit/miss mismatches in " << (long)n * numRays << " tests (" << hits << " hits)" << endl;
+
+    //Closest hit over all the triangles, scalar Cramer against full packets
+    TrianglePackets packed;
+    vector<vec3> run;
+    vector<int> runShapes;
+    for (int i = 0 ; i < n ; i++) {
+        run.push_back(vec3(triangles[i].getV0()));
+        run.push_back(vec3(triangles[i].getV1()));
+        run.push_back(vec3(triangles[i].getV2()));
+        runShapes.push_back(i);
+    }
+    packed.AddRun(run, runShapes);
+
+    int referenceAgree = 0;
+    vector<int> referenceIndex(numRays, -1);
+    double cramerStart = omp_get_wtime();
+    for (int r = 0 ; r < numRays ; r++) {
+        Intersection closest;
+        closest.distance = numeric_limits<float>::max();
+        for (int i = 0 ; i < n ; i++) {
+            if (triangles[i].intersects(starts[r], dirs[r], closest, i)) referenceIndex[r] = i;
+        }
+    }
+    double cramerTime = omp_get_wtime() - cramerStart;
+
+    double packetStart = omp_get_wtime();
+    for (int r = 0 ; r < numRays ; r++) {
+        vec4 dirScaled = vec4(vec3(dirs[r]) * (float)SCREEN_HEIGHT, 1);
+        Intersection closest;
+        closest.distance = numeric_limits<float>::max();
+        int index = packed.Intersect(0, n, starts[r], dirScaled, closest) ? closest.index : -1;
+        if (index == referenceIndex[r]) referenceAgree++;
+    }
+    double packetTime = omp_get_wtime() - packetStart;
+
+    double tests = (double)n * numRays;
+    cout << "    Cramer  " << tests / cramerTime << " tests/s" << endl;
+    cout << "    packets " << tests / packetTime << " tests/s (" << referenceAgree << "/" << numRays << " closest hits agree)" << endl;
+}
+
+
+//Compares primary rays per second for the Cornell box traced one pixel at a
+//time, as Draw does without packets, against tiles traced as ray packets
+void BenchmarkPrimaryRays() {
+    CornellBox room;
+    LoadCornellBox(room, settings.analytic);
+    Scene scene(room.shapes, settings.binnedBuild);
+    Camera camera(vec4(0, 0, -3, 1));
+    camera.rotateRight(0.3f);
+    int numRays = SCREEN_WIDTH * SCREEN_HEIGHT;
+
+    vector<int> scalarIndex(numRays, -1);
+    double scalarStart = omp_get_wtime();
+    for (int x = 0 ; x < SCREEN_WIDTH ; x++) {
+        for (int y = 0 ; y < SCREEN_HEIGHT ; y++) {
+            vec4 dir((x - SCREEN_WIDTH / 2) , (y - SCREEN_HEIGHT / 2) , settings.focalLength , 1);
+            Ray ray(camera.getPosition(), dir);
+            ray.rotateRay(camera.getYaw());
+            Intersection closestIntersection;
+            if (ray.closestIntersection(scene, closestIntersection)) {
+                scalarIndex[SCREEN_WIDTH * x + y] = closestIntersection.index;
+            }
+        }
+    }
+    double scalarTime = omp_get_wtime() - scalarStart;
+
+    vec3 right, up, forward;
+    camera.getBasis(right, up, forward);
+    int agree = 0;
+    double packetStart = omp_get_wtime();
+    for (int x0 = 0 ; x0 < SCREEN_WIDTH ; x0 += RAY_PACKET_WIDTH) {
+        for (int y0 = 0 ; y0 < SCREEN_HEIGHT ; y0 += RAY_PACKET_WIDTH) {
+            RayPacket packet;
+            packet.start = camera.getPosition();
+            packet.count = 0;
+            int pixel[RAY_PACKET_SIZE];
+            for (int x = x0 ; x < min(x0 + RAY_PACKET_WIDTH, SCREEN_WIDTH) ; x++) {
+                for (int y = y0 ; y < min(y0 + RAY_PACKET_WIDTH, SCREEN_HEIGHT) ; y++) {
+                    pixel[packet.count] = SCREEN_WIDTH * x + y;
+                    packet.dir[packet.count++] = PrimaryRayDirection(x, y, right, up, forward);
+                }
+            }
+            Intersection closestIntersections[RAY_PACKET_SIZE];
+            bool hits[RAY_PACKET_SIZE];
+            scene.closestIntersections(packet, closestIntersections, hits);
+            for (int r = 0 ; r < packet.count ; r++) {
+                if ((hits[r] ? closestIntersections[r].index : -1) == scalarIndex[pixel[r]]) agree++;
+            }
+        }
+    }
+    double packetTime = omp_get_wtime() - packetStart;
+
+    cout << "Primary rays, " << RAY_PACKET_WIDTH << "x" << RAY_PACKET_WIDTH << " packets:" << endl;
+    cout << "    scalar  " << numRays / scalarTime << " rays/s" << endl;
+    cout << "    packets " << numRays / packetTime << " rays/s (" << agree << "/" << numRays << " hit the same shape)" << endl;
+}
+
+
+//Compares the memory per triangle of a height field stored as Triangle
+//shapes against the same surface as an indexed mesh, including the scene's
+//acceleration structure, and checks both give the same hits
+void BenchmarkMeshMemory() {
+    int k = 512;
+    Mesh mesh(defaultWhite);
+    for (int i = 0 ; i <= k ; i++) {
+        for (int j = 0 ; j <= k ; j++) {
+            float x = 2.0f * i / k - 1;
+            float z = 2.0f * j / k - 1;
+            mesh.AddVertex(vec3(x, 0.1f * sin(10 * x) * cos(10 * z), z));
+        }
+    }
+    for (int i = 0 ; i < k ; i++) {
+        for (int j = 0 ; j < k ; j++) {
+            int v = i * (k + 1) + j;
+            mesh.AddFace(v, v + 1, v + k + 1);
+            mesh.AddFace(v + 1, v + k + 2, v + k + 1);
+        }
+    }
+    int n = mesh.getNumFaces();
+
+    vector<Triangle> triangles;
+    for (int f = 0 ; f < n ; f++) {
+        vec3 v0, v1, v2;
+        mesh.getFace(f, v0, v1, v2);
+        triangles.push_back(Triangle(vec4(v0, 1), vec4(v1, 1), vec4(v2, 1), defaultWhite));
+    }
+    vector<Shape *> shapes;
+    for (int i = 0 ; i < triangles.size() ; i++) {
+        shapes.push_back(&triangles[i]);
+    }
+
+    cout << n << " triangle height field:" << endl;
+    Scene shapeScene(shapes, settings.binnedBuild);
+    vector<Mesh *> meshes(1, &mesh);
+    Scene meshScene(vector<Shape *>(), meshes, settings.binnedBuild);
+
+    int agree = 0;
+    int numRays = 10000;
+    for (int i = 0 ; i < numRays ; i++) {
+        vec4 start(((float) rand() / (RAND_MAX)) * 2 - 1, -1, ((float) rand() / (RAND_MAX)) * 2 - 1, 1);
+        vec4 dir(((float) rand() / (RAND_MAX)) - 0.5f, 1, ((float) rand() / (RAND_MAX)) - 0.5f, 1);
+        Ray ray(start, dir);
+        Intersection shapeHit;
+        Intersection meshHit;
+        bool shapeHitFound = ray.closestIntersection(shapeScene, shapeHit);
+        bool meshHitFound = ray.closestIntersection(meshScene, meshHit);
+        if (shapeHitFound == meshHitFound && (!shapeHitFound || (shapeHit.index == meshHit.index && shapeHit.distance == meshHit.distance))) agree++;
+    }
+
+    cout << "    Triangle shapes " << (float)(n * sizeof(Triangle) + shapes.size() * sizeof(Shape *)) / n << " + "
+         << (float)shapeScene.getMemoryUsage() / n << " scene bytes/triangle" << endl;
+    cout << "    indexed mesh    " << (float)mesh.getMemoryUsage() / n << " + "
+         << (float)meshScene.getMemoryUsage() / n << " scene bytes/triangle (" << agree << "/" << numRays << " rays agree)" << endl;
+}
+
+//Places copies of a height field tile over a grid, rotated, scaled and some
+//mirrored, once as instances of a shared scene and once flattened into one
+//mesh. Checks both give the same hits and compares memory and trace speed
+void BenchmarkInstancing() {
+    int k = 32;
+    vector<vec3> tileVertices;
+    Mesh tile(defaultWhite);
+    for (int i = 0 ; i <= k ; i++) {
+        for (int j = 0 ; j <= k ; j++) {
+            float x = 2.0f * i / k - 1;
+            float z = 2.0f * j / k - 1;
+            tileVertices.push_back(vec3(x, 0.1f * sin(10 * x) * cos(10 * z), z));
+            tile.AddVertex(tileVertices.back());
+        }
+    }
+    for (int i = 0 ; i < k ; i++) {
+        for (int j = 0 ; j < k ; j++) {
+            int v = i * (k + 1) + j;
+            tile.AddFace(v, v + 1, v + k + 1);
+            tile.AddFace(v + 1, v + k + 2, v + k + 1);
+        }
+    }
+    Scene object(vector<Shape *>(), vector<Mesh *>(1, &tile), settings.binnedBuild);
+
+    int side = 32;
+    vector<SceneInstance> instances;
+    Mesh flattened(defaultWhite);
+    for (int i = 0 ; i < side ; i++) {
+        for (int j = 0 ; j < side ; j++) {
+            float angle = ((float) rand() / (RAND_MAX)) * 2 * M_PI;
+            float scale = (0.6f + 0.3f * ((float) rand() / (RAND_MAX))) / side;
+            float mirror = rand() % 2 ? -1.0f : 1.0f;
+            mat4 M(1.0f);
+            M[0] = vec4(mirror * scale * cos(angle), 0, mirror * -scale * sin(angle), 0);
+            M[1] = vec4(0, scale, 0, 0);
+            M[2] = vec4(scale * sin(angle), 0, scale * cos(angle), 0);
+            M[3] = vec4((2.0f * i + 1) / side - 1, 0, (2.0f * j + 1) / side - 1, 1);
+
+            SceneInstance instance;
+            instance.object = &object;
+            instance.transform = M;
+            instances.push_back(instance);
+
+            //Mirrored copies are rewound as Mesh::Transform does
+            int base = flattened.getNumVertices();
+            for (int v = 0 ; v < tileVertices.size() ; v++) {
+                flattened.AddVertex(vec3(M * vec4(tileVertices[v], 1)));
+            }
+            for (int i = 0 ; i < k ; i++) {
+                for (int j = 0 ; j < k ; j++) {
+                    int v = base + i * (k + 1) + j;
+                    if (mirror > 0) {
+                        flattened.AddFace(v, v + 1, v + k + 1);
+                        flattened.AddFace(v + 1, v + k + 2, v + k + 1);
+                    } else {
+                        flattened.AddFace(v, v + k + 1, v + 1);
+                        flattened.AddFace(v + 1, v + k + 1, v + k + 2);
+                    }
+                }
+            }
+        }
+    }
+    int n = flattened.getNumFaces();
+
+    cout << instances.size() << " instances of a " << tile.getNumFaces() << " triangle tile:" << endl;
+    Scene flatScene(vector<Shape *>(), vector<Mesh *>(1, &flattened), settings.binnedBuild);
+    Scene instancedScene(vector<Shape *>(), vector<Mesh *>(), instances, settings.binnedBuild);
+
+    int numRays = 100000;
+    vector<Ray> rays;
+    for (int i = 0 ; i < numRays ; i++) {
+        vec4 start(((float) rand() / (RAND_MAX)) * 2 - 1, -1, ((float) rand() / (RAND_MAX)) * 2 - 1, 1);
+        vec4 dir(((float) rand() / (RAND_MAX)) - 0.5f, 1, ((float) rand() / (RAND_MAX)) - 0.5f, 1);
+        rays.push_back(Ray(start, dir));
+    }
+
+    int agree = 0;
+    int shadowAgree = 0;
+    int hits = 0;
+    for (int i = 0 ; i < numRays ; i++) {
+        Intersection flatHit;
+        Intersection instancedHit;
+        bool flatHitFound = rays[i].closestIntersection(flatScene, flatHit);
+        bool instancedHitFound = rays[i].closestIntersection(instancedScene, instancedHit);
+        if (flatHitFound) hits++;
+        //A ray through an edge may report either face, so only the distance is compared
+        if (flatHitFound == instancedHitFound && (!flatHitFound || fabs(flatHit.distance - instancedHit.distance) <= 1e-4f * flatHit.distance)) agree++;
+        if (flatScene.occluded(rays[i].getStart(), rays[i].getDirection(), 1.0f) == instancedScene.occluded(rays[i].getStart(), rays[i].getDirection(), 1.0f)) shadowAgree++;
+    }
+
+    Scene * scenes[2] = {&flatScene, &instancedScene};
+    double rate[2];
+    for (int s = 0 ; s < 2 ; s++) {
+        double start = omp_get_wtime();
+        for (int i = 0 ; i < numRays ; i++) {
+            Intersection intersection;
+            rays[i].closestIntersection(*scenes[s], intersection);
+        }
+        rate[s] = numRays / (omp_get_wtime() - start);
+    }
+
+    cout << "    flattened " << (float)(flattened.getMemoryUsage() + flatScene.getMemoryUsage()) / (1 << 20) << " MB, "
+         << rate[0] << " rays/s" << endl;
+    cout << "    instanced " << (float)(tile.getMemoryUsage() + object.getMemoryUsage() + instancedScene.getMemoryUsage()) / (1 << 20) << " MB, "
+         << rate[1] << " rays/s (" << agree << "/" << numRays << " rays and " << shadowAgree << " shadow rays agree, " << hits << " hits, " << n << " placed triangles)" << endl;
+}
+
+//Moves a fraction of a random triangle and sphere scene every frame, as an
+//animation would, and compares refitting the BVH with rebuilding it. The
+//refitted scene is checked against one built from scratch at the end
+void BenchmarkRefit() {
+    int n = 100000;
+    int numFrames = 50;
+    float size = 2.0f / cbrt((float)n);
+
+    vector<Triangle> triangles;
+    for (int i = 0 ; i < n ; i++) {
+        vec4 v0(((float) rand() / (RAND_MAX)) * 2 - 1, ((float) rand() / (RAND_MAX)) * 2 - 1, ((float) rand() / (RAND_MAX)) * 2 - 1, 1);
+        vec4 v1 = v0 + vec4(((float) rand() / (RAND_MAX)) * size, ((float) rand() / (RAND_MAX)) * size, 0, 0);
+        vec4 v2 = v0 + vec4(0, ((float) rand() / (RAND_MAX)) * size, ((float) rand() / (RAND_MAX)) * size, 0);
+        triangles.push_back(Triangle(v0, v1, v2, defaultWhite));
+    }
+    vector<Sphere> spheres;
+    for (int i = 0 ; i < n / 100 ; i++) {
+        vec4 centre(((float) rand() / (RAND_MAX)) * 2 - 1, ((float) rand() / (RAND_MAX)) * 2 - 1, ((float) rand() / (RAND_MAX)) * 2 - 1, 1);
+        spheres.push_back(Sphere(centre, size, defaultWhite));
+    }
+    vector<Shape *> shapes;
+    for (int i = 0 ; i < triangles.size() ; i++) {
+        shapes.push_back(&triangles[i]);
+    }
+    for (int i = 0 ; i < spheres.size() ; i++) {
+        shapes.push_back(&spheres[i]);
+    }
+
+    Scene scene(shapes, settings.binnedBuild);
+    cout << shapes.size() << " shapes, " << numFrames << " frames:" << endl;
+
+    //Each frame a random fraction of the shapes take a step of up to the
+    //size of a triangle, so the tree slowly loosens until it is rebuilt
+    float fractions[] = {0.001f, 0.01f, 0.1f};
+    for (int f = 0 ; f < 3 ; f++) {
+        int numMoved = shapes.size() * fractions[f];
+        int rebuilds = 0;
+        double updateTime = 0;
+        for (int frame = 0 ; frame < numFrames ; frame++) {
+            float stepSize = size;
+            for (int i = 0 ; i < numMoved ; i++) {
+                int shape = rand() % shapes.size();
+                vec4 step(((float) rand() / (RAND_MAX) - 0.5f) * stepSize, ((float) rand() / (RAND_MAX) - 0.5f) * stepSize, ((float) rand() / (RAND_MAX) - 0.5f) * stepSize, 0);
+                if (shape < triangles.size()) {
+                    triangles[shape].setV0(triangles[shape].getV0() + step);
+                    triangles[shape].setV1(triangles[shape].getV1() + step);
+                    triangles[shape].setV2(triangles[shape].getV2() + step);
+                } else {
+                    Sphere& sphere = spheres[shape - triangles.size()];
+                    sphere.setCentre(sphere.getCentre() + step);
+                }
+                scene.shapeChanged(shape);
+            }
+            double start = omp_get_wtime();
+            if (scene.Update()) rebuilds++;
+            updateTime += omp_get_wtime() - start;
+        }
+
+        double buildStart = omp_get_wtime();
+        Scene rebuilt(shapes, settings.binnedBuild);
+        double buildTime = omp_get_wtime() - buildStart;
+
+        int numRays = 10000;
+        int agree = 0;
+        for (int i = 0 ; i < numRays ; i++) {
+            vec4 start(((float) rand() / (RAND_MAX)) * 2 - 1, ((float) rand() / (RAND_MAX)) * 2 - 1, ((float) rand() / (RAND_MAX)) * 2 - 1, 1);
+            vec4 dir(((float) rand() / (RAND_MAX)) - 0.5f, ((float) rand() / (RAND_MAX)) - 0.5f, ((float) rand() / (RAND_MAX)) - 0.5f, 1);
+            Intersection refitHit;
+            Intersection rebuiltHit;
+            bool refitHitFound = scene.closestIntersection(start, dir, refitHit);
+            bool rebuiltHitFound = rebuilt.closestIntersection(start, dir, rebuiltHit);
+            if (refitHitFound == rebuiltHitFound && (!refitHitFound || refitHit.distance == rebuiltHit.distance)) agree++;
+        }
+
+        cout << "    " << numMoved << " moved per frame: update " << updateTime / numFrames * 1000 << "ms/frame, rebuild "
+             << buildTime * 1000 << "ms (" << rebuilds << " rebuilds, SAH cost " << scene.getBVH().SAHCost() << " refitted vs "
+             << rebuilt.getBVH().SAHCost() << " rebuilt, " << agree << "/" << numRays << " rays agree)" << endl;
+    }
+}
+
+//Compares the binary BVH with the compressed wide one on the largest scenes
+//here, a million random triangles and a two million triangle height field,
+//in node memory, closest hit and shadow rays per second and agreement
+void BenchmarkWideBVH() {
+    int n = 1000000;
+    float size = 2.0f / cbrt((float)n);
+    vector<Triangle> triangles;
+    for (int i = 0 ; i < n ; i++) {
+        vec4 v0(((float) rand() / (RAND_MAX)) * 2 - 1, ((float) rand() / (RAND_MAX)) * 2 - 1, ((float) rand() / (RAND_MAX)) * 2 - 1, 1);
+        vec4 v1 = v0 + vec4(((float) rand() / (RAND_MAX)) * size, ((float) rand() / (RAND_MAX)) * size, 0, 0);
+        vec4 v2 = v0 + vec4(0, ((float) rand() / (RAND_MAX)) * size, ((float) rand() / (RAND_MAX)) * size, 0);
+        triangles.push_back(Triangle(v0, v1, v2, defaultWhite));
+    }
+    vector<Shape *> shapes;
+    for (int i = 0 ; i < triangles.size() ; i++) {
+        shapes.push_back(&triangles[i]);
+    }
+
+    int k = 1024;
+    Mesh heightField(defaultWhite);
+    for (int i = 0 ; i <= k ; i++) {
+        for (int j = 0 ; j <= k ; j++) {
+            float x = 2.0f * i / k - 1;
+            float z = 2.0f * j / k - 1;
+            heightField.AddVertex(vec3(x, 0.1f * sin(10 * x) * cos(10 * z), z));
+        }
+    }
+    for (int i = 0 ; i < k ; i++) {
+        for (int j = 0 ; j < k ; j++) {
+            int v = i * (k + 1) + j;
+            heightField.AddFace(v, v + 1, v + k + 1);
+            heightField.AddFace(v + 1, v + k + 2, v + k + 1);
+        }
+    }
+
+    for (int s = 0 ; s < 2 ; s++) {
+        Scene scene = s == 0 ? Scene(shapes, settings.binnedBuild) : Scene(vector<Shape *>(), vector<Mesh *>(1, &heightField), settings.binnedBuild);
+
+        //Random rays through the cube, or down onto the height field
+        int numRays = 100000;
+        vector<vec4> starts;
+        vector<vec4> dirs;
+        for (int i = 0 ; i < numRays ; i++) {
+            float y = s == 0 ? ((float) rand() / (RAND_MAX)) * 2 - 1 : -1;
+            starts.push_back(vec4(((float) rand() / (RAND_MAX)) * 2 - 1, y, ((float) rand() / (RAND_MAX)) * 2 - 1, 1));
+            float dy = s == 0 ? ((float) rand() / (RAND_MAX)) - 0.5f : 1;
+            dirs.push_back(vec4(((float) rand() / (RAND_MAX)) - 0.5f, dy, ((float) rand() / (RAND_MAX)) - 0.5f, 1));
+        }
+
+        vector<float> distances[2];
+        double rate[2];
+        double shadowRate[2];
+        int occludedRays[2] = {0, 0};
+        size_t nodeBytes[2];
+        double collapseTime = 0;
+        float shadowDistance = s == 0 ? 0.5f : 1.0f;
+        for (int wide = 0 ; wide < 2 ; wide++) {
+            double collapseStart = omp_get_wtime();
+            scene.useWideBVH(wide == 1);
+            collapseTime = omp_get_wtime() - collapseStart;
+
+            double start = omp_get_wtime();
+            for (int i = 0 ; i < numRays ; i++) {
+                Intersection intersection;
+                bool hit = scene.closestIntersection(starts[i], dirs[i], intersection);
+                distances[wide].push_back(hit ? intersection.distance : -1);
+            }
+            rate[wide] = numRays / (omp_get_wtime() - start);
+
+            start = omp_get_wtime();
+            for (int i = 0 ; i < numRays ; i++) {
+                if (scene.occluded(starts[i], dirs[i], shadowDistance)) occludedRays[wide]++;
+            }
+            shadowRate[wide] = numRays / (omp_get_wtime() - start);
+        }
+        nodeBytes[0] = scene.getBVH().getNumNodes() * sizeof(BVHNode);
+
+        int agree = 0;
+        for (int i = 0 ; i < numRays ; i++) {
+            if (distances[0][i] == distances[1][i]) agree++;
+        }
+
+        WideBVH wideBVH;
+        wideBVH.Build(scene.getBVH());
+        nodeBytes[1] = wideBVH.getNumNodes() * sizeof(WideBVHNode);
+
+        cout << (s == 0 ? "1000000 random triangles:" : "2097152 triangle height field:") << endl;
+        cout << "    binary " << scene.getBVH().getNumNodes() << " nodes, " << (float)nodeBytes[0] / (1 << 20) << " MB, "
+             << rate[0] << " rays/s, shadow " << shadowRate[0] << " rays/s (" << occludedRays[0] << " occluded)" << endl;
+        cout << "    wide   " << wideBVH.getNumNodes() << " nodes, " << (float)nodeBytes[1] / (1 << 20) << " MB collapsed in " << collapseTime * 1000 << "ms, "
+             << rate[1] << " rays/s, shadow " << shadowRate[1] << " rays/s (" << occludedRays[1] << " occluded, "
+             << agree << "/" << numRays << " closest hits agree)" << endl;
+    }
+}
+
+
+//Compares the Cornell box built from triangles with the same room built from
+//quads and boxes: the cost of one wall or block test on its own, then closest
+//hit and shadow rays per second through the whole scene
+void BenchmarkAnalyticPrimitives() {
+    CornellBox rooms[2];
+    for (int analytic = 0 ; analytic < 2 ; analytic++) {
+        LoadCornellBox(rooms[analytic], analytic == 1);
+    }
+
+    //Random rays from inside the room
+    int numRays = 200000;
+    vector<vec4> starts;
+    vector<vec4> dirs;
+    for (int i = 0 ; i < numRays ; i++) {
+        starts.push_back(vec4(((float) rand() / (RAND_MAX)) * 1.8f - 0.9f, ((float) rand() / (RAND_MAX)) * 1.8f - 0.9f, ((float) rand() / (RAND_MAX)) * 1.8f - 0.9f, 1));
+        dirs.push_back(vec4(((float) rand() / (RAND_MAX)) - 0.5f, ((float) rand() / (RAND_MAX)) - 0.5f, ((float) rand() / (RAND_MAX)) - 0.5f, 1));
+    }
+
+    //One shape's test against every ray, the floor's two triangles against
+    //its quad and the tall block's ten triangles against its box
+    struct { const char * name; int first; int count; Shape * analyticShape; } tests[2] = {
+        {"floor ", 0, 2, &rooms[1].quads[0]},
+        {"block ", 20, 10, &rooms[1].boxes[1]}
+    };
+    cout << "Analytic primitives:" << endl;
+    for (int k = 0 ; k < 2 ; k++) {
+        int hits[2] = {0, 0};
+        double start = omp_get_wtime();
+        for (int i = 0 ; i < numRays ; i++) {
+            Intersection intersection;
+            intersection.distance = numeric_limits<float>::max();
+            bool hit = false;
+            for (int t = tests[k].first ; t < tests[k].first + tests[k].count ; t++) {
+                hit = rooms[0].triangles[t].intersects(starts[i], dirs[i], intersection, t) || hit;
+            }
+            if (hit) hits[0]++;
+        }
+        double triangleTime = omp_get_wtime() - start;
+
+        start = omp_get_wtime();
+        for (int i = 0 ; i < numRays ; i++) {
+            Intersection intersection;
+            intersection.distance = numeric_limits<float>::max();
+            if (tests[k].analyticShape->intersects(starts[i], dirs[i], intersection, 0)) hits[1]++;
+        }
+        double analyticTime = omp_get_wtime() - start;
+        cout << "    " << tests[k].name << tests[k].count << " triangles " << numRays / triangleTime << " tests/s, "
+             << (k == 0 ? "quad " : "box ") << numRays / analyticTime << " tests/s (" << hits[0] << " and " << hits[1] << " hits)" << endl;
+    }
+
+    vector<float> distances[2];
+    for (int analytic = 0 ; analytic < 2 ; analytic++) {
+        Scene scene(rooms[analytic].shapes, settings.binnedBuild);
+        scene.useWideBVH(settings.wideBVH);
+
+        double start = omp_get_wtime();
+        for (int i = 0 ; i < numRays ; i++) {
+            Intersection intersection;
+            bool hit = scene.closestIntersection(starts[i], dirs[i], intersection);
+            distances[analytic].push_back(hit ? intersection.distance : -1);
+        }
+        double rate = numRays / (omp_get_wtime() - start);
+
+        int occludedRays = 0;
+        start = omp_get_wtime();
+        for (int i = 0 ; i < numRays ; i++) {
+            if (scene.occluded(starts[i], dirs[i], 0.5f)) occludedRays++;
+        }
+        double shadowRate = numRays / (omp_get_wtime() - start);
+
+        cout << "    " << (analytic ? "quads and boxes " : "triangles       ") << rooms[analytic].shapes.size() << " shapes, "
+             << rate << " rays/s, shadow " << shadowRate << " rays/s (" << occludedRays << " occluded)" << endl;
+    }
+
+    //The boxes square up the blocks' corners, which were only nearly a box,
+    //so hits on the blocks can move slightly
+    int agree = 0;
+    for (int i = 0 ; i < numRays ; i++) {
+        if (fabs(distances[0][i] - distances[1][i]) <= 1e-4f * fabs(distances[0][i])) agree++;
+    }
+    cout << "    " << agree << "/" << numRays << " closest hit distances agree" << endl;
+}
+
+
+//Shades every primary hit of the Cornell box with the recursive
+//RadianceEstimate, pixel by pixel as Draw does, and with the staged
+//RadianceEstimates over the whole frame, taking the best of three runs each
+void BenchmarkWavefront() {
+    CornellBox room;
+    LoadCornellBox(room, settings.analytic);
+    Scene scene(room.shapes, settings.binnedBuild);
+    scene.useWideBVH(settings.wideBVH);
+    PhotonMap pmap(ls, settings.numPhotons, settings.numNearestPhotons, scene);
+    Camera camera(vec4(0, 0, -3, 1));
+
+    vector<PathStart> starts = PrimaryStarts(scene, camera, 1, false);
+    int numReflective = 0;
+    for (int i = 0 ; i < starts.size() ; i++) {
+        Material& material = scene.getMaterial(starts[i].intersection.index);
+        if (material.isReflective() || material.isTransparent()) numReflective++;
+    }
+
+    vector<vec3> recursive(SCREEN_WIDTH * SCREEN_HEIGHT, vec3(0));
+    vector<vec3> staged(SCREEN_WIDTH * SCREEN_HEIGHT, vec3(0));
+    double recursiveTime = numeric_limits<double>::max();
+    double stagedTime = numeric_limits<double>::max();
+    for (int run = 0 ; run < 3 ; run++) {
+        double start = omp_get_wtime();
+        #pragma omp parallel for schedule(dynamic, 64)
+        for (int i = 0 ; i < starts.size() ; i++) {
+            recursive[starts[i].pixel] = pmap.RadianceEstimate(settings.numNearestPhotons, starts[i].intersection, scene, starts[i].incidentRay, camera, ls);
+        }
+        recursiveTime = min(recursiveTime, omp_get_wtime() - start);
+
+        fill(staged.begin(), staged.end(), vec3(0));
+        start = omp_get_wtime();
+        pmap.RadianceEstimates(settings.numNearestPhotons, starts, scene, camera, ls, staged);
+        stagedTime = min(stagedTime, omp_get_wtime() - start);
+    }
+
+    float maxDifference = 0;
+    for (int pixel = 0 ; pixel < SCREEN_WIDTH * SCREEN_HEIGHT ; pixel++) {
+        vec3 d = abs(recursive[pixel] - staged[pixel]) / glm::max(abs(recursive[pixel]), vec3(1e-3f));
+        maxDifference = glm::max(maxDifference, glm::max(d.x, glm::max(d.y, d.z)));
+    }
+    cout << "Secondary rays, " << starts.size() << " primary hits (" << numReflective << " reflective or transparent):" << endl;
+    cout << "    recursive " << recursiveTime * 1000 << "ms, wavefront " << stagedTime * 1000 << "ms, largest relative difference " << maxDifference << endl;
+}
+
+
+//Shades the diffuse primary hits of the Cornell box with LightSphereLuminance,
+//comparing the old fixed set of 50 point lights inside the sphere with a few
+//solid angle samples per point, against 256 solid angle samples per point
+void BenchmarkLightSampling() {
+    CornellBox room;
+    LoadCornellBox(room, settings.analytic);
+    Scene scene(room.shapes, settings.binnedBuild);
+    scene.useWideBVH(settings.wideBVH);
+    Camera camera(vec4(0, 0, -3, 1));
+
+    vector<PathStart> points = PrimaryStarts(scene, camera, 7, false, true);
+
+    LightSphere light = ls;
+    light.setNumSamples(256);
+    vector<vec3> reference(points.size());
+    float referenceMean = 0;
+    for (int i = 0 ; i < points.size() ; i++) {
+        reference[i] = light.LightSphereLuminance(points[i].intersection, points[i].incidentRay, scene, camera);
+        referenceMean += (reference[i].x + reference[i].y + reference[i].z) / (3.0f * points.size());
+    }
+    cout << "Sphere light, " << points.size() << " diffuse points:" << endl;
+
+    //What the light used to store: 50 point lights scattered through it
+    vector<Light> pointLights;
+    for (int l = 0 ; l < 50 ; l++) {
+        pointLights.push_back(Light(ls.samplePoint(), ls.getAmbient(), ls.getDiffuse(), ls.getSpecular(), ls.getPower() / 50.0f));
+    }
+    double start = omp_get_wtime();
+    float squaredError = 0;
+    for (int i = 0 ; i < points.size() ; i++) {
+        vec3 colour(0);
+        for (int l = 0 ; l < pointLights.size() ; l++) {
+            colour += pointLights[l].FresnelLight(points[i].intersection, points[i].incidentRay, scene, camera);
+        }
+        vec3 d = colour / (float) pointLights.size() - reference[i];
+        squaredError += dot(d, d) / 3.0f;
+    }
+    double time = omp_get_wtime() - start;
+    cout << "    50 point lights: " << time * 1000 << "ms, rms error " << sqrt(squaredError / points.size()) / referenceMean << endl;
+
+    int sampleCounts[] = {1, 4, 16};
+    for (int s = 0 ; s < 3 ; s++) {
+        light.setNumSamples(sampleCounts[s]);
+        start = omp_get_wtime();
+        squaredError = 0;
+        for (int i = 0 ; i < points.size() ; i++) {
+            vec3 d = light.LightSphereLuminance(points[i].intersection, points[i].incidentRay, scene, camera) - reference[i];
+            squaredError += dot(d, d) / 3.0f;
+        }
+        time = omp_get_wtime() - start;
+        cout << "    " << sampleCounts[s] << " solid angle samples: " << time * 1000 << "ms, rms error " << sqrt(squaredError / points.size()) / referenceMean << endl;
+    }
+}
+
+
+//Lights the Cornell box with 4096 small sphere lights of widely varying power
+//near the ceiling. Shades diffuse primary hits by looping over every light, by
+//picking 4 lights uniformly and by picking 4 from the light tree, against the
+//loop over every light with 4 samples each, then checks how photons are
+//shared between the lights
+void BenchmarkLightTree() {
+    CornellBox room;
+    LoadCornellBox(room, settings.analytic);
+    Scene scene(room.shapes, settings.binnedBuild);
+    scene.useWideBVH(settings.wideBVH);
+    Camera camera(vec4(0, 0, -3, 1));
+
+    //Powers spread over three orders of magnitude, shared out of the scene
+    //light's diffuse power
+    int numLights = 4096;
+    vector<float> powers;
+    float powerSum = 0;
+    for (int i = 0 ; i < numLights ; i++) {
+        powers.push_back(pow(10.0f, 3.0f * ((float) rand() / (RAND_MAX))));
+        powerSum += powers[i];
+    }
+    vector<LightSphere> lightSpheres;
+    for (int i = 0 ; i < numLights ; i++) {
+        vec4 centre(((float) rand() / (RAND_MAX)) * 1.8f - 0.9f, -0.95f + ((float) rand() / (RAND_MAX)) * 0.4f, ((float) rand() / (RAND_MAX)) * 1.8f - 0.9f, 1);
+        lightSpheres.push_back(LightSphere(centre, 0.01f, 1, ambientColour / (float) numLights, diffuseColour * (powers[i] / powerSum), specularColour * (powers[i] / powerSum), power));
+    }
+    double start = omp_get_wtime();
+    LightTree lights(lightSpheres);
+    cout << "Light tree over " << numLights << " lights built in " << (omp_get_wtime() - start) * 1000 << "ms, " << lights.getNodes().size() << " nodes" << endl;
+
+    vector<PathStart> points = PrimaryStarts(scene, camera, 211, false, true);
+
+    vector<vec3> reference(points.size(), vec3(0));
+    float referenceMean = 0;
+    for (int i = 0 ; i < points.size() ; i++) {
+        for (int l = 0 ; l < numLights ; l++) {
+            for (int s = 0 ; s < 4 ; s++) {
+                reference[i] += lights.getLight(l).SampleLuminance(points[i].intersection, points[i].incidentRay, scene, camera, (float) rand() / (RAND_MAX), (float) rand() / (RAND_MAX)) / 4.0f;
+            }
+        }
+        referenceMean += (reference[i].x + reference[i].y + reference[i].z) / (3.0f * points.size());
+    }
+    cout << "    " << points.size() << " diffuse points:" << endl;
+
+    for (int method = 0 ; method < 3 ; method++) {
+        start = omp_get_wtime();
+        float squaredError = 0;
+        for (int i = 0 ; i < points.size() ; i++) {
+            vec3 colour(0);
+            if (method == 0) {
+                for (int l = 0 ; l < numLights ; l++) {
+                    colour += lights.getLight(l).SampleLuminance(points[i].intersection, points[i].incidentRay, scene, camera, (float) rand() / (RAND_MAX), (float) rand() / (RAND_MAX));
+                }
+            } else if (method == 1) {
+                for (int s = 0 ; s < 4 ; s++) {
+                    int l = min((int) (((float) rand() / (RAND_MAX)) * numLights), numLights - 1);
+                    colour += lights.getLight(l).SampleLuminance(points[i].intersection, points[i].incidentRay, scene, camera, (float) rand() / (RAND_MAX), (float) rand() / (RAND_MAX)) * (float) numLights / 4.0f;
+                }
+            } else {
+                colour = lights.Luminance(points[i].intersection, points[i].incidentRay, scene, camera, 4);
+            }
+            vec3 d = colour - reference[i];
+            squaredError += dot(d, d) / 3.0f;
+        }
+        double time = omp_get_wtime() - start;
+        const char * names[] = {"every light", "4 uniform picks", "4 light tree picks"};
+        cout << "    " << names[method] << ": " << time * 1000 << "ms, rms error " << sqrt(squaredError / points.size()) / referenceMean << endl;
+    }
+
+    //Stratified picks from the alias table against each light's power share
+    int numPhotons = 1000000;
+    vector<int> photonCounts(numLights, 0);
+    start = omp_get_wtime();
+    for (int i = 0 ; i < numPhotons ; i++) {
+        float pmf;
+        photonCounts[lights.SampleEmitter((i + 0.5f) / numPhotons, pmf)]++;
+    }
+    double time = omp_get_wtime() - start;
+    float maxDeviation = 0;
+    for (int l = 0 ; l < numLights ; l++) {
+        float expected = numPhotons * LightTree::LightPower(lights.getLight(l)) / lights.getTotalPower();
+        maxDeviation = glm::max(maxDeviation, fabs(photonCounts[l] - expected));
+    }
+    cout << "    " << numPhotons << " photon lights picked in " << time * 1000 << "ms, counts within " << maxDeviation << " of power share" << endl;
+}
+
+
+//Hangs an emissive panel under the ceiling of the Cornell box and lights the
+//diffuse primary hits from it with 1, 4 and 16 samples per point, against 256
+//samples per point, then builds a photon map from the panel and the light
+//sphere together
+void BenchmarkEmissiveShapes() {
+    Material panelMaterial(white, white, white, vec3(4.0f), 0, 0.8f, 0, 0, false, 0.0f, 1.0f, false);
+    //Facing down into the room, which is +y
+    Quad panel(vec4(-0.4f, -0.98f, -0.4f, 1), vec4(-0.4f, -0.98f, 0.4f, 1), vec4(0.4f, -0.98f, -0.4f, 1), panelMaterial);
+    if (panel.getNormal().y < 0) {
+        panel = Quad(vec4(-0.4f, -0.98f, -0.4f, 1), vec4(0.4f, -0.98f, -0.4f, 1), vec4(-0.4f, -0.98f, 0.4f, 1), panelMaterial);
+    }
+    CornellBox room;
+    LoadCornellBox(room, settings.analytic, vector<Quad>(1, panel));
+    Scene scene(room.shapes, settings.binnedBuild);
+    scene.useWideBVH(settings.wideBVH);
+    Camera camera(vec4(0, 0, -3, 1));
+    LightTree lights(vector<LightSphere>(1, ls));
+    EmissiveShapes emitters(scene, lights.getNumLights());
+
+    vector<PathStart> points = PrimaryStarts(scene, camera, 37, false, true);
+
+    vector<vec3> reference(points.size());
+    float referenceMean = 0;
+    for (int i = 0 ; i < points.size() ; i++) {
+        reference[i] = emitters.Luminance(points[i].intersection, points[i].incidentRay, scene, camera, 256);
+        referenceMean += (reference[i].x + reference[i].y + reference[i].z) / (3.0f * points.size());
+    }
+    cout << "Emissive panel, " << emitters.getNumShapes() << " emitting shapes, " << points.size() << " diffuse points:" << endl;
+
+    int sampleCounts[] = {1, 4, 16};
+    for (int s = 0 ; s < 3 ; s++) {
+        double start = omp_get_wtime();
+        float squaredError = 0;
+        for (int i = 0 ; i < points.size() ; i++) {
+            vec3 d = emitters.Luminance(points[i].intersection, points[i].incidentRay, scene, camera, sampleCounts[s]) - reference[i];
+            squaredError += dot(d, d) / 3.0f;
+        }
+        double time = omp_get_wtime() - start;
+        cout << "    " << sampleCounts[s] << " samples: " << time * 1000 << "ms, rms error " << sqrt(squaredError / points.size()) / referenceMean << endl;
+    }
+
+    double start = omp_get_wtime();
+    PhotonMap pmap(lights, emitters, settings.numPhotons, settings.numNearestPhotons, scene);
+    cout << "    photon map from the panel and light sphere built in " << (omp_get_wtime() - start) * 1000 << "ms, panel power " << emitters.getTotalPower() << ", light sphere power " << lights.getTotalPower() << endl;
+}
+
+
+//Soft shadows from the sphere light with 50 solid angle samples per point,
+//over every diffuse primary hit in scanline order, with and without the
+//occluder cache. The same random numbers are used both times so the results
+//should match exactly
+void BenchmarkOccluderCache() {
+    CornellBox room;
+    LoadCornellBox(room, settings.analytic);
+    Scene scene(room.shapes, settings.binnedBuild);
+    scene.useWideBVH(settings.wideBVH);
+    Camera camera(vec4(0, 0, -3, 1));
+
+    vector<PathStart> points = PrimaryStarts(scene, camera, 3, false, true);
+
+    //The room's own light leaves few points in shadow. Raised above the
+    //ceiling it leaves every point in shadow
+    for (int raised = 0 ; raised < 2 ; raised++) {
+        LightSphere light = ls;
+        light.setNumSamples(50);
+        if (raised) light.translateDown(1.0f);
+        cout << "Soft shadows, light " << (raised ? "above the ceiling" : "in the room") << ", 50 samples each at " << points.size() << " diffuse points:" << endl;
+
+        vector<vec3> colours[2];
+        for (int cached = 0 ; cached < 2 ; cached++) {
+            scene.useOccluderCache(cached == 1);
+            Scene::resetOccluderCacheCounts();
+            srand(1);
+            double start = omp_get_wtime();
+            for (int i = 0 ; i < points.size() ; i++) {
+                colours[cached].push_back(light.LightSphereLuminance(points[i].intersection, points[i].incidentRay, scene, camera));
+            }
+            double time = omp_get_wtime() - start;
+            cout << "    " << (cached ? "occluder cache: " : "no cache: ") << time * 1000 << "ms";
+            if (cached) {
+                long tests, hits;
+                Scene::getOccluderCacheCounts(tests, hits);
+                cout << ", " << hits << " of " << points.size() * 50 << " shadow rays stopped by the cached blocker, " << 100.0 * hits / glm::max(tests, 1L) << "% of those that tried it";
+            }
+            cout << endl;
+        }
+
+        int mismatches = 0;
+        for (int i = 0 ; i < points.size() ; i++) {
+            if (colours[0][i] != colours[1][i]) mismatches++;
+        }
+        cout << "    " << mismatches << " points shaded differently" << endl;
+    }
+}
+
+
+//Soft shadows from the sphere light with 4, 16 and 64 samples per point over
+//the diffuse primary hits, with and without shadow photons from a 20000
+//photon map. Points the photons call lit or shadowed take no shadow rays, which is
+//only right away from the penumbrae, so the error this brings is given too
+void BenchmarkShadowPhotons() {
+    CornellBox room;
+    LoadCornellBox(room, settings.analytic);
+    Scene scene(room.shapes, settings.binnedBuild);
+    scene.useWideBVH(settings.wideBVH);
+    Camera camera(vec4(0, 0, -3, 1));
+
+    vector<PathStart> points = PrimaryStarts(scene, camera, 7, false, true);
+
+    LightTree lights(vector<LightSphere>(1, ls));
+    EmissiveShapes emitters(scene, lights.getNumLights());
+    double start = omp_get_wtime();
+    PhotonMap pmap(lights, emitters, 20000, settings.numNearestPhotons, scene, true);
+    cout << "Shadow photons, " << pmap.getShadowPhotons().getNumPhotons() << " direct and shadow photons traced in " << (omp_get_wtime() - start) * 1000 << "ms, " << points.size() << " diffuse points:" << endl;
+
+    int counts[3] = {0, 0, 0};
+    for (int i = 0 ; i < points.size() ; i++) {
+        counts[pmap.getShadowPhotons().Visibility(points[i].intersection.position)]++;
+    }
+    cout << "    " << counts[VISIBILITY_LIT] << " lit, " << counts[VISIBILITY_SHADOWED] << " in shadow, " << counts[VISIBILITY_UNKNOWN] << " left to shadow rays" << endl;
+
+    //The photons are asked once per point, the shadow rays they save are
+    //one per light sample
+    int sampleCounts[] = {4, 16, 64};
+    for (int s = 0 ; s < 3 ; s++) {
+        LightSphere light = ls;
+        light.setNumSamples(sampleCounts[s]);
+        vector<vec3> colours[2];
+        double times[2];
+        for (int withPhotons = 0 ; withPhotons < 2 ; withPhotons++) {
+            scene.useShadowPhotons(withPhotons ? &pmap.getShadowPhotons() : nullptr);
+            srand(1);
+            start = omp_get_wtime();
+            for (int i = 0 ; i < points.size() ; i++) {
+                colours[withPhotons].push_back(light.LightSphereLuminance(points[i].intersection, points[i].incidentRay, scene, camera));
+            }
+            times[withPhotons] = omp_get_wtime() - start;
+        }
+        scene.useShadowPhotons(nullptr);
+
+        float referenceMean = 0;
+        float squaredError = 0;
+        int mismatches = 0;
+        for (int i = 0 ; i < points.size() ; i++) {
+            referenceMean += (colours[0][i].x + colours[0][i].y + colours[0][i].z) / (3.0f * points.size());
+            vec3 d = colours[1][i] - colours[0][i];
+            squaredError += dot(d, d) / 3.0f;
+            if (d != vec3(0)) mismatches++;
+        }
+        cout << "    " << sampleCounts[s] << " samples: shadow rays only " << times[0] * 1000 << "ms, shadow photons " << times[1] * 1000 << "ms, " << mismatches << " points shaded differently, rms error " << sqrt(squaredError / points.size()) / referenceMean << endl;
+    }
+}
+
+
+//Shades every primary hit of the Cornell box with the staged RadianceEstimates
+//and the recursive RadianceEstimate, first following every branch, then
+//cutting branches and estimates below a share of 0.01 and 0.001 of the pixel,
+//then playing Russian roulette below 0.01. Gives the time, the work saved and
+//how far the frame moves from the uncut one
+void BenchmarkPathCutoff() {
+    CornellBox room;
+    LoadCornellBox(room, settings.analytic);
+    Scene scene(room.shapes, settings.binnedBuild);
+    scene.useWideBVH(settings.wideBVH);
+    PhotonMap pmap(ls, settings.numPhotons, settings.numNearestPhotons, scene);
+    Camera camera(vec4(0, 0, -3, 1));
+
+    vector<PathStart> starts = PrimaryStarts(scene, camera, 1, false);
+    cout << "Path cutoff, " << starts.size() << " primary hits:" << endl;
+
+    float cutoffs[] = {0.0f, 0.01f, 0.001f, 0.01f};
+    bool roulette[] = {false, false, false, true};
+    vector<vec3> uncut[2];
+    for (int c = 0 ; c < 4 ; c++) {
+        pmap.setPathCutoff(cutoffs[c], roulette[c]);
+        srand(1);
+        for (int recursive = 0 ; recursive < 2 ; recursive++) {
+            vector<vec3> colours(SCREEN_WIDTH * SCREEN_HEIGHT, vec3(0));
+            pmap.resetPathsSaved();
+            double start = omp_get_wtime();
+            if (recursive) {
+                #pragma omp parallel for schedule(dynamic, 64)
+                for (int i = 0 ; i < starts.size() ; i++) {
+                    colours[starts[i].pixel] = pmap.RadianceEstimate(settings.numNearestPhotons, starts[i].intersection, scene, starts[i].incidentRay, camera, ls);
+                }
+            } else {
+                pmap.RadianceEstimates(settings.numNearestPhotons, starts, scene, camera, ls, colours);
+            }
+            double time = omp_get_wtime() - start;
+            if (c == 0) uncut[recursive] = colours;
+
+            float squaredError = 0;
+            float mean = 0;
+            for (int pixel = 0 ; pixel < SCREEN_WIDTH * SCREEN_HEIGHT ; pixel++) {
+                vec3 d = colours[pixel] - uncut[recursive][pixel];
+                squaredError += dot(d, d) / 3.0f;
+                mean += (uncut[recursive][pixel].x + uncut[recursive][pixel].y + uncut[recursive][pixel].z) / 3.0f;
+            }
+            long paths, gathers;
+            pmap.getPathsSaved(paths, gathers);
+            cout << "    " << (recursive ? "recursive" : "wavefront") << ", ";
+            if (cutoffs[c] == 0) {
+                cout << "every branch";
+            } else {
+                cout << (roulette[c] ? "roulette below " : "cut below ") << cutoffs[c];
+            }
+            cout << ": " << time * 1000 << "ms, " << paths << " branches ended, " << gathers << " estimates left out, rms change " << sqrt(squaredError * (SCREEN_WIDTH * SCREEN_HEIGHT)) / mean << endl;
+        }
+    }
+}
+
+
+//Counts the photon gathers the staged and recursive estimates make over the
+//Cornell box's primary hits, per pixel and per reflective or transparent
+//pixel, with every branch followed
+void BenchmarkGathers() {
+    CornellBox room;
+    LoadCornellBox(room, settings.analytic);
+    Scene scene(room.shapes, settings.binnedBuild);
+    scene.useWideBVH(settings.wideBVH);
+    PhotonMap pmap(ls, settings.numPhotons, settings.numNearestPhotons, scene);
+    Camera camera(vec4(0, 0, -3, 1));
+
+    vector<PathStart> starts = PrimaryStarts(scene, camera, 1, false);
+    int numReflective = 0;
+    for (int i = 0 ; i < starts.size() ; i++) {
+        Material& material = scene.getMaterial(starts[i].intersection.index);
+        if (material.isReflective() || material.isTransparent()) numReflective++;
+    }
+    cout << "Photon gathers, " << starts.size() << " primary hits (" << numReflective << " reflective or transparent):" << endl;
+
+    for (int recursive = 0 ; recursive < 2 ; recursive++) {
+        vector<vec3> colours(SCREEN_WIDTH * SCREEN_HEIGHT, vec3(0));
+        pmap.resetNumGathers();
+        double start = omp_get_wtime();
+        if (recursive) {
+            #pragma omp parallel for schedule(dynamic, 64)
+            for (int i = 0 ; i < starts.size() ; i++) {
+                colours[starts[i].pixel] = pmap.RadianceEstimate(settings.numNearestPhotons, starts[i].intersection, scene, starts[i].incidentRay, camera, ls);
+            }
+        } else {
+            pmap.RadianceEstimates(settings.numNearestPhotons, starts, scene, camera, ls, colours);
+        }
+        double time = omp_get_wtime() - start;
+        long gathers = pmap.getNumGathers();
+        cout << "    " << (recursive ? "recursive: " : "wavefront: ") << time * 1000 << "ms, " << (float) gathers / starts.size() << " gathers per pixel, " << (float) (gathers - (starts.size() - numReflective)) / glm::max(numReflective, 1) << " per reflective or transparent pixel" << endl;
+    }
+}
+
+
+//Shades every primary hit of the Cornell box from a 20000 photon map taking
+//50 photons a gather, as RadianceEstimates does for the frame, with the full
+//50 at every vertex and then with secondary gathers sized by ray cones
+void BenchmarkRayCones() {
+    CornellBox room;
+    LoadCornellBox(room, settings.analytic);
+    Scene scene(room.shapes, settings.binnedBuild);
+    scene.useWideBVH(settings.wideBVH);
+    PhotonMap pmap(ls, 20000, 50, scene);
+    Camera camera(vec4(0, 0, -3, 1));
+
+    vector<PathStart> starts = PrimaryStarts(scene, camera, 1, true);
+    cout << "Ray cones, " << starts.size() << " primary hits, 50 photon gathers:" << endl;
+
+    vector<vec3> colours[2];
+    for (int cones = 0 ; cones < 2 ; cones++) {
+        pmap.setRayCones(cones ? 1.0f / settings.focalLength : 0.0f);
+        colours[cones] = vector<vec3>(SCREEN_WIDTH * SCREEN_HEIGHT, vec3(0));
+        pmap.resetNumGathers();
+        double start = omp_get_wtime();
+        pmap.RadianceEstimates(50, starts, scene, camera, ls, colours[cones]);
+        double time = omp_get_wtime() - start;
+        long gathers = pmap.getNumGathers();
+        long photons = pmap.getNumGatheredPhotons();
+        cout << "    " << (cones ? "sized by ray cones: " : "full gathers: ") << time * 1000 << "ms, " << gathers << " gathers of " << (float) photons / gathers << " photons on average";
+        if (cones) {
+            float squaredError = 0;
+            float sum = 0;
+            for (int pixel = 0 ; pixel < SCREEN_WIDTH * SCREEN_HEIGHT ; pixel++) {
+                vec3 d = colours[1][pixel] - colours[0][pixel];
+                squaredError += dot(d, d) / 3.0f;
+                sum += (colours[0][pixel].x + colours[0][pixel].y + colours[0][pixel].z) / 3.0f;
+            }
+            cout << ", rms change " << sqrt(squaredError * (SCREEN_WIDTH * SCREEN_HEIGHT)) / sum;
+        }
+        cout << endl;
+    }
+}
+
+
+//Shades every primary hit of the Cornell box from a 20000 photon map taking
+//50 photons a gather, as RadianceEstimates does for the frame, first with
+//every diffuse estimate gathered and then through a fresh irradiance cache
+//at a few accuracies, with and without gradients
+void BenchmarkIrradianceCache() {
+    CornellBox room;
+    LoadCornellBox(room, settings.analytic);
+    Scene scene(room.shapes, settings.binnedBuild);
+    scene.useWideBVH(settings.wideBVH);
+    PhotonMap pmap(ls, 20000, 50, scene);
+    Camera camera(vec4(0, 0, -3, 1));
+
+    vector<PathStart> starts = PrimaryStarts(scene, camera, 1, false);
+    cout << "Irradiance cache, " << starts.size() << " primary hits, 50 photon gathers:" << endl;
+
+    //Errors are measured against gathers of 250 photons, which the 50
+    //photon gathers are themselves some way off
+    vector<vec3> reference(SCREEN_WIDTH * SCREEN_HEIGHT, vec3(0));
+    pmap.RadianceEstimates(250, starts, scene, camera, ls, reference);
+    float referenceSum = 0;
+    for (int pixel = 0 ; pixel < SCREEN_WIDTH * SCREEN_HEIGHT ; pixel++) {
+        referenceSum += (reference[pixel].x + reference[pixel].y + reference[pixel].z) / 3.0f;
+    }
+
+    float accuracies[] = {0, 0.15f, 0.3f, 0.3f, 0.5f};
+    bool gradients[] = {false, true, false, true, true};
+    for (int run = 0 ; run < 5 ; run++) {
+        IrradianceCache cache(accuracies[run], gradients[run]);
+        pmap.useIrradianceCache(run > 0 ? &cache : nullptr);
+        vector<vec3> colours(SCREEN_WIDTH * SCREEN_HEIGHT, vec3(0));
+        pmap.resetNumGathers();
+        double start = omp_get_wtime();
+        pmap.RadianceEstimates(50, starts, scene, camera, ls, colours);
+        double time = omp_get_wtime() - start;
+
+        float squaredError = 0;
+        for (int pixel = 0 ; pixel < SCREEN_WIDTH * SCREEN_HEIGHT ; pixel++) {
+            vec3 d = colours[pixel] - reference[pixel];
+            squaredError += dot(d, d) / 3.0f;
+        }
+        float error = sqrt(squaredError * (SCREEN_WIDTH * SCREEN_HEIGHT)) / referenceSum;
+        if (run == 0) {
+            cout << "    uncached: " << time * 1000 << "ms, " << pmap.getNumGathers() << " gathers, rms error " << error << endl;
+        } else {
+            cout << "    accuracy " << accuracies[run] << (gradients[run] ? " with gradients: " : ": ") << time * 1000 << "ms, " << pmap.getNumGathers() << " gathers, " << cache.getNumRecords() << " records, " << 100 * cache.getHitRate() << "% hit rate, rms error " << error << endl;
+        }
+    }
+    pmap.useIrradianceCache(nullptr);
+}
+
+
+//Shades the primary hits of every 64th pixel across the Cornell box, showing the photon map directly and by final gathering, over maps of
+//different sizes. Each way is measured against itself over a 200000 photon
+//map, shown directly with 500 photon gathers and final gathered with 64 rays
+//and 100 photon gathers, as the two do not give quite the same image
+void BenchmarkFinalGather() {
+    CornellBox room;
+    LoadCornellBox(room, settings.analytic);
+    Scene scene(room.shapes, settings.binnedBuild);
+    scene.useWideBVH(settings.wideBVH);
+    Camera camera(vec4(0, 0, -3, 1));
+
+    vector<PathStart> starts = PrimaryStarts(scene, camera, 64, false);
+    cout << "Final gather, " << starts.size() << " primary hits:" << endl;
+
+    //The first two runs are the references
+    int photons[] = {200000, 200000, 5000, 20000, 50000, 2000, 5000, 5000, 5000};
+    int nearest[] = {500, 100, 50, 50, 100, 50, 50, 50, 50};
+    int rays[] = {0, 64, 0, 0, 0, 16, 16, 64, 64};
+    bool cached[] = {false, false, false, false, false, false, false, false, true};
+    vector<vec3> references[2];
+    float referenceSums[2] = {0, 0};
+    for (int run = 0 ; run < 9 ; run++) {
+        double start = omp_get_wtime();
+        PhotonMap pmap(ls, photons[run], nearest[run], scene);
+        double buildTime = omp_get_wtime() - start;
+        IrradianceCache cache(0.3f, false);
+        if (cached[run]) {
+            pmap.useIrradianceCache(&cache);
+        }
+        pmap.setFinalGather(rays[run]);
+
+        vector<vec3> colours(SCREEN_WIDTH * SCREEN_HEIGHT, vec3(0));
+        start = omp_get_wtime();
+        pmap.RadianceEstimates(nearest[run], starts, scene, camera, ls, colours);
+        double time = omp_get_wtime() - start;
+
+        cout << "    " << photons[run] << " photons, " << nearest[run] << " a gather, ";
+        if (rays[run] > 0) {
+            cout << rays[run] << " gather rays" << (cached[run] ? " through an irradiance cache: " : ": ");
+        } else {
+            cout << "shown directly: ";
+        }
+        cout << pmap.getNumStoredPhotons() << " stored (" << pmap.getNumStoredPhotons() * sizeof(Photon) / 1024 << "KB), built in " << buildTime * 1000 << "ms, shaded in " << time * 1000 << "ms";
+
+        int mode = rays[run] > 0 ? 1 : 0;
+        if (run < 2) {
+            references[mode] = colours;
+            for (int pixel = 0 ; pixel < SCREEN_WIDTH * SCREEN_HEIGHT ; pixel++) {
+                referenceSums[mode] += (colours[pixel].x + colours[pixel].y + colours[pixel].z) / 3.0f;
+            }
+            cout << ", reference" << endl;
+            if (run == 1) {
+                cout << "    final gathering is " << referenceSums[1] / referenceSums[0] << " times as bright overall" << endl;
+            }
+            continue;
+        }
+        float squaredError = 0;
+        for (int pixel = 0 ; pixel < SCREEN_WIDTH * SCREEN_HEIGHT ; pixel++) {
+            vec3 d = colours[pixel] - references[mode][pixel];
+            squaredError += dot(d, d) / 3.0f;
+        }
+        cout << ", rms error " << sqrt(squaredError * starts.size()) / referenceSums[mode] << endl;
+    }
+}
@@ -0,0 +1,58 @@
+#ifndef BENCHMARKS_H
+#define BENCHMARKS_H
+
+#include <glm/glm.hpp>
+#include <vector>
+#include "Triangle.h"
+#include "Sphere.h"
+#include "Quad.h"
+#include "Box.h"
+#include "Camera.h"
+#include "Scene.h"
+#include "PhotonMap.h"
+
+using namespace std;
+using glm::vec3;
+using glm::mat3;
+using glm::vec4;
+using glm::mat4;
+
+// The renderer's settings the benchmarks build their scenes with, so each
+// measures the configuration the renderer is set to draw
+struct BenchmarkSettings {
+    bool binnedBuild;
+    bool wideBVH;
+    bool analytic;
+    int numPhotons;
+    int numNearestPhotons;
+    float focalLength;
+};
+
+// The Cornell box as the renderer draws it. The shape vectors own the shapes
+// and shapes points into them, so a room is filled in place and never copied
+struct CornellBox {
+    vector<Triangle> triangles;
+    vector<Sphere> spheres;
+    vector<Quad> quads;
+    vector<Box> boxes;
+    vector<Shape *> shapes;
+
+    CornellBox() {}
+    CornellBox(const CornellBox&) = delete;
+    CornellBox& operator=(const CornellBox&) = delete;
+};
+
+// Fills room with the renderer's shapes, built from quads and boxes if
+// analytic, and any extra quads after them
+void LoadCornellBox(CornellBox& room, bool analytic, vector<Quad> extraQuads = vector<Quad>());
+
+// The primary hits of every stride-th pixel in scanline order, started as the
+// renderer starts its paths. With cones set each incident ray carries the
+// camera's ray cone, and with diffuseOnly set reflective, transparent and
+// emitting hits are left out
+vector<PathStart> PrimaryStarts(Scene& scene, Camera& camera, int stride, bool cones, bool diffuseOnly = false);
+
+// Runs every benchmark in turn, printing its results
+void RunBenchmarks(BenchmarkSettings settings);
+
+#endif
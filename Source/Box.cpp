@@ -0,0 +1,108 @@
+#include "Box.h"
+#include "ImageBuffer.h" // For SCREEN_HEIGHT
+
+// Constructor
+Box::Box(vec4 v0, vec4 v1, vec4 v2, vec4 v3, Material material) : Shape(material) {
+    setCorners(v0, v1, v2, v3);
+}
+
+//An affine map keeps the ray parameter, so the slab test against the unit
+//cube in the box's frame gives distances along the world ray
+float Box::Distance(const vec3& v0, const mat3& toLocal, const vec3& start, const vec3& dir, int& face) {
+    vec3 localStart = toLocal * (start - v0);
+    vec3 localDir = toLocal * dir;
+
+    float tEnter = -numeric_limits<float>::max();
+    float tExit = numeric_limits<float>::max();
+    int enterFace = 0;
+    int exitFace = 0;
+    for (int a = 0 ; a < 3 ; a++) {
+        float invDir = 1.0f / (fabs(localDir[a]) > 1e-12f ? localDir[a] : 1e-12f);
+        float tLower = -localStart[a] * invDir;
+        float tUpper = (1.0f - localStart[a]) * invDir;
+        bool upperFirst = tUpper < tLower;
+        float tNear = upperFirst ? tUpper : tLower;
+        float tFar = upperFirst ? tLower : tUpper;
+        if (tNear > tEnter) {
+            tEnter = tNear;
+            enterFace = 2 * a + (upperFirst ? 1 : 0);
+        }
+        if (tFar < tExit) {
+            tExit = tFar;
+            exitFace = 2 * a + (upperFirst ? 0 : 1);
+        }
+    }
+
+    if (tEnter > tExit || tExit < 0.0f) return -1.0f;
+    if (tEnter >= 0.0f) {
+        face = enterFace;
+        return tEnter;
+    }
+    face = exitFace;
+    return tExit;
+}
+
+//Each local coordinate grows along its row of toLocal, which is the normal of
+//the faces where it is constant
+vec3 Box::FaceNormal(const mat3& toLocal, int face) {
+    int a = face / 2;
+    vec3 normal = normalize(vec3(toLocal[0][a], toLocal[1][a], toLocal[2][a]));
+    return (face & 1) ? normal : -normal;
+}
+
+//Check if a ray or photon intersects with the box
+bool Box::intersects(vec4 start, vec4 dir, Intersection & intersection, int index) {
+    dir = vec4(vec3(dir) * (float)SCREEN_HEIGHT, 1);
+
+    int face;
+    float t = Distance(vec3(v0), toLocal, vec3(start), vec3(dir), face);
+    if (t >= 0.0f && t < intersection.distance) {
+        intersection.position = start + t * dir;
+        intersection.distance = t;
+        intersection.index = index;
+        intersection.normal = vec4(FaceNormal(toLocal, face), 1.0f);
+        return true;
+    }
+    return false;
+}
+
+AABB Box::getBoundingBox() {
+    vec3 e1 = vec3(v1 - v0);
+    vec3 e2 = vec3(v2 - v0);
+    vec3 e3 = vec3(v3 - v0);
+    AABB box;
+    for (int c = 0 ; c < 8 ; c++) {
+        box.grow(vec3(v0) + ((c & 1) ? e1 : vec3(0)) + ((c & 2) ? e2 : vec3(0)) + ((c & 4) ? e3 : vec3(0)));
+    }
+    return box;
+}
+
+// Getters
+vec4 Box::getV0() {
+    return v0;
+}
+
+vec4 Box::getV1() {
+    return v1;
+}
+
+vec4 Box::getV2() {
+    return v2;
+}
+
+vec4 Box::getV3() {
+    return v3;
+}
+
+mat3 Box::getToLocal() {
+    return toLocal;
+}
+
+// Setters
+void Box::setCorners(vec4 v0, vec4 v1, vec4 v2, vec4 v3) {
+    this->v0 = v0;
+    this->v1 = v1;
+    this->v2 = v2;
+    this->v3 = v3;
+    toLocal = inverse(mat3(vec3(v1 - v0), vec3(v2 - v0), vec3(v3 - v0)));
+}
@@ -0,0 +1,46 @@
+#ifndef BOX_H
+#define BOX_H
+
+#include "Shape.h"
+
+// A solid box, free to be rotated or sheared, tested with one slab test in
+// its own frame rather than as twelve triangles
+class Box : public Shape {
+
+    private:
+        vec4 v0;
+        vec4 v1;
+        vec4 v2;
+        vec4 v3;
+        // Takes offsets from v0 to the box's frame, where it is the unit cube
+        mat3 toLocal;
+
+    public:
+        // Constructor. The box has corner v0 and edges from v0 to each of
+        // v1, v2 and v3
+        Box(vec4 v0, vec4 v1, vec4 v2, vec4 v3, Material material);
+
+        // Distance along dir to where the ray enters the box, or leaves it
+        // if start is inside, or -1. face is set to 2 * axis, plus 1 for the
+        // far face along that axis of the box's frame
+        static float Distance(const vec3& v0, const mat3& toLocal, const vec3& start, const vec3& dir, int& face);
+
+        // Outward unit normal of a face numbered as by Distance
+        static vec3 FaceNormal(const mat3& toLocal, int face);
+
+        using Shape::intersects;
+        bool intersects(vec4 start, vec4 dir, Intersection & intersection, int index);
+        AABB getBoundingBox();
+
+        // Getters
+        vec4 getV0();
+        vec4 getV1();
+        vec4 getV2();
+        vec4 getV3();
+        mat3 getToLocal();
+
+        // Setters
+        // Moves the box to the given corners, as the constructor
+        void setCorners(vec4 v0, vec4 v1, vec4 v2, vec4 v3);
+};
+#endif
@@ -74,6 +74,13 @@ float Camera::getYaw() {
     return this->yaw;
 }
 
+//The columns of the rotation Ray::rotateRay applies
+void Camera::getBasis(vec3& right, vec3& up, vec3& forward) {
+    right = vec3(cos(yaw), 0, sin(yaw));
+    up = vec3(0, 1, 0);
+    forward = vec3(-sin(yaw), 0, cos(yaw));
+}
+
 // Setters
 void Camera::setPosition(vec4 position) {
     this->position = position;
@@ -28,6 +28,10 @@ class Camera {
         mat4 getR();
         float getYaw();
 
+        // Camera space axes rotated by the yaw, so a primary ray direction is
+        // x * right + y * up + z * forward without a matrix per pixel
+        void getBasis(vec3& right, vec3& up, vec3& forward);
+
         // Setters
         void setPosition(vec4 position);
         void setR(mat4 R);
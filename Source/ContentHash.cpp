@@ -0,0 +1,45 @@
+#include "ContentHash.h"
+
+#include <fstream>
+#include <vector>
+#include <cstring>
+
+#define FNV_OFFSET_BASIS 14695981039346656037ULL
+#define FNV_PRIME 1099511628211ULL
+
+// CONSTRUCTOR
+ContentHash::ContentHash() {
+    value = FNV_OFFSET_BASIS;
+}
+
+//Whole words are mixed in one step each so hashing a large file costs far
+//less than reading it. The tail is mixed a byte at a time
+void ContentHash::Add(const void * data, size_t bytes) {
+    const unsigned char * p = (const unsigned char *)data;
+    size_t i = 0;
+    for ( ; i + sizeof(uint64_t) <= bytes ; i += sizeof(uint64_t)) {
+        uint64_t word;
+        memcpy(&word, p + i, sizeof(uint64_t));
+        value = (value ^ word) * FNV_PRIME;
+    }
+    for ( ; i < bytes ; i++) {
+        value = (value ^ p[i]) * FNV_PRIME;
+    }
+}
+
+bool ContentHash::AddFile(string path) {
+    ifstream file(path, ios::binary);
+    if (!file) return false;
+
+    vector<char> chunk(1 << 20);
+    while (file) {
+        file.read(chunk.data(), chunk.size());
+        Add(chunk.data(), file.gcount());
+    }
+    return true;
+}
+
+// GETTERS
+uint64_t ContentHash::getValue() {
+    return value;
+}
@@ -0,0 +1,36 @@
+#ifndef CONTENT_HASH_H
+#define CONTENT_HASH_H
+
+#include <string>
+#include <cstddef>
+#include <cstdint>
+
+using namespace std;
+
+// 64 bit FNV-1a style hash, fed eight bytes at a time, used to key caches by
+// the content they were built from. Not cryptographic
+class ContentHash {
+
+    private:
+        uint64_t value;
+
+    public:
+        // CONSTRUCTOR
+        ContentHash();
+
+        void Add(const void * data, size_t bytes);
+
+        // Adds the bytes of a plain value, such as a float, vec3 or mat4
+        template<typename T>
+        void Add(const T& item) {
+            Add(&item, sizeof(T));
+        }
+
+        // Adds the file's contents. Returns false if it could not be read
+        bool AddFile(string path);
+
+        // GETTERS
+        uint64_t getValue();
+};
+
+#endif
@@ -0,0 +1,139 @@
+#include "EmissiveShapes.h"
+#include "Scene.h"
+#include "Light.h"
+#include "Triangle.h"
+#include "Sphere.h"
+#include "Quad.h"
+
+// Lights and photons start this far off the emitting surface so they do not
+// hit it straight away
+#define EMISSIVE_SURFACE_OFFSET 1e-4f
+
+// CONSTRUCTOR
+EmissiveShapes::EmissiveShapes() : firstShadowCacheSlot(0) {
+}
+
+EmissiveShapes::EmissiveShapes(Scene& scene, int firstShadowCacheSlot) {
+    this->firstShadowCacheSlot = firstShadowCacheSlot;
+    vector<Shape *>& sceneShapes = scene.getShapes();
+    vector<float> powers;
+    for (int i = 0 ; i < sceneShapes.size() ; i++) {
+        vec3 radiance = sceneShapes[i]->getMaterial().getEmitted();
+        if (radiance == vec3(0)) continue;
+
+        EmissiveShape shape;
+        shape.sphere = false;
+        shape.quad = false;
+        shape.radius = 0;
+        shape.radiance = radiance;
+        if (Sphere * sphere = dynamic_cast<Sphere *>(sceneShapes[i])) {
+            shape.sphere = true;
+            shape.v0 = vec3(sphere->getCentre());
+            shape.radius = sphere->getRadius();
+            shape.area = 4.0f * (float) M_PI * shape.radius * shape.radius;
+        } else if (Quad * quad = dynamic_cast<Quad *>(sceneShapes[i])) {
+            shape.quad = true;
+            shape.v0 = vec3(quad->getV0());
+            shape.e1 = vec3(quad->getV1()) - shape.v0;
+            shape.e2 = vec3(quad->getV2()) - shape.v0;
+            shape.normal = vec3(quad->getNormal());
+            shape.area = length(cross(shape.e1, shape.e2));
+        } else if (Triangle * triangle = dynamic_cast<Triangle *>(sceneShapes[i])) {
+            shape.v0 = vec3(triangle->getV0());
+            shape.e1 = vec3(triangle->getV1()) - shape.v0;
+            shape.e2 = vec3(triangle->getV2()) - shape.v0;
+            shape.normal = vec3(triangle->getNormal());
+            shape.area = 0.5f * length(cross(shape.e1, shape.e2));
+        } else {
+            //Boxes are left out
+            continue;
+        }
+        shapes.push_back(shape);
+        powers.push_back(ShapePower(shape));
+    }
+    table = AliasTable(powers);
+}
+
+float EmissiveShapes::ShapePower(EmissiveShape& shape) {
+    return (float) M_PI * shape.area * (shape.radiance.x + shape.radiance.y + shape.radiance.z) / 3.0f;
+}
+
+void EmissiveShapes::SamplePoint(int s, float u1, float u2, vec3& position, vec3& normal) {
+    EmissiveShape& shape = shapes[s];
+    if (shape.sphere) {
+        float z = 1.0f - 2.0f * u1;
+        float r = sqrt(glm::max(0.0f, 1.0f - z * z));
+        float phi = 2.0f * (float) M_PI * u2;
+        normal = vec3(r * cos(phi), r * sin(phi), z);
+        position = shape.v0 + shape.radius * normal;
+        return;
+    }
+    if (!shape.quad && u1 + u2 > 1.0f) {
+        //Fold the far half of the parallelogram back onto the triangle
+        u1 = 1.0f - u1;
+        u2 = 1.0f - u2;
+    }
+    position = shape.v0 + u1 * shape.e1 + u2 * shape.e2;
+    normal = shape.normal;
+}
+
+int EmissiveShapes::SampleSurface(float u, float u1, float u2, vec3& position, vec3& normal, vec3& radiance, float& pdfArea) {
+    float pmf;
+    int s = table.Sample(u, pmf);
+    SamplePoint(s, u1, u2, position, normal);
+    radiance = shapes[s].radiance;
+    pdfArea = pmf / shapes[s].area;
+    return s;
+}
+
+//A point light at distance d gives s_diff cos / (4 pi d^2), and a patch of
+//radiance L and area 1 / pdfArea gives L cos cosLight / (d^2 pdfArea), so each
+//sample is a point light with s_diff = 4 pi L cosLight / pdfArea
+vec3 EmissiveShapes::Luminance(Intersection& intersection, Ray incidentRay, Scene& scene, Camera& camera, int numSamples) {
+    vec3 colour(0,0,0);
+    if (shapes.empty()) return colour;
+    for (int i = 0 ; i < numSamples ; i++) {
+        float u = (float) rand() / ((float) RAND_MAX + 1);
+        float u1 = (float) rand() / (RAND_MAX);
+        float u2 = (float) rand() / (RAND_MAX);
+        vec3 position, normal, radiance;
+        float pdfArea;
+        int s = SampleSurface(u, u1, u2, position, normal, radiance, pdfArea);
+
+        vec3 toPoint = vec3(intersection.position) - position;
+        float cosLight = glm::max(0.0f, dot(normal, normalize(toPoint)));
+        vec3 intensity = 4.0f * (float) M_PI * radiance * cosLight / pdfArea;
+        Light l(vec4(position + EMISSIVE_SURFACE_OFFSET * normal, 1), vec3(0), intensity, intensity, 0.0f);
+        l.setShadowCacheSlot(firstShadowCacheSlot + s);
+        colour += l.FresnelLight(intersection, incidentRay, scene, camera);
+    }
+    return colour / (float) numSamples;
+}
+
+//Cosine weighted about the normal: a uniform point on the unit disc lifted
+//onto the hemisphere
+void EmissiveShapes::SamplePhoton(float u, float u1, float u2, float u3, float u4, int numPhotons, vec4& position, vec4& direction, vec3& power) {
+    vec3 point, normal, radiance;
+    float pdfArea;
+    SampleSurface(u, u1, u2, point, normal, radiance, pdfArea);
+
+    float r = sqrt(u3);
+    float phi = 2.0f * (float) M_PI * u4;
+    vec3 t = normalize(cross(fabs(normal.x) > 0.5f ? vec3(0, 1, 0) : vec3(1, 0, 0), normal));
+    vec3 b = cross(normal, t);
+    vec3 dir = r * cos(phi) * t + r * sin(phi) * b + sqrt(glm::max(0.0f, 1.0f - u3)) * normal;
+
+    position = vec4(point + EMISSIVE_SURFACE_OFFSET * normal, 1);
+    direction = vec4(dir, 1);
+    //pi L over the patch's 1 / pdfArea of area, shared between the photons
+    power = (float) M_PI * radiance / (pdfArea * (float) numPhotons);
+}
+
+// GETTERS
+int EmissiveShapes::getNumShapes() {
+    return shapes.size();
+}
+
+float EmissiveShapes::getTotalPower() {
+    return table.getTotal();
+}
@@ -0,0 +1,81 @@
+#ifndef EMISSIVE_SHAPES_H
+#define EMISSIVE_SHAPES_H
+
+#include <glm/glm.hpp>
+#include <vector>
+#include "AliasTable.h"
+#include "Ray.h"
+#include "Camera.h"
+
+class Scene;
+
+using namespace std;
+using glm::vec3;
+using glm::mat3;
+using glm::vec4;
+using glm::mat4;
+
+// One emitting shape. Triangles and quads are v0 + u e1 + v e2, over u + v <= 1
+// for triangles, and emit from the side their normal faces. Spheres emit
+// outwards all over
+struct EmissiveShape {
+    bool sphere;
+    bool quad;
+    vec3 v0;
+    vec3 e1;
+    vec3 e2;
+    vec3 normal;
+    float radius;
+    // Emitted radiance, the material's emitted colour
+    vec3 radiance;
+    float area;
+};
+
+// The scene's shapes with an emitted colour, as light sources. Each is picked
+// from an alias table by emitted power, pi times radiance times area, then a
+// point taken uniformly over its surface, so sampling costs the same however
+// many shapes emit or however large they are
+class EmissiveShapes {
+
+    private:
+        vector<EmissiveShape> shapes;
+        AliasTable table;
+        // Shape s keeps its last shadow ray blocker in occluder cache slot
+        // firstShadowCacheSlot + s
+        int firstShadowCacheSlot;
+
+        // Uniform point on shape s's surface and the normal there
+        void SamplePoint(int s, float u1, float u2, vec3& position, vec3& normal);
+
+    public:
+        // CONSTRUCTOR
+        EmissiveShapes();
+        // Takes the triangles, quads and spheres of the scene's own shapes
+        // whose materials emit. Their occluder cache slots start from
+        // firstShadowCacheSlot, which should be past the light spheres' slots
+        EmissiveShapes(Scene& scene, int firstShadowCacheSlot);
+
+        // Summed emitted power, averaged over colour
+        static float ShapePower(EmissiveShape& shape);
+
+        // Picks a point on an emitter, shape in proportion to power and
+        // point uniform over its area, with u, u1 and u2 uniform in [0, 1).
+        // pdfArea is its density per unit area over all emitting surface.
+        // Returns the shape picked
+        int SampleSurface(float u, float u1, float u2, vec3& position, vec3& normal, vec3& radiance, float& pdfArea);
+
+        // Light reaching the intersection from numSamples points on the
+        // emitters, each shaded as a point light just off the surface
+        vec3 Luminance(Intersection& intersection, Ray incidentRay, Scene& scene, Camera& camera, int numSamples);
+
+        // Starts a photon: a point picked as by SampleSurface and a cosine
+        // weighted direction about the normal there from u3 and u4. power is
+        // the photon's share of the emitted power when numPhotons are sent
+        void SamplePhoton(float u, float u1, float u2, float u3, float u4, int numPhotons, vec4& position, vec4& direction, vec3& power);
+
+        // GETTERS
+        int getNumShapes();
+        float getTotalPower();
+};
+
+#endif
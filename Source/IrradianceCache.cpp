@@ -0,0 +1,130 @@
+#include "IrradianceCache.h"
+
+#include <algorithm>
+
+// CONSTRUCTOR
+IrradianceCache::IrradianceCache(float accuracy, bool gradients) : numRecords(0), numLookups(0), numHits(0) {
+    this->accuracy = accuracy;
+    this->gradients = gradients;
+    buckets.resize(IRRADIANCE_CACHE_BUCKETS);
+    locks.resize(IRRADIANCE_CACHE_BUCKETS);
+    for (int i = 0 ; i < locks.size() ; i++) {
+        omp_init_lock(&locks[i]);
+    }
+}
+
+IrradianceCache::~IrradianceCache() {
+    for (int i = 0 ; i < locks.size() ; i++) {
+        omp_destroy_lock(&locks[i]);
+    }
+}
+
+//Teschner et al.'s spatial hash
+int IrradianceCache::Bucket(int x, int y, int z) {
+    unsigned int h = ((unsigned int) x * 73856093u) ^ ((unsigned int) y * 19349663u) ^ ((unsigned int) z * 83492791u);
+    return h % IRRADIANCE_CACHE_BUCKETS;
+}
+
+int IrradianceCache::CellBucket(vec3 position) {
+    vec3 cell = floor(position / IRRADIANCE_CACHE_CELL);
+    return Bucket((int) cell.x, (int) cell.y, (int) cell.z);
+}
+
+//Records in front of the point, by more than a sliver of their radius, are
+//left out as Ward does, since they may see light the point does not
+bool IrradianceCache::Lookup(vec3 position, vec3 normal, Material * material, int n, vec3& value) {
+    numLookups++;
+    int bucket = CellBucket(position);
+    vec3 sum(0);
+    float totalWeight = 0;
+
+    omp_set_lock(&locks[bucket]);
+    vector<IrradianceRecord>& records = buckets[bucket];
+    for (int i = 0 ; i < records.size() ; i++) {
+        IrradianceRecord& record = records[i];
+        if (record.material != material || record.n != n) continue;
+        vec3 offset = position - record.position;
+        float error = length(offset) / record.radius + sqrt(glm::max(0.0f, 1.0f - dot(normal, record.normal)));
+        if (error >= accuracy) continue;
+        if (dot(offset, 0.5f * (normal + record.normal)) < -0.05f * record.radius) continue;
+
+        float weight = 1.0f / glm::max(error, 1e-4f);
+        vec3 recordValue = record.value;
+        if (gradients) {
+            recordValue += record.gradient * offset;
+        }
+        sum += weight * recordValue;
+        totalWeight += weight;
+    }
+    omp_unset_lock(&locks[bucket]);
+
+    if (totalWeight == 0) return false;
+    numHits++;
+    //Gradients carried too far can overshoot below zero
+    value = glm::max(sum / totalWeight, vec3(0));
+    return true;
+}
+
+//A record is filed once in every bucket holding a cell within
+//accuracy * radius of it, the furthest any query could use it from
+void IrradianceCache::Insert(IrradianceRecord record) {
+    record.radius = glm::min(record.radius, IRRADIANCE_CACHE_MAX_RADIUS);
+    if (record.radius <= 0) return;
+    float reach = accuracy * record.radius;
+    vec3 lower = floor((record.position - vec3(reach)) / IRRADIANCE_CACHE_CELL);
+    vec3 upper = floor((record.position + vec3(reach)) / IRRADIANCE_CACHE_CELL);
+
+    vector<int> recordBuckets;
+    for (int z = (int) lower.z ; z <= (int) upper.z ; z++) {
+        for (int y = (int) lower.y ; y <= (int) upper.y ; y++) {
+            for (int x = (int) lower.x ; x <= (int) upper.x ; x++) {
+                int bucket = Bucket(x, y, z);
+                if (find(recordBuckets.begin(), recordBuckets.end(), bucket) == recordBuckets.end()) {
+                    recordBuckets.push_back(bucket);
+                }
+            }
+        }
+    }
+    for (int i = 0 ; i < recordBuckets.size() ; i++) {
+        omp_set_lock(&locks[recordBuckets[i]]);
+        buckets[recordBuckets[i]].push_back(record);
+        omp_unset_lock(&locks[recordBuckets[i]]);
+    }
+    numRecords++;
+}
+
+void IrradianceCache::Clear() {
+    for (int i = 0 ; i < buckets.size() ; i++) {
+        omp_set_lock(&locks[i]);
+        buckets[i].clear();
+        omp_unset_lock(&locks[i]);
+    }
+    numRecords = 0;
+}
+
+// GETTERS
+bool IrradianceCache::useGradients() {
+    return gradients;
+}
+
+long IrradianceCache::getNumRecords() {
+    return numRecords;
+}
+
+long IrradianceCache::getNumLookups() {
+    return numLookups;
+}
+
+long IrradianceCache::getNumHits() {
+    return numHits;
+}
+
+float IrradianceCache::getHitRate() {
+    long lookups = numLookups;
+    return lookups > 0 ? (float) numHits / lookups : 0.0f;
+}
+
+void IrradianceCache::resetCounts() {
+    numLookups = 0;
+    numHits = 0;
+}
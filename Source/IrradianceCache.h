@@ -0,0 +1,87 @@
+#ifndef IRRADIANCE_CACHE_H
+#define IRRADIANCE_CACHE_H
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <atomic>
+#include <omp.h>
+#include "Material.h"
+
+using namespace std;
+using glm::vec3;
+using glm::mat3;
+using glm::vec4;
+using glm::mat4;
+
+// Side of the grid cells records are filed under, and the number of buckets
+// the cells hash into
+#define IRRADIANCE_CACHE_CELL 0.1f
+#define IRRADIANCE_CACHE_BUCKETS 4096
+
+// Largest radius a record is taken to hold over, however wide its gather
+#define IRRADIANCE_CACHE_MAX_RADIUS 0.25f
+
+// A photon estimate made at position, on a surface facing normal. radius is
+// the gather's radius. The record only stands in for estimates of n photons
+// on the same material
+struct IrradianceRecord {
+    vec3 position;
+    vec3 normal;
+    vec3 value;
+    // Change in value per unit move along x, y and z, one column each
+    mat3 gradient;
+    float radius;
+    Material * material;
+    int n;
+};
+
+// Ward's irradiance cache over diffuse photon estimates. A query interpolates
+// the records near enough and facing near enough the same way, each weighted
+// by 1 / (d / radius + sqrt(1 - n . n_i)) and kept while that error term is
+// under accuracy, and makes no estimate of its own if there are none. With
+// gradients each record's value is first carried to the query point. Records
+// are filed under every cell of a hashed grid they reach, so a query reads a
+// single bucket, and each bucket has its own lock, so threads can look up and
+// add records together. Results depend on the order records are added in
+class IrradianceCache {
+
+    private:
+        float accuracy;
+        bool gradients;
+        vector<vector<IrradianceRecord> > buckets;
+        vector<omp_lock_t> locks;
+
+        atomic<long> numRecords;
+        atomic<long> numLookups;
+        atomic<long> numHits;
+
+        static int Bucket(int x, int y, int z);
+        int CellBucket(vec3 position);
+
+    public:
+        // CONSTRUCTOR
+        IrradianceCache(float accuracy, bool gradients);
+        ~IrradianceCache();
+
+        // Interpolates the records valid at position into value. Returns
+        // false if there are none
+        bool Lookup(vec3 position, vec3 normal, Material * material, int n, vec3& value);
+
+        // Adds a record, with its radius held to IRRADIANCE_CACHE_MAX_RADIUS
+        void Insert(IrradianceRecord record);
+
+        // Drops every record, as when the photon map changes
+        void Clear();
+
+        // GETTERS
+        bool useGradients();
+        long getNumRecords();
+        // Lookups and hits since the last reset
+        long getNumLookups();
+        long getNumHits();
+        float getHitRate();
+
+        void resetCounts();
+};
+
+#endif
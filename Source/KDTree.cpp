@@ -56,10 +56,11 @@ KDTree::KDTree( vector<Photon>& nphotons, int dimension ){
     }
 }
 
-//Add the n closest photons to the priority queue
+//Add the n closest photons within max_dist to the priority queue
 void KDTree::searchPhotonList(std::priority_queue<PhotonComparator>& pq, float max_dist, int n, vec4 position){
     for (int i = 0 ; i < this->photons.size() ; i++) {
         float dist = distance(position, this->photons[i].getPosition());
+        if (dist > max_dist) continue;
             PhotonComparator pc(dist, this->photons[i]);
             if (pq.size() < n) {
                 pq.push(pc);
@@ -70,8 +71,12 @@ void KDTree::searchPhotonList(std::priority_queue<PhotonComparator>& pq, float m
     }
 }
 
-//Add the n closest photons to the priority queue
-void KDTree::FillPQClosestPhotons(int n, float max_dist, vec4 position, std::priority_queue<PhotonComparator>& pq, int dimension){
+//Add the n closest photons to the priority queue. With epsilon > 0 the search
+//is approximate: once n photons are queued a subtree is only visited if it
+//could hold a photon more than (1 + epsilon) times closer than the current
+//n-th closest, so the n-th photon found is at most (1 + epsilon) times further
+//away than the true n-th nearest
+void KDTree::FillPQClosestPhotons(int n, float max_dist, vec4 position, std::priority_queue<PhotonComparator>& pq, int dimension, float epsilon){
 
     float delta = position[dimension] - this->median;
 
@@ -85,20 +90,18 @@ void KDTree::FillPQClosestPhotons(int n, float max_dist, vec4 position, std::pri
     else{
         if(delta < 0){
             //Check left branch first
-            (this->left_kd)->FillPQClosestPhotons(n, max_dist, position, pq, (dimension+1)%3);
+            (this->left_kd)->FillPQClosestPhotons(n, max_dist, position, pq, (dimension+1)%3, epsilon);
             //Then try the right branch if it is not to far away
-            if( pow(delta,2) < pow(max_dist,2)) {
-                (this->right_kd)->FillPQClosestPhotons(n, max_dist, position, pq, (dimension + 1) % 3);
-                if (pq.size() == n) return;
+            if( pow(delta * PruneSlack(n, pq, epsilon),2) < pow(SearchRadius(n, max_dist, pq),2)) {
+                (this->right_kd)->FillPQClosestPhotons(n, max_dist, position, pq, (dimension + 1) % 3, epsilon);
             }
         }
         else{
             //Check the right branch first
-            (this->right_kd)->FillPQClosestPhotons(n, max_dist, position, pq, (dimension+1)%3);
+            (this->right_kd)->FillPQClosestPhotons(n, max_dist, position, pq, (dimension+1)%3, epsilon);
             //Then try the left branch if it is not to far away
-            if( pow(delta,2) < pow(max_dist,2)) {
-                (this->left_kd)->FillPQClosestPhotons(n, max_dist, position, pq, (dimension + 1) % 3);
-                if (pq.size() == n) return;
+            if( pow(delta * PruneSlack(n, pq, epsilon),2) < pow(SearchRadius(n, max_dist, pq),2)) {
+                (this->left_kd)->FillPQClosestPhotons(n, max_dist, position, pq, (dimension + 1) % 3, epsilon);
             }
         }
     }
@@ -108,7 +111,7 @@ void KDTree::FillPQClosestPhotons(int n, float max_dist, vec4 position, std::pri
 vector<Photon> KDTree::FindClosestPhotons(int n, float max_dist, vec4 position){
 
     std::priority_queue<PhotonComparator> pq;
-    FillPQClosestPhotons(n, max_dist, position, pq, 0);
+    FillPQClosestPhotons(n, max_dist, position, pq, 0, 0.0f);
     vector<Photon> nearestPhotons;
     while (!pq.empty()) {
         PhotonComparator pc = pq.top();
@@ -118,6 +121,56 @@ vector<Photon> KDTree::FindClosestPhotons(int n, float max_dist, vec4 position){
     return nearestPhotons;
 }
 
+//Finds the n closest photons to a point, starting the search at radius_hint
+//(e.g. the result of the previous query on this thread) and only widening it
+//towards max_dist when too few photons were found. On return radius_hint holds
+//a starting radius for the next, neighbouring, query. epsilon > 0 makes the
+//search approximate (see FillPQClosestPhotons)
+vector<Photon> KDTree::FindClosestPhotons(int n, float max_dist, vec4 position, float& radius_hint, float epsilon){
+
+    float radius = (radius_hint > 0 && radius_hint < max_dist) ? radius_hint : max_dist;
+
+    std::priority_queue<PhotonComparator> pq;
+    FillPQClosestPhotons(n, radius, position, pq, 0, epsilon);
+    while (pq.size() < n && radius < max_dist) {
+        //Too few photons inside the radius, widen it and search again
+        radius = min(radius * 2.0f, max_dist);
+        pq = std::priority_queue<PhotonComparator>();
+        FillPQClosestPhotons(n, radius, position, pq, 0, epsilon);
+    }
+
+    //The furthest photon is a good predictor of the next query's radius
+    if (pq.size() == n) {
+        radius_hint = pq.top().getDistance() * WARM_START_SLACK;
+    } else {
+        radius_hint = max_dist;
+    }
+
+    vector<Photon> nearestPhotons;
+    while (!pq.empty()) {
+        PhotonComparator pc = pq.top();
+        pq.pop();
+        nearestPhotons.push_back(pc.getPhoton());
+    }
+    return nearestPhotons;
+}
+
+//The (1 + epsilon) slack only applies against the n-th closest photon. Until
+//there are n of them every photon within max_dist is still wanted, so the
+//far side is pruned against max_dist exactly
+float KDTree::PruneSlack(int n, std::priority_queue<PhotonComparator>& pq, float epsilon){
+    return pq.size() < n ? 1.0f : 1.0f + epsilon;
+}
+
+//Returns the radius a subtree must fall within to improve the current result.
+//Once we have n photons nothing further than the n-th closest can be added
+float KDTree::SearchRadius(int n, float max_dist, std::priority_queue<PhotonComparator>& pq){
+    if (pq.size() < n) {
+        return max_dist;
+    }
+    return min(max_dist, pq.top().getDistance());
+}
+
 bool KDTree::sortOnX(Photon photonA, Photon photonB){
     if(photonA.getPosition()[0] < photonB.getPosition()[0])
         return true;
@@ -12,6 +12,10 @@ using glm::mat3;
 using glm::vec4;
 using glm::mat4;
 
+// Slack applied to the previous query's furthest photon distance when it is
+// reused as the starting radius of the next query
+#define WARM_START_SLACK 1.25f
+
 class KDTree {
 
     private:
@@ -33,8 +37,11 @@ class KDTree {
         vector<Photon> getPhotons();
 
         void searchPhotonList(priority_queue<PhotonComparator>& pq, float max_dist, int n, vec4 position);
-        void FillPQClosestPhotons(int n, float max_dist, vec4 position, priority_queue<PhotonComparator>& pq, int dimension);
+        void FillPQClosestPhotons(int n, float max_dist, vec4 position, priority_queue<PhotonComparator>& pq, int dimension, float epsilon);
         vector<Photon> FindClosestPhotons(int n, float max_dist, vec4 position);
+        vector<Photon> FindClosestPhotons(int n, float max_dist, vec4 position, float& radius_hint, float epsilon);
+        float SearchRadius(int n, float max_dist, priority_queue<PhotonComparator>& pq);
+        float PruneSlack(int n, priority_queue<PhotonComparator>& pq, float epsilon);
 };
 
 #endif
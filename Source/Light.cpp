@@ -1,4 +1,5 @@
 #include "Light.h"
+#include "ShadowPhotons.h"
 #include <iostream>
 
 // Constructor
@@ -8,10 +9,11 @@ Light::Light(vec4 position, vec3 s_amb, vec3 s_diff, vec3 s_spec, float power) {
     setDiffuse(s_diff);
     setSpecular(s_spec);
     setPower(power);
+    setShadowCacheSlot(0);
 }
 
 // Direct light
-vec3 Light::directLight(const Intersection& i, vector<Shape *> shapes) {
+vec3 Light::directLight(const Intersection& i, Scene& scene) {
 
     // Distance from point to light source
     float r = distance(i.position, this->position);
@@ -33,28 +35,30 @@ vec3 Light::directLight(const Intersection& i, vector<Shape *> shapes) {
     // Power of the emitted light for each colour component
     vec3 P = this->s_diff;
 
-    Ray pointToLight(i.position + 0.001f * vec4(r_hat, 1), vec4(r_hat, 1));
+    // Shadow ray from just off the surface towards the light, stopping short of it
+    vec4 shadowStart = i.position + 0.001f * vec4(r_hat, 1);
+    float lightDistance = glm::length(vec3(this->position) - vec3(shadowStart));
+
+    //Points the shadow photons say are plainly lit or in shadow take no shadow ray
+    int visibility = scene.getShadowPhotons() ? scene.getShadowPhotons()->Visibility(i.position) : VISIBILITY_UNKNOWN;
+    if (visibility == VISIBILITY_SHADOWED) {
+        return vec3(0,0,0);
+    }
 
-    Intersection closestIntersection;
-
-    // i = interescting ray point passed in
-    // clostestIntersection = closest intersecting surface for a ray project from the light source
-    if (pointToLight.closestIntersection(shapes, closestIntersection)) {
-        float dist = glm::distance(i.position, closestIntersection.position);
-        if (dist < r) {
-            //Case object which is first collided with is translucent/transparent
-            if(shapes[closestIntersection.index]->getMaterial().isTransparent()){
-                float scalar = (max(dot(r_hat, n_hat), 0.0f) / (4.0f * M_PI * pow(r, 2)));
-                vec3 D(P.x * scalar, P.y * scalar, P.z * scalar);
-                vec3 Dnew =  D * shapes[i.index]->getMaterial().getDiffuse();
-                //TODO: 0.5 set to mimic the fact that there should be a slight shadow
-                float translucentShadowFactor = 0.9f;
-                return vec3(Dnew.x * translucentShadowFactor, Dnew.y * translucentShadowFactor, Dnew.z * translucentShadowFactor);
-            }
-            //Else the object is opaque and set to a hard shadow
-            else{
-                return vec3(0,0,0);
-            }
+    bool transparentOnly;
+    if (visibility == VISIBILITY_UNKNOWN && scene.occluded(shadowStart, vec4(r_hat, 1), lightDistance, transparentOnly, shadowCacheSlot)) {
+        //Case every object between the point and the light is translucent/transparent
+        if(transparentOnly){
+            float scalar = (max(dot(r_hat, n_hat), 0.0f) / (4.0f * M_PI * pow(r, 2)));
+            vec3 D(P.x * scalar, P.y * scalar, P.z * scalar);
+            vec3 Dnew =  D * scene.getMaterial(i.index).getDiffuse();
+            //TODO: 0.5 set to mimic the fact that there should be a slight shadow
+            float translucentShadowFactor = 0.9f;
+            return vec3(Dnew.x * translucentShadowFactor, Dnew.y * translucentShadowFactor, Dnew.z * translucentShadowFactor);
+        }
+        //Else an opaque object casts a hard shadow
+        else{
+            return vec3(0,0,0);
         }
     }
     float scalar = (max(dot(r_hat, n_hat), 0.0f) / (4.0f * M_PI * pow(r, 2)));
@@ -63,13 +67,13 @@ vec3 Light::directLight(const Intersection& i, vector<Shape *> shapes) {
     vec3 D(P.x * scalar, P.y * scalar, P.z * scalar);
 
 
-    return D * shapes[i.index]->getMaterial().getDiffuse();
+    return D * scene.getMaterial(i.index).getDiffuse();
 }
 
 
-vec3 Light::SpecularLight(const Intersection i, vector<Shape *> shapes, Camera camera) {
+vec3 Light::SpecularLight(const Intersection i, Scene& scene, Camera camera) {
 
-    Shape * shape = shapes[i.index];
+    Material& material = scene.getMaterial(i.index);
 
     //Required Ks for balancing factor for specular light, as defined in phongs phesis
     float Ks = 0.01;
@@ -106,16 +110,16 @@ vec3 Light::SpecularLight(const Intersection i, vector<Shape *> shapes, Camera c
     float blinn = dot(halfAngle, n_hat);
     blinn = glm::clamp(blinn, 0.0f, 1.0f);
     blinn = cosAngIncidence != 0.0 ? blinn : 0.0;
-    blinn = pow(blinn, shape->getMaterial().getShininess());
+    blinn = pow(blinn, material.getShininess());
 
-    return blinn * shape->getMaterial().getSpecular() * attenIntensity;
+    return blinn * material.getSpecular() * attenIntensity;
 }
 
 
-Ray Light::RefractLightRay(const Intersection i, Ray incidentRay, vector<Shape *> shapes){
+Ray Light::RefractLightRay(const Intersection i, Ray incidentRay, Scene& scene){
 
-    //Get the shape and its normal
-    Shape *  shape = shapes[i.index];
+    //Get the material and normal
+    Material& material = scene.getMaterial(i.index);
     vec4 dir4 = incidentRay.getDirection();
     vec4 N4 = i.normal;
 
@@ -124,7 +128,7 @@ Ray Light::RefractLightRay(const Intersection i, Ray incidentRay, vector<Shape *
 
     //Find and define the refractive indices
     float etai = 1.0f;
-    float etat = shape->getMaterial().getRefractiveIndex();
+    float etat = material.getRefractiveIndex();
 
     vec3 transmittedRayDir = vec3(0.0f,0.0f,0.0f);
 
@@ -173,13 +177,12 @@ vec4 Light::reflectRay(Ray incidentRay, const vec4 normal) {
     return vec4(newdir.x, newdir.y, newdir.z, 1);
 }
 
-vec3 Light::totalLight(Intersection closestIntersection, vector<Shape *> shapes, Camera camera){
+vec3 Light::totalLight(Intersection closestIntersection, Scene& scene, Camera camera){
 
-    Shape * shape = shapes[closestIntersection.index];
-    Material mat = shape->getMaterial();
+    Material& mat = scene.getMaterial(closestIntersection.index);
 
-    vec3 i_diff = directLight(closestIntersection, shapes);
-    vec3 i_spec = SpecularLight(closestIntersection, shapes, camera);
+    vec3 i_diff = directLight(closestIntersection, scene);
+    vec3 i_spec = SpecularLight(closestIntersection, scene, camera);
     vec3 i_amb  = mat.getAmbient() * this->getAmbient();
     float distanceAttenuation = 2;
     float dimming_factor = 0.8f;
@@ -189,25 +192,25 @@ vec3 Light::totalLight(Intersection closestIntersection, vector<Shape *> shapes,
     return totalLight;
 }
 
-vec3 Light::RefractedLight(const Intersection i, Ray incidentRay, vector<Shape *> shapes, const int rayDepth, int depth, vec3 hitColour, Camera camera){
+vec3 Light::RefractedLight(const Intersection i, Ray incidentRay, Scene& scene, const int rayDepth, int depth, vec3 hitColour, Camera camera){
 
     if(depth > rayDepth) return vec3(0,0,0);
 
-    //Get the shape
-    Shape * shape = shapes[i.index];
+    //Get the material
+    Material& material = scene.getMaterial(i.index);
 
     //If the material is transparent
-    if(shape->getMaterial().isTransparent()){
+    if(material.isTransparent()){
         //Find the refracted ray from the intersection
-        Ray refractedRay = RefractLightRay(i, incidentRay, shapes);
+        Ray refractedRay = RefractLightRay(i, incidentRay, scene);
         vec4 transmittedRayDir = refractedRay.getDirection();
         vec3 trd3 = normalize(vec3(transmittedRayDir));
         transmittedRayDir = vec4(trd3, 1);
         refractedRay.setDirection(transmittedRayDir);
         Intersection i_next;
-        if(refractedRay.closestIntersection(shapes, i_next)){
+        if(refractedRay.closestIntersection(scene, i_next)){
             //Find the colour of the reflected ray
-            vec3 colour = RefractedLight(i_next, refractedRay, shapes, rayDepth, depth+1, hitColour, camera);
+            vec3 colour = RefractedLight(i_next, refractedRay, scene, rayDepth, depth+1, hitColour, camera);
             hitColour = vec3(hitColour.x + (0.95 * colour.x), hitColour.y + (0.95 * colour.y), hitColour.z + (0.95 * colour.z));
         }
         else {
@@ -218,25 +221,25 @@ vec3 Light::RefractedLight(const Intersection i, Ray incidentRay, vector<Shape *
         if (depth == 0) {
             hitColour = vec3(0);
         } else {
-            hitColour = totalLight(i, shapes, camera);
+            hitColour = totalLight(i, scene, camera);
         }
     }
 
     return hitColour;
 }
 
-vec3 Light::ReflectedLight(const Intersection i, Ray incidentRay, vector<Shape *> shapes, const int rayDepth, int depth, vec3 hitColour, Camera camera){
+vec3 Light::ReflectedLight(const Intersection i, Ray incidentRay, Scene& scene, const int rayDepth, int depth, vec3 hitColour, Camera camera){
 
     //If we have recursed too far (i.e. ray keep getting reflected)
     //then set the colour to the background colour
     if( depth > rayDepth ) return vec3(0,0,0);
 
-    Shape * shape = shapes[i.index];
+    Material& material = scene.getMaterial(i.index);
 
     vec4 n = i.normal;
 
     //Surface is reflective, reflect the ray
-    if(shape->getMaterial().isReflective()){
+    if(material.isReflective()){
 
         //Compute the reflected ray
         vec4 reflectedDirection = reflectRay(incidentRay, n);
@@ -244,9 +247,9 @@ vec3 Light::ReflectedLight(const Intersection i, Ray incidentRay, vector<Shape *
 
         //Find the next intersection, if there exists one reflect the ray, else return background colour
         Intersection i_next;
-        if(reflectedRay.closestIntersection(shapes, i_next)){
+        if(reflectedRay.closestIntersection(scene, i_next)){
             //Find the colour of the reflected ray
-            vec3 colour = ReflectedLight(i_next, reflectedRay, shapes, rayDepth, depth+1, hitColour, camera);
+            vec3 colour = ReflectedLight(i_next, reflectedRay, scene, rayDepth, depth+1, hitColour, camera);
             hitColour = vec3(hitColour.x + (0.95 * colour.x), hitColour.y + (0.95 * colour.y), hitColour.z + (0.95 * colour.z));
         }
         else {
@@ -257,7 +260,7 @@ vec3 Light::ReflectedLight(const Intersection i, Ray incidentRay, vector<Shape *
     else {
         if (depth == 0) {
             hitColour = vec3(0);
-            hitColour = totalLight(i, shapes, camera);
+            hitColour = totalLight(i, scene, camera);
         }
     }
 
@@ -267,13 +270,13 @@ vec3 Light::ReflectedLight(const Intersection i, Ray incidentRay, vector<Shape *
 
 
 //Calculates the fresnel ratio of reflected light
-float Light::FresnelRatio(const Intersection i, Ray incidentRay, vector<Shape *> shapes){
+float Light::FresnelRatio(const Intersection i, Ray incidentRay, Scene& scene){
 
     //Define the reflected light Ratio
     float FR = 0.5f;
 
-    //Get the shape and its normal
-    Shape * shape = shapes[i.index];
+    //Get the material and normal
+    Material& material = scene.getMaterial(i.index);
     vec4 dir4 = incidentRay.getDirection();
     vec4 N4 = i.normal;
 
@@ -281,7 +284,7 @@ float Light::FresnelRatio(const Intersection i, Ray incidentRay, vector<Shape *>
     vec3 N(N4[0], N4[1], N4[2]);
 
     //Find and define the refractive indices
-    float etat = 1.0, etai = shape->getMaterial().getRefractiveIndex();
+    float etat = 1.0, etai = material.getRefractiveIndex();
 
     //cout << etai << endl;
 
@@ -314,27 +317,27 @@ float Light::FresnelRatio(const Intersection i, Ray incidentRay, vector<Shape *>
 }
 
 //Finds the colour of an individual incident ray based on reflection and refraction
-vec3 Light::FresnelLight(const Intersection i, Ray incidentRay, vector<Shape *> shapes, Camera camera){
+vec3 Light::FresnelLight(const Intersection i, Ray incidentRay, Scene& scene, Camera camera){
 
     float lengthDir3 = length(vec3(incidentRay.getDirection()));
     assert(lengthDir3 > 0.999f && lengthDir3 < 1.001f);
 
     vec3 hitColour = vec3(0,0,0);
 
-    Shape * shape = shapes[i.index];
+    Material& material = scene.getMaterial(i.index);
 
     //If the material is reflective and transparent compute the fresnel effect
-    if(shape->getMaterial().isReflective() && shape->getMaterial().isTransparent()){
+    if(material.isReflective() && material.isTransparent()){
 
 
-        float reflectiveRatio = FresnelRatio(i, incidentRay, shapes);
+        float reflectiveRatio = FresnelRatio(i, incidentRay, scene);
 
         if(reflectiveRatio >= 1){
-            hitColour = ReflectedLight(i, incidentRay , shapes, 10, 0, hitColour, camera);
+            hitColour = ReflectedLight(i, incidentRay , scene, 10, 0, hitColour, camera);
         }
         else{
-            vec3 reflectedColour = ReflectedLight(i, incidentRay , shapes, 10, 0, hitColour, camera);
-            vec3 refractedColour = RefractedLight(i, incidentRay , shapes, 10, 0, hitColour, camera);
+            vec3 reflectedColour = ReflectedLight(i, incidentRay , scene, 10, 0, hitColour, camera);
+            vec3 refractedColour = RefractedLight(i, incidentRay , scene, 10, 0, hitColour, camera);
 
             float refractiveRatio = 1 - reflectiveRatio;
 
@@ -345,24 +348,24 @@ vec3 Light::FresnelLight(const Intersection i, Ray incidentRay, vector<Shape *>
     }
 
     //If the material is only reflective, compute the reflective light
-    else if(shape->getMaterial().isReflective()){
+    else if(material.isReflective()){
 
-        hitColour = ReflectedLight(i, incidentRay , shapes, 10, 0, hitColour, camera);
-        float diff_ratio = 1.0f - shape->getMaterial().getReflectRatio();
+        hitColour = ReflectedLight(i, incidentRay , scene, 10, 0, hitColour, camera);
+        float diff_ratio = 1.0f - material.getReflectRatio();
 
-        hitColour = vec3(hitColour.x * shape->getMaterial().getReflectRatio() + shape->getMaterial().getDiffuse().x * diff_ratio,
-                         hitColour.y * shape->getMaterial().getReflectRatio() + shape->getMaterial().getDiffuse().y * diff_ratio,
-                         hitColour.z * shape->getMaterial().getReflectRatio() + shape->getMaterial().getDiffuse().z * diff_ratio);
+        hitColour = vec3(hitColour.x * material.getReflectRatio() + material.getDiffuse().x * diff_ratio,
+                         hitColour.y * material.getReflectRatio() + material.getDiffuse().y * diff_ratio,
+                         hitColour.z * material.getReflectRatio() + material.getDiffuse().z * diff_ratio);
     }
 
     //If the material is only refractive
-    else if(shape->getMaterial().isTransparent()){
-        hitColour = RefractedLight(i, incidentRay , shapes, 5, 0, hitColour, camera);
+    else if(material.isTransparent()){
+        hitColour = RefractedLight(i, incidentRay , scene, 5, 0, hitColour, camera);
     }
 
     //Else the material is diffuse in which case we have already computed it's colour, return
     else{
-        hitColour = totalLight(i, shapes, camera);
+        hitColour = totalLight(i, scene, camera);
     }
     return hitColour;
 }
@@ -414,6 +417,10 @@ float Light::getPower() {
     return power;
 }
 
+int Light::getShadowCacheSlot() {
+    return shadowCacheSlot;
+}
+
 // Setters
 void Light::setAmbient(vec3 ambient) {
     s_amb = ambient;
@@ -434,3 +441,7 @@ void Light::setPosition(vec4 position) {
 void Light::setPower(float power) {
     this->power = power;
 }
+
+void Light::setShadowCacheSlot(int shadowCacheSlot) {
+    this->shadowCacheSlot = shadowCacheSlot;
+}
@@ -4,6 +4,7 @@
 #include <glm/glm.hpp>
 #include <vector>
 #include "Shape.h"
+#include "Scene.h"
 #include "Ray.h"
 #include "Camera.h"
 
@@ -22,21 +23,25 @@ class Light {
         vec4 position;
         float power;
 
+        // Occluder cache slot shadow rays to this light test first, so
+        // lights sampled from the same source share their last blocker
+        int shadowCacheSlot;
+
     public:
         // Constructor
         Light(vec4 position, vec3 s_amb, vec3 s_diff, vec3 s_spec, float power);
 
         // Direct light
-        vec3 directLight(const Intersection& i, vector<Shape *> shapes);
+        vec3 directLight(const Intersection& i, Scene& scene);
 
-        vec3 SpecularLight(const Intersection i, vector<Shape *> shapes, Camera camera);
-        Ray RefractLightRay(const Intersection i, Ray incidentRay, vector<Shape *> shapes);
+        vec3 SpecularLight(const Intersection i, Scene& scene, Camera camera);
+        Ray RefractLightRay(const Intersection i, Ray incidentRay, Scene& scene);
         vec4 reflectRay(Ray incidentRay, const vec4 normal);
-        vec3 totalLight(Intersection closestIntersection, vector<Shape *> shapes, Camera camera);
-        vec3 RefractedLight(const Intersection i, Ray incidentRay, vector<Shape *> shapes, const int rayDepth, int depth, vec3 hitColour, Camera camera);
-        vec3 ReflectedLight(const Intersection i, Ray incidentRay ,vector<Shape *> shapes, const int rayDepth, int depth, vec3 hitColour, Camera camera);
-        float FresnelRatio(const Intersection i, Ray incidentRay, vector<Shape *> shapes);
-        vec3 FresnelLight(const Intersection i, Ray incidentRay, vector<Shape *> shapes, Camera camera);
+        vec3 totalLight(Intersection closestIntersection, Scene& scene, Camera camera);
+        vec3 RefractedLight(const Intersection i, Ray incidentRay, Scene& scene, const int rayDepth, int depth, vec3 hitColour, Camera camera);
+        vec3 ReflectedLight(const Intersection i, Ray incidentRay ,Scene& scene, const int rayDepth, int depth, vec3 hitColour, Camera camera);
+        float FresnelRatio(const Intersection i, Ray incidentRay, Scene& scene);
+        vec3 FresnelLight(const Intersection i, Ray incidentRay, Scene& scene, Camera camera);
 
         // Movement methods
         void translateLeft(float distance);
@@ -52,6 +57,7 @@ class Light {
         vec3 getSpecular();
         vec4 getPosition();
         float getPower();
+        int getShadowCacheSlot();
 
         // Setters
         void setAmbient(vec3 ambient);
@@ -59,6 +65,7 @@ class Light {
         void setSpecular(vec3 specular);
         void setPosition(vec4 position);
         void setPower(float power);
+        void setShadowCacheSlot(int shadowCacheSlot);
 
 };
 #endif
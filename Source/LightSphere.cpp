@@ -2,15 +2,15 @@
 #include "Light.h"
 #include <iostream>
 
-LightSphere::LightSphere(vec4 centre, float radius, int numLights, vec3 s_amb, vec3 s_diff, vec3 s_spec, float power) {
+LightSphere::LightSphere(vec4 centre, float radius, int numSamples, vec3 s_amb, vec3 s_diff, vec3 s_spec, float power) {
     setCentre(centre);
     setRadius(radius);
     setAmbient(s_amb);
     setDiffuse(s_diff);
     setSpecular(s_spec);
     setPower(power);
-    setPointLights(sphereSample(numLights));
-
+    setNumSamples(numSamples);
+    setShadowCacheSlot(0);
 }
 
 //Returns whether a point p is contained in a sphere with centre c and radius r
@@ -18,110 +18,101 @@ bool LightSphere::containedInSphere(vec4 p) {
     return glm::distance(p, centre) <= radius;
 }
 
-vec3 LightSphere::LightSphereLuminance(Intersection& intersection, Ray incidentRay, vector<Shape *> shapes, Camera& camera) {
+vec3 LightSphere::LightSphereLuminance(Intersection& intersection, Ray incidentRay, Scene& scene, Camera& camera) {
     vec3 colour(0,0,0);
-    float size = (float)this->pointLights.size();
-    for (int i = 0 ; i < this->pointLights.size() ; i++) {
-        Light l = this->pointLights[i];
-        vec3 l_light = l.FresnelLight(intersection, incidentRay, shapes, camera);
-        colour = vec3(colour.x + l_light.x, colour.y + l_light.y, colour.z + l_light.z);
-
+    for (int i = 0 ; i < numSamples ; i++) {
+        float u1 = (float) rand() / (RAND_MAX);
+        float u2 = (float) rand() / (RAND_MAX);
+        colour += SampleLuminance(intersection, incidentRay, scene, camera, u1, u2);
     }
-    vec3 final_colour(colour.x/size, colour.y/size, colour.z/size);
-    return final_colour;
-}
-
-//Takes n samples from a sphere with centre at c and radius r
-vector<Light> LightSphere::sphereSample(int n) {
-    vec4 c = centre;
-    vector<Light> samples;
-    for (int i = 0 ; i < n ; i++) {
-        bool contained = true;
-        // rejection sampling
-        while (contained) {
-            float randx = ((float) rand() / (RAND_MAX)) * radius - radius / 2;
-            float randy = ((float) rand() / (RAND_MAX)) * radius - radius / 2;
-            float randz = ((float) rand() / (RAND_MAX)) * radius - radius / 2;
-            vec4 p(c.x + randx, c.y + randy, c.z + randz, 1);
-            if (containedInSphere(p)) {
-                Light light(p, this->s_amb, this->s_diff, this->s_spec, this->power / (float) n);
-                samples.push_back(light);
-                contained = false;
-            }
+    return colour / (float) numSamples;
+}
+
+//The sphere has radiance power / (4 pi^2 r^2), giving out the same light as a
+//point light of its power at its centre. A sample with density pdf stands for
+//that radiance over 1 / pdf of solid angle, which a point light at distance d
+//gives if scaled by d^2 / (pi r^2 pdf)
+vec3 LightSphere::SampleLuminance(Intersection& intersection, Ray incidentRay, Scene& scene, Camera& camera, float u1, float u2) {
+    vec3 direction;
+    float distance;
+    float pdf;
+    if (!sampleDirection(intersection.position, u1, u2, direction, distance, pdf)) {
+        Light l(centre, this->s_amb, this->s_diff, this->s_spec, this->power);
+        l.setShadowCacheSlot(shadowCacheSlot);
+        return l.FresnelLight(intersection, incidentRay, scene, camera);
+    }
+
+    float scale = (distance * distance) / ((float) M_PI * radius * radius * pdf);
+    vec4 position = intersection.position + distance * vec4(direction, 0);
+    Light l(position, this->s_amb, scale * this->s_diff, scale * this->s_spec, this->power);
+    l.setShadowCacheSlot(shadowCacheSlot);
+    return l.FresnelLight(intersection, incidentRay, scene, camera);
+}
+
+bool LightSphere::sampleDirection(vec4 position, float u1, float u2, vec3& direction, float& distance, float& pdf) {
+    vec3 toCentre = vec3(centre - position);
+    float d = length(toCentre);
+    if (d <= radius) return false;
+
+    //Uniform over the cone, 1 - cos(theta) running linearly from 0 to 1 - cos(thetaMax)
+    vec3 w = toCentre / d;
+    float sinThetaMax2 = (radius * radius) / (d * d);
+    float cosThetaMax = sqrt(glm::max(0.0f, 1.0f - sinThetaMax2));
+    float cosTheta = 1.0f - u1 * (1.0f - cosThetaMax);
+    float sinTheta = sqrt(glm::max(0.0f, 1.0f - cosTheta * cosTheta));
+    float phi = 2.0f * (float) M_PI * u2;
+
+    vec3 u = normalize(cross(fabs(w.x) > 0.5f ? vec3(0, 1, 0) : vec3(1, 0, 0), w));
+    vec3 v = cross(w, u);
+    direction = sinTheta * cos(phi) * u + sinTheta * sin(phi) * v + cosTheta * w;
+
+    //Nearer root of |t direction - toCentre| = radius, clamped for grazing directions
+    float b = dot(direction, toCentre);
+    float discriminant = b * b - (d * d - radius * radius);
+    distance = b - sqrt(glm::max(0.0f, discriminant));
+    pdf = 1.0f / (2.0f * (float) M_PI * (1.0f - cosThetaMax));
+    return true;
+}
+
+//Takes a point uniformly from within the sphere by rejection sampling
+vec4 LightSphere::samplePoint() {
+    while (true) {
+        float randx = ((float) rand() / (RAND_MAX)) * 2 * radius - radius;
+        float randy = ((float) rand() / (RAND_MAX)) * 2 * radius - radius;
+        float randz = ((float) rand() / (RAND_MAX)) * 2 * radius - radius;
+        vec4 p(centre.x + randx, centre.y + randy, centre.z + randz, 1);
+        if (containedInSphere(p)) {
+            return p;
         }
     }
-    return samples;
 }
 
 // Movement
 void LightSphere::translateLeft(float distance) {
     setCentre(getCentre() - vec4(distance, 0, 0, 0));
-    vector<Light> newLights;
-    for (int i = 0 ; i < getPointLights().size() ; i++) {
-        Light l = getPointLights()[i];
-        l.translateLeft(distance);
-        newLights.push_back(l);
-    }
-    setPointLights(newLights);
 }
 
 void LightSphere::translateRight(float distance) {
-    setCentre(getCentre() - vec4(distance, 0, 0, 0));
-    vector<Light> newLights;
-    for (int i = 0 ; i < getPointLights().size() ; i++) {
-        Light l = getPointLights()[i];
-        l.translateRight(distance);
-        newLights.push_back(l);
-    }
-    setPointLights(newLights);
+    setCentre(getCentre() + vec4(distance, 0, 0, 0));
 }
 
 void LightSphere::translateForwards(float distance) {
-    setCentre(getCentre() - vec4(distance, 0, 0, 0));
-    vector<Light> newLights;
-    for (int i = 0 ; i < getPointLights().size() ; i++) {
-        Light l = getPointLights()[i];
-        l.translateForwards(distance);
-        newLights.push_back(l);
-    }
-    setPointLights(newLights);
+    setCentre(getCentre() + vec4(0, 0, distance, 0));
 }
+
 void LightSphere::translateBackwards(float distance) {
-    setCentre(getCentre() - vec4(distance, 0, 0, 0));
-    vector<Light> newLights;
-    for (int i = 0 ; i < getPointLights().size() ; i++) {
-        Light l = getPointLights()[i];
-        l.translateBackwards(distance);
-        newLights.push_back(l);
-    }
-    setPointLights(newLights);
+    setCentre(getCentre() - vec4(0, 0, distance, 0));
 }
+
 void LightSphere::translateUp(float distance) {
-    setCentre(getCentre() - vec4(distance, 0, 0, 0));
-    vector<Light> newLights;
-    for (int i = 0 ; i < getPointLights().size() ; i++) {
-        Light l = getPointLights()[i];
-        l.translateUp(distance);
-        newLights.push_back(l);
-    }
-    setPointLights(newLights);
+    setCentre(getCentre() + vec4(0, distance, 0, 0));
 }
+
 void LightSphere::translateDown(float distance) {
-    setCentre(getCentre() - vec4(distance, 0, 0, 0));
-    vector<Light> newLights;
-    for (int i = 0 ; i < getPointLights().size() ; i++) {
-        Light l = getPointLights()[i];
-        l.translateDown(distance);
-        newLights.push_back(l);
-    }
-    setPointLights(newLights);
+    setCentre(getCentre() - vec4(0, distance, 0, 0));
 }
 
 // Getters
-vector<Light> LightSphere::getPointLights() {
-    return pointLights;
-}
-
 vec4 LightSphere::getCentre() {
     return centre;
 }
@@ -146,11 +137,15 @@ float LightSphere::getPower() {
     return power;
 }
 
-// Setters
-void LightSphere::setPointLights(vector<Light> pointLights) {
-    this->pointLights = pointLights;
+int LightSphere::getNumSamples() {
+    return numSamples;
 }
 
+int LightSphere::getShadowCacheSlot() {
+    return shadowCacheSlot;
+}
+
+// Setters
 void LightSphere::setCentre(vec4 centre) {
     this->centre = centre;
 }
@@ -174,3 +169,11 @@ void LightSphere::setSpecular(vec3 specular) {
 void LightSphere::setPower(float power) {
     this->power = power;
 }
+
+void LightSphere::setNumSamples(int numSamples) {
+    this->numSamples = numSamples;
+}
+
+void LightSphere::setShadowCacheSlot(int shadowCacheSlot) {
+    this->shadowCacheSlot = shadowCacheSlot;
+}
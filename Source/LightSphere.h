@@ -8,6 +8,7 @@
 #include "Ray.h"
 
 class Light;
+class Scene;
 
 using namespace std;
 using glm::vec3;
@@ -18,7 +19,6 @@ using glm::mat4;
 class LightSphere {
 
     private:
-        vector<Light> pointLights;
         vec4 centre;
         float radius;
         vec3 s_amb;
@@ -26,17 +26,35 @@ class LightSphere {
         vec3 s_spec;
         float power;
 
+        // Light samples taken per shading point
+        int numSamples;
+
+        // Occluder cache slot its samples' shadow rays share
+        int shadowCacheSlot;
+
     public:
         // Constructor
-        LightSphere(vec4 centre, float radius, int numLights, vec3 s_amb, vec3 s_diff, vec3 s_spec, float power);
+        LightSphere(vec4 centre, float radius, int numSamples, vec3 s_amb, vec3 s_diff, vec3 s_spec, float power);
 
-        // Generate the point lights to go in the sphere
-        vector<Light> sphereSample(int n);
+        // A random point in the sphere, as photons are emitted from
+        vec4 samplePoint();
+
+        // Samples a direction from position towards the sphere, uniformly over
+        // the cone of directions it covers. distance is how far along it the
+        // sphere's surface lies and pdf the density per solid angle. Returns
+        // false if position is inside the sphere
+        bool sampleDirection(vec4 position, float u1, float u2, vec3& direction, float& distance, float& pdf);
 
         // Test whether a point is in a sphere or not
         bool containedInSphere(vec4 p);
 
-        vec3 LightSphereLuminance(Intersection& intersection, Ray incidentRay, vector<Shape *> shapes, Camera& camera);
+        // Light reaching the intersection from numSamples directions sampled
+        // by solid angle, each shaded as a point light on the sphere
+        vec3 LightSphereLuminance(Intersection& intersection, Ray incidentRay, Scene& scene, Camera& camera);
+
+        // One of those samples, taken in the direction u1 and u2 give
+        // sampleDirection. From inside the sphere, its centre is used
+        vec3 SampleLuminance(Intersection& intersection, Ray incidentRay, Scene& scene, Camera& camera, float u1, float u2);
 
         // Movement
         void translateLeft(float distance);
@@ -47,21 +65,23 @@ class LightSphere {
         void translateDown(float distance);
 
         // Getters
-        vector<Light> getPointLights();
         vec4 getCentre();
         float getRadius();
         vec3 getAmbient();
         vec3 getDiffuse();
         vec3 getSpecular();
         float getPower();
+        int getNumSamples();
+        int getShadowCacheSlot();
 
         // Setters
-        void setPointLights(vector<Light> pointLights);
         void setCentre(vec4 centre);
         void setRadius(float radius);
         void setAmbient(vec3 ambient);
         void setDiffuse(vec3 diffuse);
         void setSpecular(vec3 specular);
         void setPower(float power);
+        void setNumSamples(int numSamples);
+        void setShadowCacheSlot(int shadowCacheSlot);
 };
 #endif
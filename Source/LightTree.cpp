@@ -0,0 +1,169 @@
+#include "LightTree.h"
+#include "Scene.h"
+
+#include <algorithm>
+
+// CONSTRUCTOR
+LightTree::LightTree() {
+}
+
+LightTree::LightTree(vector<LightSphere> lights) {
+    this->lights = lights;
+    vector<float> powers;
+    for (int i = 0 ; i < lights.size() ; i++) {
+        //Each light keeps its own last blocker
+        this->lights[i].setShadowCacheSlot(i);
+        lightIndices.push_back(i);
+        powers.push_back(LightPower(lights[i]));
+    }
+    emitters = AliasTable(powers);
+    if (lights.empty()) return;
+
+    //A binary tree with one light per leaf has 2n - 1 nodes
+    nodes.reserve(2 * lights.size() - 1);
+    LightNode root;
+    root.leftFirst = 0;
+    root.count = lights.size();
+    nodes.push_back(root);
+    Subdivide(0);
+}
+
+float LightTree::LightPower(LightSphere& light) {
+    vec3 diffuse = light.getDiffuse();
+    return light.getPower() * (diffuse.x + diffuse.y + diffuse.z) / 3.0f;
+}
+
+//Fills in the node's bounds and power from its lights, then
+//splits them at the median centroid along the longest axis until each leaf
+//holds one light
+void LightTree::Subdivide(int nodeIndex) {
+    int first = nodes[nodeIndex].leftFirst;
+    int count = nodes[nodeIndex].count;
+
+    AABB bounds;
+    AABB centroidBounds;
+    float power = 0;
+    for (int i = first ; i < first + count ; i++) {
+        LightSphere& light = lights[lightIndices[i]];
+        vec3 centre = vec3(light.getCentre());
+        bounds.grow(AABB(centre - vec3(light.getRadius()), centre + vec3(light.getRadius())));
+        centroidBounds.grow(centre);
+        power += LightPower(light);
+    }
+    nodes[nodeIndex].bounds = bounds;
+    nodes[nodeIndex].power = power;
+    if (count == 1) return;
+
+    vec3 extent = centroidBounds.upper - centroidBounds.lower;
+    int splitAxis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+    int middle = first + count / 2;
+    nth_element(lightIndices.begin() + first, lightIndices.begin() + middle, lightIndices.begin() + first + count, [&](int a, int b) {
+        return lights[a].getCentre()[splitAxis] < lights[b].getCentre()[splitAxis];
+    });
+
+    int left = nodes.size();
+    LightNode child;
+    child.leftFirst = first;
+    child.count = middle - first;
+    nodes.push_back(child);
+    child.leftFirst = middle;
+    child.count = first + count - middle;
+    nodes.push_back(child);
+    nodes[nodeIndex].leftFirst = left;
+    nodes[nodeIndex].count = 0;
+
+    Subdivide(left);
+    Subdivide(left + 1);
+}
+
+//After Conty Estevez and Kulla's importance: the node's power over the
+//squared distance to it, scaled by the cosine at the surface once its angle
+//is reduced by the angle the node's bounds subtend. Sphere lights shine every
+//way, so there is no cosine at the lights. Inside the bounds nothing is ruled
+//out
+float LightTree::Importance(const LightNode& node, const vec3& position, const vec3& normal) {
+    vec3 toNode = node.bounds.centroid() - position;
+    float radius = 0.5f * length(node.bounds.upper - node.bounds.lower);
+    float d2 = glm::max(dot(toNode, toNode), radius * radius);
+    float d = sqrt(d2);
+    vec3 dir = toNode / d;
+    float thetaU = asin(glm::min(radius / d, 1.0f));
+
+    float receiver = 1.0f;
+    if (normal != vec3(0)) {
+        float thetaI = acos(glm::clamp(dot(normal, dir), -1.0f, 1.0f));
+        float reduced = glm::max(0.0f, thetaI - thetaU);
+        if (reduced >= (float) M_PI / 2) return 0.0f;
+        receiver = cos(reduced);
+    }
+
+    return node.power * receiver / d2;
+}
+
+int LightTree::SampleLight(vec4 position, vec3 normal, float u, float& pmf) {
+    pmf = 0;
+    if (nodes.empty()) return -1;
+
+    vec3 p = vec3(position);
+    float probability = 1.0f;
+    int nodeIndex = 0;
+    while (nodes[nodeIndex].count == 0) {
+        int left = nodes[nodeIndex].leftFirst;
+        float leftImportance = Importance(nodes[left], p, normal);
+        float rightImportance = Importance(nodes[left + 1], p, normal);
+        if (leftImportance + rightImportance <= 0) return -1;
+
+        //Reuse u for the next choice down by rescaling the part left of it
+        float pLeft = leftImportance / (leftImportance + rightImportance);
+        if (u < pLeft) {
+            u = u / pLeft;
+            probability *= pLeft;
+            nodeIndex = left;
+        } else {
+            u = (u - pLeft) / (1.0f - pLeft);
+            probability *= 1.0f - pLeft;
+            nodeIndex = left + 1;
+        }
+        u = glm::min(u, 0.99999994f);
+    }
+    pmf = probability;
+    return lightIndices[nodes[nodeIndex].leftFirst];
+}
+
+int LightTree::SampleEmitter(float u, float& pmf) {
+    return emitters.Sample(u, pmf);
+}
+
+vec3 LightTree::Luminance(Intersection& intersection, Ray incidentRay, Scene& scene, Camera& camera, int numSamples) {
+    //Only diffuse surfaces are lit from the front alone
+    Material& material = scene.getMaterial(intersection.index);
+    vec3 normal = material.isReflective() || material.isTransparent() ? vec3(0) : vec3(intersection.normal);
+
+    vec3 colour(0,0,0);
+    for (int i = 0 ; i < numSamples ; i++) {
+        float pmf;
+        int light = SampleLight(intersection.position, normal, (float) rand() / ((float) RAND_MAX + 1), pmf);
+        if (light < 0) continue;
+        float u1 = (float) rand() / (RAND_MAX);
+        float u2 = (float) rand() / (RAND_MAX);
+        colour += lights[light].SampleLuminance(intersection, incidentRay, scene, camera, u1, u2) / pmf;
+    }
+    return colour / (float) numSamples;
+}
+
+// GETTERS
+int LightTree::getNumLights() {
+    return lights.size();
+}
+
+LightSphere& LightTree::getLight(int light) {
+    return lights[light];
+}
+
+float LightTree::getTotalPower() {
+    return emitters.getTotal();
+}
+
+vector<LightNode>& LightTree::getNodes() {
+    return nodes;
+}
@@ -0,0 +1,74 @@
+#ifndef LIGHT_TREE_H
+#define LIGHT_TREE_H
+
+#include <glm/glm.hpp>
+#include <vector>
+#include "AABB.h"
+#include "LightSphere.h"
+#include "AliasTable.h"
+
+using namespace std;
+using glm::vec3;
+using glm::mat3;
+using glm::vec4;
+using glm::mat4;
+
+// A node is a leaf if count > 0, in which case its light is
+// lights[lightIndices[leftFirst]]. Otherwise its children are nodes[leftFirst]
+// and nodes[leftFirst + 1]
+struct LightNode {
+    AABB bounds;
+    // Summed power of the lights below
+    float power;
+    int leftFirst;
+    int count;
+};
+
+// Light hierarchy over many sphere lights. Shading points pick a light by
+// walking down it, choosing each child by how much light it could give the
+// point (power over distance squared, bounded by the surface's orientation),
+// so the cost grows with the depth of the tree rather than the number of
+// lights. Sphere lights emit in every direction, so the nodes keep no cone of
+// emitted directions. Photons pick their light from an alias table over the
+// lights' power
+class LightTree {
+
+    private:
+        vector<LightSphere> lights;
+        vector<LightNode> nodes;
+        vector<int> lightIndices;
+
+        // Lights by power, for photons
+        AliasTable emitters;
+
+        void Subdivide(int nodeIndex);
+        static float Importance(const LightNode& node, const vec3& position, const vec3& normal);
+
+    public:
+        // CONSTRUCTOR
+        LightTree();
+        LightTree(vector<LightSphere> lights);
+
+        // Power a light is weighted by, for photons and shading points alike
+        static float LightPower(LightSphere& light);
+
+        // Picks a light to shade position from, with u uniform in [0, 1). A
+        // zero normal leaves the surface's orientation out. pmf is the chance
+        // of the light being picked. Returns -1 if no light can reach the point
+        int SampleLight(vec4 position, vec3 normal, float u, float& pmf);
+
+        // Picks the light to emit a photon from in proportion to power
+        int SampleEmitter(float u, float& pmf);
+
+        // Light reaching the intersection from numSamples lights picked from
+        // the tree, each shaded with one solid angle sample
+        vec3 Luminance(Intersection& intersection, Ray incidentRay, Scene& scene, Camera& camera, int numSamples);
+
+        // GETTERS
+        int getNumLights();
+        LightSphere& getLight(int light);
+        float getTotalPower();
+        vector<LightNode>& getNodes();
+};
+
+#endif
@@ -26,7 +26,7 @@ vec3 specularColour = 1.0f * vec3(1, 1, 0.9);
 float power = 30.0f;
 
 float r = 0.05f;
-LightSphere ls(vec4(0, -0.4, -0.9, 1.0), r, 50, ambientColour, diffuseColour, specularColour, power);
+LightSphere ls(vec4(0, -0.4, -0.9, 1.0), r, 4, ambientColour, diffuseColour, specularColour, power);
    
 //LightSphere ls(vec4(-0.9, -0.9, 0.9, 1.0), r, 1, ambientColour, diffuseColour, specularColour, power);
 
@@ -19,6 +19,13 @@ Material::Material(vec3 m_amb, vec3 m_diff, vec3 m_spec, vec3 m_emi, float coef_
 
 }
 
+bool Material::equals(const Material& other) const {
+    return m_amb == other.m_amb && m_diff == other.m_diff && m_spec == other.m_spec && m_emi == other.m_emi
+        && coef_spec == other.coef_spec && coef_diff == other.coef_diff && coef_trans == other.coef_trans
+        && shininess == other.shininess && reflective == other.reflective && reflectRatio == other.reflectRatio
+        && transparent == other.transparent && refractiveIndex == other.refractiveIndex;
+}
+
 // Getters
 vec3 Material::getAmbient() {
     return m_amb;
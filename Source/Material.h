@@ -32,6 +32,9 @@ class Material {
         // Constructor
         Material(vec3 m_amb, vec3 m_diff, vec3 m_spec, vec3 m_emi, float coef_spec, float coef_diff, float coef_trans, float shininess, bool reflective, float reflectRatio, float refractiveIndex, bool transparent);
 
+        // True if every property matches, used to share materials between shapes
+        bool equals(const Material& other) const;
+
         // Getters
         vec3 getAmbient();
         vec3 getDiffuse();
@@ -0,0 +1,345 @@
+#include "Mesh.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstdint>
+#include <cstring>
+#include <cstdlib>
+#include <climits>
+
+// CONSTRUCTOR
+Mesh::Mesh(Material material) {
+    materials.push_back(material);
+}
+
+bool Mesh::Load(string path) {
+    map<string, Material> namedMaterials;
+    return Load(path, namedMaterials);
+}
+
+bool Mesh::Load(string path, map<string, Material>& namedMaterials) {
+    vertices.clear();
+    indices.clear();
+    faceMaterials.clear();
+    materials.erase(materials.begin() + 1, materials.end());
+
+    string extension = path.substr(path.find_last_of('.') + 1);
+    for (int i = 0 ; i < extension.size() ; i++) {
+        extension[i] = tolower(extension[i]);
+    }
+    bool loaded = false;
+    if (extension == "obj") {
+        loaded = LoadOBJ(path, namedMaterials);
+    } else if (extension == "ply") {
+        loaded = LoadPLY(path);
+    } else {
+        cout << "Mesh: unsupported file type " << path << endl;
+    }
+    if (loaded) {
+        cout << "Loaded " << path << ": " << getNumVertices() << " vertices, " << getNumFaces() << " faces" << endl;
+    } else {
+        //Drop whatever was read before the file went wrong
+        vertices.clear();
+        indices.clear();
+        faceMaterials.clear();
+        materials.erase(materials.begin() + 1, materials.end());
+    }
+    return loaded;
+}
+
+bool Mesh::LoadOBJ(string path, map<string, Material>& namedMaterials) {
+    ifstream file(path);
+    if (!file) {
+        cout << "Mesh: could not open " << path << endl;
+        return false;
+    }
+
+    map<string, int> materialIds;
+    int material = 0;
+    int lineNumber = 0;
+    string line;
+    while (getline(file, line)) {
+        lineNumber++;
+        istringstream in(line);
+        string keyword;
+        in >> keyword;
+
+        if (keyword == "v") {
+            vec3 v;
+            in >> v.x >> v.y >> v.z;
+            if (in.fail()) {
+                cout << "Mesh: " << path << " line " << lineNumber << " is not a vertex" << endl;
+                return false;
+            }
+            AddVertex(v);
+        }
+        else if (keyword == "usemtl") {
+            string name;
+            in >> name;
+            map<string, Material>::iterator named = namedMaterials.find(name);
+            if (named == namedMaterials.end()) {
+                material = 0;
+            } else {
+                if (materialIds.find(name) == materialIds.end()) {
+                    materialIds[name] = AddMaterial(named->second);
+                }
+                material = materialIds[name];
+            }
+        }
+        else if (keyword == "f") {
+            //Vertices are written v, v/vt, v//vn or v/vt/vn, and negative
+            //indices count back from the latest vertex
+            vector<int> polygon;
+            string token;
+            while (in >> token) {
+                char * end;
+                long index = strtol(token.c_str(), &end, 10);
+                long vertex = index < 0 ? (long)vertices.size() + index : index - 1;
+                if (end == token.c_str() || vertex < 0 || vertex >= (long)vertices.size()) {
+                    cout << "Mesh: " << path << " line " << lineNumber << " refers to a vertex that is not in the file" << endl;
+                    return false;
+                }
+                polygon.push_back(vertex);
+            }
+            //Files wind faces anticlockwise about the outward normal, the
+            //opposite of Triangle, so each fan triangle is reversed
+            for (int i = 1 ; i + 1 < polygon.size() ; i++) {
+                AddFace(polygon[0], polygon[i + 1], polygon[i], material);
+            }
+        }
+    }
+    return true;
+}
+
+// Reads one PLY property value of the given type, as text or as binary little
+// endian, and returns it as a double
+static double ReadPLYValue(istream& in, const string& type, bool binary) {
+    if (!binary) {
+        double value;
+        in >> value;
+        return value;
+    }
+    if (type == "char" || type == "int8") { int8_t v; in.read((char *)&v, 1); return v; }
+    if (type == "uchar" || type == "uint8") { uint8_t v; in.read((char *)&v, 1); return v; }
+    if (type == "short" || type == "int16") { int16_t v; in.read((char *)&v, 2); return v; }
+    if (type == "ushort" || type == "uint16") { uint16_t v; in.read((char *)&v, 2); return v; }
+    if (type == "int" || type == "int32") { int32_t v; in.read((char *)&v, 4); return v; }
+    if (type == "uint" || type == "uint32") { uint32_t v; in.read((char *)&v, 4); return v; }
+    if (type == "float" || type == "float32") { float v; in.read((char *)&v, 4); return v; }
+    double v;
+    in.read((char *)&v, 8);
+    return v;
+}
+
+// One property of a PLY element. Lists have a count type and an item type
+struct PLYProperty {
+    string name;
+    string type;
+    bool isList;
+    string countType;
+};
+
+bool Mesh::LoadPLY(string path) {
+    ifstream file(path, ios::binary);
+    if (!file) {
+        cout << "Mesh: could not open " << path << endl;
+        return false;
+    }
+
+    //Header: the format, then each element with its count and properties
+    string line;
+    getline(file, line);
+    if (line.compare(0, 3, "ply") != 0) {
+        cout << "Mesh: " << path << " is not a PLY file" << endl;
+        return false;
+    }
+    bool binary = false;
+    vector<string> elementNames;
+    vector<long> elementCounts;
+    vector<vector<PLYProperty> > elementProperties;
+    while (getline(file, line)) {
+        istringstream in(line);
+        string keyword;
+        in >> keyword;
+        if (keyword == "format") {
+            string format;
+            in >> format;
+            if (format == "binary_little_endian") {
+                binary = true;
+            } else if (format != "ascii") {
+                cout << "Mesh: unsupported PLY format " << format << endl;
+                return false;
+            }
+        }
+        else if (keyword == "element") {
+            string name;
+            long count;
+            in >> name >> count;
+            if (in.fail() || count < 0) {
+                cout << "Mesh: " << path << " has a bad element count: " << line << endl;
+                return false;
+            }
+            elementNames.push_back(name);
+            elementCounts.push_back(count);
+            elementProperties.push_back(vector<PLYProperty>());
+        }
+        else if (keyword == "property" && !elementProperties.empty()) {
+            PLYProperty property;
+            in >> property.type;
+            property.isList = property.type == "list";
+            if (property.isList) {
+                in >> property.countType >> property.type;
+            }
+            in >> property.name;
+            elementProperties.back().push_back(property);
+        }
+        else if (keyword == "end_header") {
+            break;
+        }
+    }
+
+    //Every element and list item takes at least a byte, so no count can be
+    //larger than what is left of the file
+    streampos dataStart = file.tellg();
+    file.seekg(0, ios::end);
+    long dataSize = file.tellg() - dataStart;
+    file.seekg(dataStart);
+    for (int e = 0 ; e < elementNames.size() ; e++) {
+        if (elementCounts[e] > dataSize) {
+            cout << "Mesh: " << path << " claims " << elementCounts[e] << " " << elementNames[e] << " elements in " << dataSize << " bytes" << endl;
+            return false;
+        }
+    }
+
+    for (int e = 0 ; e < elementNames.size() ; e++) {
+        vector<PLYProperty>& properties = elementProperties[e];
+        for (long i = 0 ; i < elementCounts[e] ; i++) {
+            vec3 vertex(0.0f);
+            vector<int> polygon;
+            for (int p = 0 ; p < properties.size() ; p++) {
+                if (properties[p].isList) {
+                    double count = ReadPLYValue(file, properties[p].countType, binary);
+                    if (!file || count < 0 || count > dataSize) {
+                        cout << "Mesh: " << path << " has a bad list count in " << elementNames[e] << " " << i << endl;
+                        return false;
+                    }
+                    vector<int> list;
+                    for (int k = 0 ; k < count ; k++) {
+                        //Anything out of int's range cannot be a vertex index
+                        double item = ReadPLYValue(file, properties[p].type, binary);
+                        list.push_back(item < 0 || item > INT_MAX ? -1 : (int)item);
+                    }
+                    if (properties[p].name == "vertex_indices" || properties[p].name == "vertex_index") {
+                        polygon = list;
+                    }
+                } else {
+                    double value = ReadPLYValue(file, properties[p].type, binary);
+                    if (properties[p].name == "x") vertex.x = value;
+                    if (properties[p].name == "y") vertex.y = value;
+                    if (properties[p].name == "z") vertex.z = value;
+                }
+            }
+            if (!file) {
+                cout << "Mesh: " << path << " ended early" << endl;
+                return false;
+            }
+            if (elementNames[e] == "vertex") {
+                AddVertex(vertex);
+            } else if (elementNames[e] == "face") {
+                for (int k = 0 ; k < polygon.size() ; k++) {
+                    if (polygon[k] < 0 || polygon[k] >= vertices.size()) {
+                        cout << "Mesh: " << path << " face " << i << " refers to a vertex that is not in the file" << endl;
+                        return false;
+                    }
+                }
+                //Reversed as for OBJ faces
+                for (int k = 1 ; k + 1 < polygon.size() ; k++) {
+                    AddFace(polygon[0], polygon[k + 1], polygon[k]);
+                }
+            }
+        }
+    }
+    return true;
+}
+
+int Mesh::AddVertex(vec3 vertex) {
+    vertices.push_back(vertex);
+    return vertices.size() - 1;
+}
+
+int Mesh::AddMaterial(Material material) {
+    materials.push_back(material);
+    return materials.size() - 1;
+}
+
+void Mesh::AddFace(int i0, int i1, int i2, int material) {
+    indices.push_back(i0);
+    indices.push_back(i1);
+    indices.push_back(i2);
+    //Only store per face ids once a face uses something other than the default
+    if (material != 0 || !faceMaterials.empty()) {
+        faceMaterials.resize(getNumFaces() - 1, 0);
+        faceMaterials.push_back(material);
+    }
+}
+
+void Mesh::Transform(mat4 M) {
+    for (int i = 0 ; i < vertices.size() ; i++) {
+        vertices[i] = vec3(M * vec4(vertices[i], 1));
+    }
+    if (determinant(mat3(M)) < 0) {
+        for (int f = 0 ; f < getNumFaces() ; f++) {
+            swap(indices[3 * f + 1], indices[3 * f + 2]);
+        }
+    }
+}
+
+void Mesh::FitToBox(AABB box) {
+    AABB bounds;
+    for (int i = 0 ; i < vertices.size() ; i++) {
+        bounds.grow(vertices[i]);
+    }
+    vec3 extent = bounds.upper - bounds.lower;
+    vec3 target = box.upper - box.lower;
+    float scale = numeric_limits<float>::max();
+    for (int a = 0 ; a < 3 ; a++) {
+        if (extent[a] > 0) scale = glm::min(scale, target[a] / extent[a]);
+    }
+    if (scale == numeric_limits<float>::max()) scale = 1.0f;
+
+    for (int i = 0 ; i < vertices.size() ; i++) {
+        vertices[i] = box.centroid() + (vertices[i] - bounds.centroid()) * scale;
+    }
+}
+
+size_t Mesh::getMemoryUsage() {
+    return vertices.size() * sizeof(vec3) + indices.size() * sizeof(int) + faceMaterials.size() * sizeof(int);
+}
+
+// GETTERS
+int Mesh::getNumFaces() {
+    return indices.size() / 3;
+}
+
+int Mesh::getNumVertices() {
+    return vertices.size();
+}
+
+void Mesh::getFace(int face, vec3& v0, vec3& v1, vec3& v2) {
+    v0 = vertices[indices[3 * face]];
+    v1 = vertices[indices[3 * face + 1]];
+    v2 = vertices[indices[3 * face + 2]];
+}
+
+int Mesh::getNumMaterials() {
+    return materials.size();
+}
+
+Material& Mesh::getMaterial(int material) {
+    return materials[material];
+}
+
+int Mesh::getFaceMaterial(int face) {
+    return faceMaterials.empty() ? 0 : faceMaterials[face];
+}
@@ -0,0 +1,70 @@
+#ifndef MESH_H
+#define MESH_H
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <string>
+#include <map>
+#include "Material.h"
+#include "AABB.h"
+
+using namespace std;
+using glm::vec3;
+using glm::mat3;
+using glm::vec4;
+using glm::mat4;
+
+// Indexed triangle mesh: vertices are shared between faces and each face
+// stores three vertex indices and a material id. Faces are wound so that
+// normalize(cross(v2 - v0, v1 - v0)) is the outward normal, as for Triangle
+class Mesh {
+
+    private:
+        vector<vec3> vertices;
+        vector<int> indices;
+        vector<Material> materials;
+        // Empty while every face uses materials[0]
+        vector<int> faceMaterials;
+
+        bool LoadOBJ(string path, map<string, Material>& namedMaterials);
+        bool LoadPLY(string path);
+
+    public:
+        // CONSTRUCTOR
+        // Faces use the given material unless the file names their own
+        Mesh(Material material);
+
+        // Loads a Wavefront OBJ or PLY (ascii or binary little endian) file,
+        // replacing the mesh's faces. Polygons are split into fans of
+        // triangles. OBJ usemtl names are looked up in namedMaterials, falling
+        // back to the mesh's default material. Returns false, leaving the mesh
+        // empty, if the file could not be read or is malformed, as when a face
+        // refers to a vertex the file does not have or a PLY count is negative
+        // or larger than the file
+        bool Load(string path);
+        bool Load(string path, map<string, Material>& namedMaterials);
+
+        int AddVertex(vec3 vertex);
+        int AddMaterial(Material material);
+        void AddFace(int i0, int i1, int i2, int material = 0);
+
+        // Applies M to every vertex. Mirroring transforms flip the faces'
+        // winding so normals stay outward
+        void Transform(mat4 M);
+
+        // Uniformly scales and centres the mesh to fit inside the box
+        void FitToBox(AABB box);
+
+        // Bytes held by the vertex, index and material id buffers
+        size_t getMemoryUsage();
+
+        // GETTERS
+        int getNumFaces();
+        int getNumVertices();
+        void getFace(int face, vec3& v0, vec3& v1, vec3& v2);
+        int getNumMaterials();
+        Material& getMaterial(int material);
+        int getFaceMaterial(int face);
+};
+
+#endif
@@ -1,5 +1,6 @@
 #include "Photon.h"
 #include "Shape.h"
+#include "Scene.h"
 
 #include <iostream>
 
@@ -23,6 +24,11 @@ bool Photon::closestIntersection(vector<Shape *> shapes, Intersection& closestIn
     return returnVal;
 }
 
+//Finds the closest intersection for a photon using the scene's BVH
+bool Photon::closestIntersection(Scene& scene, Intersection& closestIntersection) {
+    return scene.closestIntersection(getPosition(), getDirection(), closestIntersection);
+}
+
 //Generate random photon direction
 vec4 Photon::GeneratePhotonDirection(){
     float r = 1.0f;
@@ -46,12 +52,18 @@ vec4 Photon::GeneratePhotonDirection(){
 }
 
 //Trace a photon in the 3D world using the Russian Roullette system
-void Photon::TracePhoton(vector<Photon> & globalTraced,  vector<Shape *> shapes){
+void Photon::TracePhoton(vector<Photon> & globalTraced,  Scene& scene){
+    TracePhoton(globalTraced, nullptr, scene);
+}
+
+void Photon::TracePhoton(vector<Photon> & globalTraced, vector<Photon> * shadowTraced, Scene& scene){
     //The list of Photon data for the traced photon
     bool hadSpecularRef = false;
+    bool direct = true;
+    bool specularPath = true;
     while(true) {
         Intersection i;
-        while(!closestIntersection(shapes, i)){
+        while(!closestIntersection(scene, i)){
             //Resample
             setDirection(GeneratePhotonDirection());
         }
@@ -59,7 +71,7 @@ void Photon::TracePhoton(vector<Photon> & globalTraced,  vector<Shape *> shapes)
         // Update the position of the photon
         setPosition(i.position);
 
-        Material mat = shapes[i.index]->getMaterial();
+        Material& mat = scene.getMaterial(i.index);
 
         float dr = mat.getDiffuse()[0] * mat.getCoefDiff();
         float dg = mat.getDiffuse()[1] * mat.getCoefDiff();
@@ -91,7 +103,8 @@ void Photon::TracePhoton(vector<Photon> & globalTraced,  vector<Shape *> shapes)
         // Add the photon to the trace if the material is not fully reflective
         // or transparent
         if (mat.getReflectRatio() < randVar && !mat.isTransparent()) {
-            Photon p(getPosition(), getDirection(), getPower(), getFlag());
+            short flag = direct ? PHOTON_DIRECT : (specularPath ? PHOTON_CAUSTIC : PHOTON_INDIRECT);
+            Photon p(getPosition(), getDirection(), getPower(), flag);
             if (hadSpecularRef) {
                 #pragma omp critical
                 {
@@ -106,8 +119,16 @@ void Photon::TracePhoton(vector<Photon> & globalTraced,  vector<Shape *> shapes)
             }
         }
 
+        //Light passes through transparent shapes, so only opaque ones cast
+        //shadow photons
+        if (direct && shadowTraced && !mat.isTransparent()) {
+            TraceShadowPhotons(*shadowTraced, scene);
+        }
+        direct = false;
+
         if (randVar <= pd) {
             // Diffuse reflection
+            specularPath = false;
             setDirection(ReflectPhoton(getPosition(), i.normal));
             setPower(getPower() * (vec3(dr,dg,db) / pd));
         } else if (randVar > pd && randVar <= ps + pd) {
@@ -118,7 +139,7 @@ void Photon::TracePhoton(vector<Photon> & globalTraced,  vector<Shape *> shapes)
         } else if (randVar > pd + ps && randVar <= ps + pd + pt) {
             // Transmission
             hadSpecularRef = true;
-            setDirection(RefractPhoton(i, shapes));
+            setDirection(RefractPhoton(i, scene));
             setPower(getPower() * (vec3(tr,tg,tb) / pt));
         } else if (randVar > ps + pd + pt && randVar <= 1) {
             // Absorption
@@ -128,6 +149,23 @@ void Photon::TracePhoton(vector<Photon> & globalTraced,  vector<Shape *> shapes)
     }
 }
 
+//Carries on along the photon's path through the surface it has just hit,
+//marking each opaque surface behind it with a shadow photon. Takes no random
+//numbers, so the photons traced afterwards are the same with or without it
+void Photon::TraceShadowPhotons(vector<Photon> & shadowTraced, Scene& scene){
+    vec4 position = getPosition();
+    Intersection i;
+    while (scene.closestIntersection(position + 0.0001f * getDirection(), getDirection(), i)) {
+        position = i.position;
+        if (scene.getMaterial(i.index).isTransparent()) continue;
+        Photon p(position, getDirection(), vec3(0), PHOTON_SHADOW);
+        #pragma omp critical
+        {
+            shadowTraced.push_back(p);
+        }
+    }
+}
+
 //Reflect a photon
 vec4 Photon::ReflectPhoton(const vec4 position, const vec4 normal) {
     vec3 normal3 = vec3(normal.x, normal.y, normal.z);
@@ -139,10 +177,10 @@ vec4 Photon::ReflectPhoton(const vec4 position, const vec4 normal) {
 }
 
 //Refract a photon
-vec4 Photon::RefractPhoton(const Intersection i, vector<Shape *> shapes){
+vec4 Photon::RefractPhoton(const Intersection i, Scene& scene){
 
-    //Get the shape and its normal
-    Shape *  shape = shapes[i.index];
+    //Get the material and normal
+    Material& material = scene.getMaterial(i.index);
     vec4 dir4 = getDirection();
     vec4 N4 = i.normal;
 
@@ -151,7 +189,7 @@ vec4 Photon::RefractPhoton(const Intersection i, vector<Shape *> shapes){
 
     //Find and define the refractive indices
     float etai = 1.0f;
-    float etat = shape->getMaterial().getRefractiveIndex();
+    float etat = material.getRefractiveIndex();
 
     vec3 transmittedPhotonDir = vec3(0.0f,0.0f,0.0f);
 
@@ -189,10 +227,10 @@ vec4 Photon::RefractPhoton(const Intersection i, vector<Shape *> shapes){
     return transmittedPhotonDir4;
 }
 
-vec3 Photon::DirectLight(Intersection i, vector<Shape *> shapes) {
+vec3 Photon::DirectLight(Intersection i, Scene& scene) {
     vec3 photonDir = vec3(getDirection());
     vec3 norm = vec3(i.normal);
-    vec3 colour = shapes[i.index]->getMaterial().getDiffuse();
+    vec3 colour = scene.getMaterial(i.index).getDiffuse();
     float scalar = max(dot(-photonDir, norm), 0.0f);
     return colour * scalar;
 }
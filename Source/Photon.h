@@ -11,7 +11,17 @@ using glm::mat3;
 using glm::vec4;
 using glm::mat4;
 
+// Photon flags. Direct photons are the ones stored where light first lands,
+// shadow photons mark the surfaces behind that point, which the light does
+// not reach straight, caustic photons have only been reflected or refracted
+// by mirrors and glass on the way, and indirect photons are the rest
+#define PHOTON_INDIRECT 0
+#define PHOTON_DIRECT 1
+#define PHOTON_SHADOW 2
+#define PHOTON_CAUSTIC 3
+
 class Shape;
+class Scene;
 
 class Photon {
 
@@ -38,11 +48,16 @@ class Photon {
         void setDirection(vec4 direction);
         void setFlag(short flag);
 
-        vec3 DirectLight(Intersection i, vector<Shape *> shapes);
+        vec3 DirectLight(Intersection i, Scene& scene);
         vec4 ReflectPhoton(const vec4 position, const vec4 normal);
-        vec4 RefractPhoton(const Intersection i, vector<Shape *> shapes);
-        void TracePhoton(vector<Photon> & globalTraced, vector<Shape *> shapes);
+        vec4 RefractPhoton(const Intersection i, Scene& scene);
+        void TracePhoton(vector<Photon> & globalTraced, Scene& scene);
+        // As above, also adding a shadow photon to shadowTraced at every
+        // surface behind the first hit, if shadowTraced is not null
+        void TracePhoton(vector<Photon> & globalTraced, vector<Photon> * shadowTraced, Scene& scene);
+        void TraceShadowPhotons(vector<Photon> & shadowTraced, Scene& scene);
         bool closestIntersection(vector<Shape *> shapes, Intersection& closestIntersection);
+        bool closestIntersection(Scene& scene, Intersection& closestIntersection);
         vec4 GeneratePhotonDirection();
 };
 
@@ -9,7 +9,7 @@ PhotonComparator::PhotonComparator(float distance, Photon photon) {
 }
 
 // Getters
-float PhotonComparator::getDistance() {
+float PhotonComparator::getDistance() const {
     return this->distance;
 }
 
@@ -15,7 +15,7 @@ class PhotonComparator {
         PhotonComparator(float distance, Photon photon);
 
         // GETTERS
-        float getDistance();
+        float getDistance() const;
         Photon getPhoton();
 
 
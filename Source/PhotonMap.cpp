@@ -4,14 +4,33 @@
 #include <iostream>
 #include <omp.h>
 #include <queue>
+#include <cstring>
 #include "util.h"
 
-PhotonMap::PhotonMap(LightSphere ls, int initial_photon_count, int numNearestPhotons, vector<Shape *> shapes) {
+PhotonMap::PhotonMap(LightSphere ls, int initial_photon_count, int numNearestPhotons, Scene& scene) {
+    LightTree lights(vector<LightSphere>(1, ls));
+    EmissiveShapes emitters;
+    BuildMap(lights, emitters, initial_photon_count, numNearestPhotons, scene, false);
+}
+
+PhotonMap::PhotonMap(LightTree& lights, int initial_photon_count, int numNearestPhotons, Scene& scene) {
+    EmissiveShapes emitters;
+    BuildMap(lights, emitters, initial_photon_count, numNearestPhotons, scene, false);
+}
+
+PhotonMap::PhotonMap(LightTree& lights, EmissiveShapes& emitters, int initial_photon_count, int numNearestPhotons, Scene& scene) {
+    BuildMap(lights, emitters, initial_photon_count, numNearestPhotons, scene, false);
+}
+
+PhotonMap::PhotonMap(LightTree& lights, EmissiveShapes& emitters, int initial_photon_count, int numNearestPhotons, Scene& scene, bool traceShadowPhotons) {
+    BuildMap(lights, emitters, initial_photon_count, numNearestPhotons, scene, traceShadowPhotons);
+}
 
-    //Set the light sphere passed in
-    this->ls = ls;
+void PhotonMap::BuildMap(LightTree& lights, EmissiveShapes& emitters, int initial_photon_count, int numNearestPhotons, Scene& scene, bool traceShadowPhotons) {
     this->initial_photon_count = initial_photon_count;
     this->numNearestPhotons = numNearestPhotons;
+    radiusHints.assign(omp_get_max_threads(), map<int, float>());
+    randomStates.assign(omp_get_max_threads(), 1u);
 
     cout << "Initialising Photons" << endl;
 
@@ -23,17 +42,37 @@ PhotonMap::PhotonMap(LightSphere ls, int initial_photon_count, int numNearestPho
 
     cout << "Initialised Photons" << endl;
 
-    // Populate the list of photons
-    GeneratePhotonsFromLightSphere(photons);
+    // Populate the list of photons, shared between the light spheres and the
+    // emissive shapes by power
+    float lightPower = lights.getTotalPower();
+    float emittedPower = emitters.getTotalPower();
+    int numEmitted = lightPower + emittedPower > 0 ? (int) (initial_photon_count * emittedPower / (lightPower + emittedPower) + 0.5f) : 0;
+    if (lights.getNumLights() == 0) numEmitted = initial_photon_count;
+    if (emitters.getNumShapes() == 0) numEmitted = 0;
+    GeneratePhotonsFromLights(lights, photons, initial_photon_count - numEmitted);
+    GeneratePhotonsFromEmitters(emitters, photons, initial_photon_count - numEmitted, numEmitted);
 
-    cout << "Generated Photons from light sphere" << endl;
+    cout << "Generated Photons from " << lights.getNumLights() << " light spheres and " << emitters.getNumShapes() << " emissive shapes" << endl;
 
     // Create the traced Photon Vector:
     // Trace each photon by storing position and diffuse surface it hits until
     // they are all absored -> meaning we store the same photons multiple times.
     vector<Photon> globalTraced;
-    TracePhotons(photons, globalTraced, shapes);
+    vector<Photon> shadowTraced;
+    TracePhotons(photons, globalTraced, traceShadowPhotons ? &shadowTraced : nullptr, scene);
+
+    if (traceShadowPhotons) {
+        //The direct photons are kept alongside the shadow ones before the
+        //global photons are sorted into the kd tree
+        shadowTraced.insert(shadowTraced.end(), globalTraced.begin(), globalTraced.end());
+        shadowPhotons = ShadowPhotons(shadowTraced, lights.getNumLights() + emitters.getNumShapes());
+        cout << "Traced " << shadowPhotons.getNumPhotons() << " direct and shadow photons" << endl;
+        if (!shadowPhotons.isUsable()) {
+            cout << "Shadow photons only stand in for shadow rays with a single light source" << endl;
+        }
+    }
 
+    numStoredPhotons = globalTraced.size();
     kdGlobalTraced.push_back(new KDTree(globalTraced,0));
 }
 
@@ -41,13 +80,20 @@ bool PhotonMap::ContainedInSphere(vec4 p, float r) {
     return glm::distance(vec4(0), p) <= r;
 }
 
-//Generate photons from a point light
-void PhotonMap::GeneratePhotonsFromPointLight(Light light, vector<Photon>& photons, int numPhotons, int offset){
+//Generate the first numPhotons photons from the lights, each leaving from its
+//own point in a light picked in proportion to power. The picks are stratified
+//over the alias table, so each light's share of the photons follows its power
+//closely
+void PhotonMap::GeneratePhotonsFromLights(LightTree& lights, vector<Photon>& photons, int numPhotons){
     float r = 1.0f;
 
     //Create photon_count photons using rejection sampling to uniformly
-    //sample from a point light
+    //sample their directions
     for(int i = 0; i < numPhotons; i++){
+        float pmf;
+        LightSphere& light = lights.getLight(lights.SampleEmitter((i + 0.5f) / numPhotons, pmf));
+        vec4 position = light.samplePoint();
+
         float x = 0;
         float y = 0;
         float z = 0;
@@ -60,33 +106,34 @@ void PhotonMap::GeneratePhotonsFromPointLight(Light light, vector<Photon>& photo
 
         vec4 direction(x, y, z, 1.0f);
 
-        //Create the photon
-        Photon photon(light.getPosition(), direction, (light.getPower() * light.getDiffuse()) / (float)numPhotons, (short)0);
-        photons[offset + i] = photon;
+        //Create the photon, its share of the light's power raised by how
+        //rarely the light is picked
+        vec3 power = (light.getPower() * light.getDiffuse()) / (pmf * (float)numPhotons);
+        photons[i] = Photon(position, direction, power, (short)0);
     }
 }
 
-
-//Generate the photons from a light sphere
-void PhotonMap::GeneratePhotonsFromLightSphere(vector<Photon>& photons){
-    int arr[ls.getPointLights().size()] = {0};
-    for (int i = 0 ; i < photons.size() ; i++) {
-        arr[i % ls.getPointLights().size()]++;
-    }
-    int offset = 0;
-    for(int i = 0; i < ls.getPointLights().size(); i++){
-        //Generate the photons for a given point light
-        GeneratePhotonsFromPointLight(ls.getPointLights()[i], photons, arr[i], offset);
-        offset+=arr[i];
+//Generate numPhotons photons from the emissive shapes from photons[offset],
+//with the shape picks stratified as for the lights
+void PhotonMap::GeneratePhotonsFromEmitters(EmissiveShapes& emitters, vector<Photon>& photons, int offset, int numPhotons){
+    for(int i = 0; i < numPhotons; i++){
+        float u1 = (float) rand() / (RAND_MAX);
+        float u2 = (float) rand() / (RAND_MAX);
+        float u3 = (float) rand() / (RAND_MAX);
+        float u4 = (float) rand() / (RAND_MAX);
+        vec4 position, direction;
+        vec3 power;
+        emitters.SamplePhoton((i + 0.5f) / numPhotons, u1, u2, u3, u4, numPhotons, position, direction, power);
+        photons[offset + i] = Photon(position, direction, power, (short)0);
     }
 }
 
 //Traces all photons in the passed in list and add them to the list of photons in the end
-void PhotonMap::TracePhotons(vector<Photon> initial_photons, vector<Photon>& globalPhotons, vector<Shape *> shapes){
+void PhotonMap::TracePhotons(vector<Photon> initial_photons, vector<Photon>& globalPhotons, vector<Photon> * shadowPhotons, Scene& scene){
 
     //For all of the initial photons trace their path and add them to the new vector
     for(int i = 0 ; i < initial_photons.size() ; i++){
-        initial_photons[i].TracePhoton(globalPhotons, shapes);
+        initial_photons[i].TracePhoton(globalPhotons, shadowPhotons, scene);
     }
 }
 
@@ -100,11 +147,67 @@ float PhotonMap::CalculateGaussianFilter(float dp, float r){
     return w_pc;
 }
 
+//d/ddp of the filter above is alpha beta dp exp(-beta dp^2 / 2r^2) over
+//r^2 (1 - exp(-beta)), so over dp it leaves the rest
+float PhotonMap::CalculateGaussianFilterSlope(float dp, float r){
+    float alpha = 0.918f;
+    float beta = 1.953f;
+    return alpha * beta * exp( -beta * ((pow(dp,2)) / (2 * pow(r,2))) ) / (pow(r,2) * (1.0f - exp(-beta)));
+}
+
+//Each photon's filter weight changes by its slope times the offset from the
+//photon as the point moves. The photons and r are held where they are, as
+//the estimate only holds over moves within its own radius anyway
+mat3 PhotonMap::DiffuseSurfaceGradient(vector<Photon>& photons, Intersection& intersection, Scene& scene, float r){
+    mat3 gradient(0);
+    for (int i = 0; i < photons.size(); i++) {
+        vec3 offset = vec3(intersection.position - photons[i].getPosition());
+        vec3 fr = photons[i].DirectLight(intersection, scene);
+        vec3 change = fr * photons[i].getPower() * CalculateGaussianFilterSlope(length(offset), r);
+        for (int k = 0; k < 3; k++) {
+            gradient[k] += change * offset[k];
+        }
+    }
+    return gradient;
+}
+
+//Gathers the photons used for a radiance estimate at a position. With adaptive
+//gathering every photon within the density radius is used (clamped to between
+//the min and max count), otherwise the n nearest photons are returned. The
+//nearest photon search is approximate to within (1 + epsilon)
+vector<Photon> PhotonMap::GatherPhotons(int n, vec4 position, float epsilon){
+    #pragma omp atomic
+    numGathers++;
+    #pragma omp atomic
+    numGatheredPhotons += adaptiveNearestPhotons ? maxNearestPhotons : n;
+
+    if (adaptiveNearestPhotons) {
+        vector<Photon> photons = kdGlobalTraced[0]->FindClosestPhotons(maxNearestPhotons, densityRadius, position);
+        if (photons.size() >= minNearestPhotons) {
+            return photons;
+        }
+        //Sparse region, fall back to the minimum number of photons
+        n = minNearestPhotons;
+    }
+
+    //Starting radius carried over from this thread's previous gather of n
+    //photons from this map. Threads past the ones the map was built for
+    //start from nothing
+    float noHint = 0.0f;
+    int thread = omp_get_thread_num();
+    float& radiusHint = thread < radiusHints.size() ? radiusHints[thread][n] : noHint;
+    return kdGlobalTraced[0]->FindClosestPhotons(n, MAX_GATHER_RADIUS, position, radiusHint, epsilon);
+}
+
 //Estimates the radiance at a diffuse surface with n photons at the intersection
-vec3 PhotonMap::DiffuseSurfaceEstimate(int n, Intersection intersection, vector<Shape *> shapes){
+vec3 PhotonMap::DiffuseSurfaceEstimate(int n, Intersection intersection, Scene& scene, float epsilon){
     vec4 position = intersection.position;
-    //TODO Get from the KDTree instead
-    vector <Photon> nearestPhotons = kdGlobalTraced[0]->FindClosestPhotons(n, 0.5f, position);
+    Material * material = &scene.getMaterial(intersection.index);
+    vec3 cached;
+    if (irradianceCache && irradianceCache->Lookup(vec3(position), vec3(intersection.normal), material, n, cached)) {
+        return cached;
+    }
+    vector <Photon> nearestPhotons = GatherPhotons(n, position, epsilon);
     if(nearestPhotons.size() > 0) {
         // Distance from the position to the furthest away photon
         float r = (float) sqrt(pow(position.x - nearestPhotons[0].getPosition().x, 2)
@@ -117,12 +220,19 @@ vec3 PhotonMap::DiffuseSurfaceEstimate(int n, Intersection intersection, vector<
 
             float dp = distance(position, nearestPhotons[i].getPosition());
 
-            vec3 fr = nearestPhotons[i].DirectLight(intersection, shapes);
+            vec3 fr = nearestPhotons[i].DirectLight(intersection, scene);
             vec3 flux = nearestPhotons[i].getPower();
             float w_pc = CalculateGaussianFilter(dp, r);
             vec3 prod = fr * flux * w_pc;
             sum += prod;
         }
+        if (irradianceCache) {
+            mat3 gradient(0);
+            if (irradianceCache->useGradients()) {
+                gradient = coeff * DiffuseSurfaceGradient(nearestPhotons, intersection, scene, r);
+            }
+            irradianceCache->Insert({vec3(position), vec3(intersection.normal), coeff * sum, gradient, r, material, n});
+        }
         return coeff * sum;
     }
 
@@ -130,10 +240,29 @@ vec3 PhotonMap::DiffuseSurfaceEstimate(int n, Intersection intersection, vector<
 }
 
 
+//The filter radius is still the nth nearest photon's, so the direct and
+//caustic photons are counted over the same area as all the photons would be
+vec3 PhotonMap::DirectSurfaceEstimate(int n, Intersection intersection, Scene& scene, float epsilon){
+    vec4 position = intersection.position;
+    vector <Photon> nearestPhotons = GatherPhotons(n, position, epsilon);
+    if (nearestPhotons.empty()) return vec3(0);
+
+    float r = distance(position, nearestPhotons[0].getPosition());
+    float coeff = 1 / (float) (M_PI * pow(r, 2));
+    vec3 sum = vec3(0);
+    for (int i = 0; i < nearestPhotons.size(); i++) {
+        short flag = nearestPhotons[i].getFlag();
+        if (flag != PHOTON_DIRECT && flag != PHOTON_CAUSTIC) continue;
+        float dp = distance(position, nearestPhotons[i].getPosition());
+        sum += nearestPhotons[i].DirectLight(intersection, scene) * nearestPhotons[i].getPower() * CalculateGaussianFilter(dp, r);
+    }
+    return coeff * sum;
+}
+
 //Estimates radiance at specular surface
-vec3 PhotonMap::SpecularSurfaceEstimate(Intersection intersection, vector<Shape *> shapes, Camera camera, LightSphere ls) {
+vec3 PhotonMap::SpecularSurfaceEstimate(Intersection intersection, Scene& scene, Camera camera, LightSphere ls) {
 
-    Shape * shape = shapes[intersection.index];
+    Material& material = scene.getMaterial(intersection.index);
 
     vec4 lightPos = ls.getCentre();
     
@@ -169,54 +298,126 @@ vec3 PhotonMap::SpecularSurfaceEstimate(Intersection intersection, vector<Shape
     float blinn = dot(halfAngle, n_hat);
     blinn = glm::clamp(blinn, 0.0f, 1.0f);
     blinn = cosAngIncidence != 0.0 ? blinn : 0.0;
-    blinn = pow(blinn, shape->getMaterial().getShininess());
-    if  (shape->getMaterial().getShininess() == 0) {
+    blinn = pow(blinn, material.getShininess());
+    if  (material.getShininess() == 0) {
         blinn = 0;
     }
 
-    return blinn * shape->getMaterial().getSpecular() * attenIntensity;
+    return blinn * material.getSpecular() * attenIntensity;
 }
 
-vec3 PhotonMap::SpecDiffSurfaceEstimate(int n, Intersection intersection, vector<Shape *> shapes, Camera camera, LightSphere ls){
+vec3 PhotonMap::SpecDiffSurfaceEstimate(int n, Intersection intersection, Scene& scene, Camera camera, LightSphere ls, float epsilon){
     
-    Shape * shape = shapes[intersection.index];
-    Material mat = shape->getMaterial();
+    Material& mat = scene.getMaterial(intersection.index);
 
-    vec3 i_diff = DiffuseSurfaceEstimate(n, intersection, shapes);
-    vec3 i_spec = SpecularSurfaceEstimate(intersection, shapes, camera, ls);
+    vec3 i_diff = DiffuseSurfaceEstimate(n, intersection, scene, epsilon);
+    vec3 i_spec = SpecularSurfaceEstimate(intersection, scene, camera, ls);
     vec3 i_amb  = mat.getAmbient() * ls.getAmbient();
     float distanceAttenuation = 2;
     float dimming_factor = 1.0f;
-    vec3 totalLight = (i_diff + 10.0f * i_spec);
+    vec3 totalLight = (mat.getEmitted() + i_diff + 10.0f * i_spec);
     totalLight = totalLight * dimming_factor;
 
     return totalLight;
 }
 
+vec3 PhotonMap::PrimarySurfaceEstimate(int n, Intersection intersection, Scene& scene, Camera camera, LightSphere ls){
+    if (finalGatherRays <= 0) {
+        return SpecDiffSurfaceEstimate(n, intersection, scene, camera, ls, gatherEpsilon);
+    }
+    //As SpecDiffSurfaceEstimate
+    Material& mat = scene.getMaterial(intersection.index);
+    vec3 i_spec = SpecularSurfaceEstimate(intersection, scene, camera, ls);
+    return mat.getEmitted() + FinalGather(n, intersection, scene, camera) + 10.0f * i_spec;
+}
+
+//The map's own estimate at a point is diffuse colour times the flux around
+//it, so the indirect part here is the diffuse colour times the mean of the
+//estimates the rays land on, cosine weighting already standing for the
+//cosine at the point. Strata are cells of an s by s grid over the two
+//numbers the cosine weighting maps onto the hemisphere. Rays that miss, or
+//land on glass, which holds no photons, add nothing, and emitters are left
+//to their own photons.
+//No calibration factor is applied, so the result is biased against the map
+//shown directly: TracePhoton bounces "diffuse" photons as off a mirror, so
+//the light the map carries between surfaces is not spread evenly over every
+//direction as the gather takes it to be. On the Cornell box a gathered frame
+//comes out about 1.19 times as bright overall
+vec3 PhotonMap::FinalGather(int n, Intersection intersection, Scene& scene, Camera camera){
+    vec3 direct = DirectSurfaceEstimate(n, intersection, scene, gatherEpsilon);
+
+    vec3 position = vec3(intersection.position);
+    vec3 normal = vec3(intersection.normal);
+    if (dot(normal, position - vec3(camera.getPosition())) > 0) {
+        normal = -normal;
+    }
+    vec3 t = normalize(cross(fabs(normal.x) > 0.5f ? vec3(0, 1, 0) : vec3(1, 0, 0), normal));
+    vec3 b = cross(normal, t);
+
+    //Seeded from the hit, so the jitter is the same whichever thread
+    //gathers here
+    SeedRandom(intersection.position);
+    int strata = glm::max(1, (int) sqrt((float) finalGatherRays));
+    vec3 sum(0);
+    for (int sy = 0 ; sy < strata ; sy++) {
+        for (int sx = 0 ; sx < strata ; sx++) {
+            float u1 = (sx + Random()) / strata;
+            float u2 = (sy + Random()) / strata;
+            float r = sqrt(u1);
+            float phi = 2.0f * (float) M_PI * u2;
+            vec3 dir = r * cos(phi) * t + r * sin(phi) * b + sqrt(glm::max(0.0f, 1.0f - u1)) * normal;
+
+            Intersection hit;
+            if (scene.closestIntersection(vec4(position + 0.0001f * dir, 1), vec4(dir, 1), hit)) {
+                sum += DiffuseSurfaceEstimate(n, hit, scene, secondaryGatherEpsilon);
+            }
+        }
+    }
+    vec3 diffuse = scene.getMaterial(intersection.index).getDiffuse();
+    return direct + diffuse * sum / (float) (strata * strata);
+}
+
 //Estimates the radiance at a reflective surface
-vec3 PhotonMap::ReflectiveSurfaceEstimate(const Intersection i, Ray incidentRay, vector<Shape *> shapes, const int rayDepth, int depth, vec3 hitColour, int n, Camera camera, LightSphere ls){
+vec3 PhotonMap::ReflectiveSurfaceEstimate(const Intersection i, Ray incidentRay, Scene& scene, const int rayDepth, int depth, vec3 hitColour, int n, Camera camera, LightSphere ls, float throughput){
     //If we have recursed too far (i.e. ray keep getting reflected)
     //then set the colour to the background colour
     if( depth > rayDepth ) return vec3(0,0,0);
 
-    Shape * shape = shapes[i.index];
+    Material& material = scene.getMaterial(i.index);
 
     vec4 norm = i.normal;
 
     //Surface is reflective, reflect the ray
-    if(shape->getMaterial().isReflective()){
+    if(material.isReflective()){
 
         //Compute the reflected ray
         vec4 reflectedDirection = incidentRay.ReflectRay(norm);
         Ray reflectedRay( i.position + 0.0001f*reflectedDirection ,reflectedDirection);
+        incidentRay.BounceCone(reflectedRay, i, scene, false);
 
         //Find the next intersection, if there exists one reflect the ray, else return background colour
         Intersection i_next;
-        if(reflectedRay.closestIntersection(shapes, i_next)){
-            Material mat = shapes[i_next.index]->getMaterial();
+        if(reflectedRay.closestIntersection(scene, i_next)){
+            Material& mat = scene.getMaterial(i_next.index);
             //Find the colour of the reflected ray
-            vec3 reflectedColour = ReflectiveSurfaceEstimate(i_next, reflectedRay, shapes, rayDepth, depth+1, hitColour, n, camera, ls);
-            vec3 diffuseColour = SpecDiffSurfaceEstimate(getNumNearestPhotons(), i_next, shapes, camera, ls);
+            float reflectedWeight = 0.95f * throughput * mat.getReflectRatio();
+            float diffuseWeight = 0.95f * throughput * (1 - mat.getReflectRatio());
+            float reflectedScale, diffuseScale;
+            vec3 reflectedColour(0), diffuseColour(0);
+            if (EndsPath(mat, depth + 1, rayDepth)) {
+                //The call below would only make this same estimate again
+                if (ContinuePath(reflectedWeight + diffuseWeight, diffuseScale, gathersSaved)) {
+                    diffuseColour = diffuseScale * SpecDiffSurfaceEstimate(FootprintPhotons(getNumNearestPhotons(), reflectedRay, i_next), i_next, scene, camera, ls, secondaryGatherEpsilon);
+                    reflectedColour = diffuseColour;
+                }
+            } else {
+                if (ContinuePath(reflectedWeight, reflectedScale, pathsCut)) {
+                    reflectedColour = reflectedScale * ReflectiveSurfaceEstimate(i_next, reflectedRay, scene, rayDepth, depth+1, hitColour, n, camera, ls, reflectedWeight * reflectedScale);
+                }
+                if (ContinuePath(diffuseWeight, diffuseScale, gathersSaved)) {
+                    diffuseColour = diffuseScale * SpecDiffSurfaceEstimate(FootprintPhotons(getNumNearestPhotons(), reflectedRay, i_next), i_next, scene, camera, ls, secondaryGatherEpsilon);
+                }
+            }
             vec3 colour = reflectedColour * mat.getReflectRatio() + diffuseColour * (1 - mat.getReflectRatio());
             hitColour = vec3(hitColour.x + (0.95 * colour.x), hitColour.y + (0.95 * colour.y), hitColour.z + (0.95 * colour.z));
         }
@@ -224,16 +425,17 @@ vec3 PhotonMap::ReflectiveSurfaceEstimate(const Intersection i, Ray incidentRay,
             return vec3(0,0,0);
         }
     }
-    else if(shape->getMaterial().isTransparent()){
+    else if(material.isTransparent()){
         //transmit ray
-        vec4 refractedDirection = incidentRay.RefractLightRay(i, shapes);
+        vec4 refractedDirection = incidentRay.RefractLightRay(i, scene);
         Ray refractedRay( i.position + 0.0001f*refractedDirection, refractedDirection);
+        incidentRay.BounceCone(refractedRay, i, scene, true);
 
         //Find the next intersection, if there exists one, call function again else return 0
         Intersection i_next;
-        if(refractedRay.closestIntersection(shapes, i_next)){
+        if(refractedRay.closestIntersection(scene, i_next)){
             //Find the colour of the refracted ray
-            vec3 colour = TransmissiveSurfaceEstimate(i_next, refractedRay, shapes, rayDepth, depth+1, hitColour, n, camera, ls);
+            vec3 colour = TransmissiveSurfaceEstimate(i_next, refractedRay, scene, rayDepth, depth+1, hitColour, n, camera, ls, 0.95f * throughput);
             hitColour = vec3(hitColour.x + (0.95 * colour.x), hitColour.y + (0.95 * colour.y), hitColour.z + (0.95 * colour.z));
         }
         else{
@@ -245,7 +447,7 @@ vec3 PhotonMap::ReflectiveSurfaceEstimate(const Intersection i, Ray incidentRay,
         if (depth == 0) {
             hitColour = vec3(0);
         } else {
-            hitColour = SpecDiffSurfaceEstimate(n,i, shapes, camera, ls);
+            hitColour = SpecDiffSurfaceEstimate(FootprintPhotons(n, incidentRay, i), i, scene, camera, ls, secondaryGatherEpsilon);
         }
     }
 
@@ -253,19 +455,20 @@ vec3 PhotonMap::ReflectiveSurfaceEstimate(const Intersection i, Ray incidentRay,
 }
 
 //Estiamtes the radiance at a transmissive surface
-vec3 PhotonMap::TransmissiveSurfaceEstimate(const Intersection i, Ray incidentRay, vector<Shape *> shapes, const int rayDepth, int depth, vec3 hitColour, int n, Camera camera, LightSphere ls){
+vec3 PhotonMap::TransmissiveSurfaceEstimate(const Intersection i, Ray incidentRay, Scene& scene, const int rayDepth, int depth, vec3 hitColour, int n, Camera camera, LightSphere ls, float throughput){
     if(depth > rayDepth) return vec3(0,0,0);
 
-    //Get the shape
-    Shape * shape = shapes[i.index];
+    //Get the material
+    Material& material = scene.getMaterial(i.index);
 
     //If the material is transparent
-    if(shape->getMaterial().isTransparent()){
+    if(material.isTransparent()){
 
         //Find the refracted ray from the intersection
-        vec4 refractedDir = incidentRay.RefractLightRay(i, shapes);
+        vec4 refractedDir = incidentRay.RefractLightRay(i, scene);
 
         Ray refractedRay(i.position + (0.001f * refractedDir), refractedDir);
+        incidentRay.BounceCone(refractedRay, i, scene, true);
 
         vec4 transmittedRayDir = refractedRay.getDirection();
         vec3 trd3 = normalize(vec3(transmittedRayDir));
@@ -274,11 +477,27 @@ vec3 PhotonMap::TransmissiveSurfaceEstimate(const Intersection i, Ray incidentRa
         refractedRay.setDirection(transmittedRayDir);
 
         Intersection i_next;
-        if(refractedRay.closestIntersection(shapes, i_next)){
-            Material mat = shapes[i_next.index]->getMaterial();
+        if(refractedRay.closestIntersection(scene, i_next)){
+            Material& mat = scene.getMaterial(i_next.index);
             //Find the colour of the reflected ray
-            vec3 transmittedColour = TransmissiveSurfaceEstimate(i_next, refractedRay, shapes, rayDepth, depth+1, hitColour, n, camera, ls);
-            vec3 diffuseColour = SpecDiffSurfaceEstimate(getNumNearestPhotons(), i_next, shapes, camera, ls);
+            float transmittedWeight = 0.95f * throughput * mat.getReflectRatio();
+            float diffuseWeight = 0.95f * throughput * (1 - mat.getReflectRatio());
+            float transmittedScale, diffuseScale;
+            vec3 transmittedColour(0), diffuseColour(0);
+            if (EndsPath(mat, depth + 1, rayDepth)) {
+                //The call below would only make this same estimate again
+                if (ContinuePath(transmittedWeight + diffuseWeight, diffuseScale, gathersSaved)) {
+                    diffuseColour = diffuseScale * SpecDiffSurfaceEstimate(FootprintPhotons(getNumNearestPhotons(), refractedRay, i_next), i_next, scene, camera, ls, secondaryGatherEpsilon);
+                    transmittedColour = diffuseColour;
+                }
+            } else {
+                if (ContinuePath(transmittedWeight, transmittedScale, pathsCut)) {
+                    transmittedColour = transmittedScale * TransmissiveSurfaceEstimate(i_next, refractedRay, scene, rayDepth, depth+1, hitColour, n, camera, ls, transmittedWeight * transmittedScale);
+                }
+                if (ContinuePath(diffuseWeight, diffuseScale, gathersSaved)) {
+                    diffuseColour = diffuseScale * SpecDiffSurfaceEstimate(FootprintPhotons(getNumNearestPhotons(), refractedRay, i_next), i_next, scene, camera, ls, secondaryGatherEpsilon);
+                }
+            }
             vec3 colour = transmittedColour * mat.getReflectRatio() + diffuseColour * (1 - mat.getReflectRatio());
             hitColour = vec3(hitColour.x + (0.95 * colour.x), hitColour.y + (0.95 * colour.y), hitColour.z + (0.95 * colour.z));
         }
@@ -286,17 +505,18 @@ vec3 PhotonMap::TransmissiveSurfaceEstimate(const Intersection i, Ray incidentRa
             hitColour = vec3(0.0f,0.0f,0.0f);
         }
     }
-    else if(shape->getMaterial().isReflective()){
+    else if(material.isReflective()){
 
         //Compute the reflected ray
         vec4 reflectedDirection = incidentRay.ReflectRay(i.normal);
         Ray reflectedRay( i.position + 0.0001f*reflectedDirection ,reflectedDirection);
+        incidentRay.BounceCone(reflectedRay, i, scene, false);
 
         //Find the next intersection, if there exists one reflect the ray, else return background colour
         Intersection i_next;
-        if(reflectedRay.closestIntersection(shapes, i_next)){
+        if(reflectedRay.closestIntersection(scene, i_next)){
             //Find the colour of the reflected ray
-            vec3 colour = ReflectiveSurfaceEstimate(i_next, reflectedRay, shapes, rayDepth, depth+1, hitColour, n, camera, ls);
+            vec3 colour = ReflectiveSurfaceEstimate(i_next, reflectedRay, scene, rayDepth, depth+1, hitColour, n, camera, ls, 0.95f * throughput);
             hitColour = vec3(hitColour.x + (0.95 * colour.x), hitColour.y + (0.95 * colour.y), hitColour.z + (0.95 * colour.z));
         }
         else {
@@ -307,7 +527,7 @@ vec3 PhotonMap::TransmissiveSurfaceEstimate(const Intersection i, Ray incidentRa
         if (depth == 0) {
             hitColour = vec3(0);
         } else {
-            hitColour = SpecDiffSurfaceEstimate(n, i, shapes, camera, ls);
+            hitColour = SpecDiffSurfaceEstimate(FootprintPhotons(n, incidentRay, i), i, scene, camera, ls, secondaryGatherEpsilon);
         }
     }
 
@@ -316,28 +536,39 @@ vec3 PhotonMap::TransmissiveSurfaceEstimate(const Intersection i, Ray incidentRa
 
 
 //TODO include SpecularLight function and include this with the radiance estimate
-vec3 PhotonMap::RadianceEstimate(int n, Intersection intersection, vector<Shape *> shapes, Ray incidentRay, Camera camera, LightSphere ls) {
+vec3 PhotonMap::RadianceEstimate(int n, Intersection intersection, Scene& scene, Ray incidentRay, Camera camera, LightSphere ls) {
     vec4 position = intersection.position;
-    Material mat = shapes[intersection.index]->getMaterial();
+    SeedRandom(position);
+    Material& mat = scene.getMaterial(intersection.index);
     vec3 hitColour = vec3(0,0,0);
 
     //CASE 1: Material is both reflective and transmissive
     if(mat.isReflective() && mat.isTransparent()){
 
-        float reflectiveRatio = incidentRay.FresnelRatio(intersection, shapes);
+        float reflectiveRatio = incidentRay.FresnelRatio(intersection, scene);
 
         if(reflectiveRatio >= 1){
-            hitColour = ReflectiveSurfaceEstimate(intersection, incidentRay , shapes, 8, 0, hitColour, n, camera, ls);
+            hitColour = ReflectiveSurfaceEstimate(intersection, incidentRay , scene, MAX_PATH_DEPTH, 0, hitColour, n, camera, ls, 1.0f);
         }
         else{
-            vec3 reflectedColour = 5.0f * ReflectiveSurfaceEstimate(intersection, incidentRay , shapes, 8, 0, hitColour, n, camera, ls);
-            vec3 refractedColour = TransmissiveSurfaceEstimate(intersection, incidentRay , shapes, 8, 0, hitColour, n, camera, ls);
-            vec3 diffuseColour = SpecDiffSurfaceEstimate(n,intersection, shapes, camera, ls);
-
-
             float diff_ratio = 1.0f - mat.getReflectRatio();
             float refractiveRatio = 1 - reflectiveRatio;
 
+            //Each branch is only followed while its share of the pixel is
+            //worth it
+            float reflectedScale, refractedScale, diffuseScale;
+            float reflectedWeight = 5.0f * reflectiveRatio * mat.getReflectRatio();
+            vec3 reflectedColour(0), refractedColour(0), diffuseColour(0);
+            if (ContinuePath(reflectedWeight, reflectedScale, pathsCut)) {
+                reflectedColour = 5.0f * reflectedScale * ReflectiveSurfaceEstimate(intersection, incidentRay , scene, MAX_PATH_DEPTH, 0, hitColour, n, camera, ls, reflectedWeight * reflectedScale);
+            }
+            if (ContinuePath(refractiveRatio, refractedScale, pathsCut)) {
+                refractedColour = refractedScale * TransmissiveSurfaceEstimate(intersection, incidentRay , scene, MAX_PATH_DEPTH, 0, hitColour, n, camera, ls, refractiveRatio * refractedScale);
+            }
+            if (ContinuePath(diff_ratio, diffuseScale, gathersSaved)) {
+                diffuseColour = diffuseScale * PrimarySurfaceEstimate(n, intersection, scene, camera, ls);
+            }
+
             hitColour = vec3( (reflectedColour.x * reflectiveRatio * mat.getReflectRatio()) + (refractedColour.x * refractiveRatio) + (diffuseColour.x * diff_ratio),
                               (reflectedColour.y * reflectiveRatio * mat.getReflectRatio()) + (refractedColour.y * refractiveRatio) + (diffuseColour.y * diff_ratio),
                               (reflectedColour.z * reflectiveRatio * mat.getReflectRatio()) + (refractedColour.z * refractiveRatio) + (diffuseColour.z * diff_ratio));
@@ -346,9 +577,15 @@ vec3 PhotonMap::RadianceEstimate(int n, Intersection intersection, vector<Shape
     //CASE 2: Material is only reflective
     else if(mat.isReflective()){
 
-        hitColour = ReflectiveSurfaceEstimate(intersection, incidentRay , shapes, 8, 0, hitColour, n, camera, ls);
         float diff_ratio = 1.0f - mat.getReflectRatio();
-        vec3 diffuseColour = SpecDiffSurfaceEstimate(n,intersection, shapes, camera, ls);
+        float reflectedScale, diffuseScale;
+        vec3 diffuseColour(0);
+        if (ContinuePath(mat.getReflectRatio(), reflectedScale, pathsCut)) {
+            hitColour = reflectedScale * ReflectiveSurfaceEstimate(intersection, incidentRay , scene, MAX_PATH_DEPTH, 0, hitColour, n, camera, ls, mat.getReflectRatio() * reflectedScale);
+        }
+        if (ContinuePath(diff_ratio, diffuseScale, gathersSaved)) {
+            diffuseColour = diffuseScale * PrimarySurfaceEstimate(n, intersection, scene, camera, ls);
+        }
 
         //TODO: Include specular
         hitColour = vec3(hitColour.x * mat.getReflectRatio() + diffuseColour.x * diff_ratio,
@@ -357,15 +594,250 @@ vec3 PhotonMap::RadianceEstimate(int n, Intersection intersection, vector<Shape
     }
     //CASE 3: Material is only refractive
     else if(mat.isTransparent()){
-        hitColour = TransmissiveSurfaceEstimate(intersection, incidentRay , shapes, 8, 0, hitColour, n, camera, ls);
+        hitColour = TransmissiveSurfaceEstimate(intersection, incidentRay , scene, MAX_PATH_DEPTH, 0, hitColour, n, camera, ls, 1.0f);
     }
     //CASE 4: Material is diffuse
     else{
-        hitColour = SpecDiffSurfaceEstimate(n, intersection, shapes, camera, ls);
+        hitColour = PrimarySurfaceEstimate(n, intersection, scene, camera, ls);
     }
     return hitColour;
 }
 
+//The recursive estimates only ever add up surface estimates, each scaled by
+//the reflect ratios, Fresnel ratios and 0.95 falloffs along the way to it.
+//Here each path vertex carries that scale as its weight, and every surface
+//estimate is queued with its weight until all the paths have ended
+void PhotonMap::RadianceEstimates(int n, vector<PathStart>& starts, Scene& scene, Camera camera, LightSphere ls, vector<vec3>& colours) {
+    vector<PathState> states;
+    vector<GatherRequest> gathers;
+    //The stages before the gathers run on this thread alone, so the numbers
+    //they draw follow on from the first start's seed in queue order
+    if (!starts.empty()) {
+        SeedRandom(starts[0].intersection.position);
+    }
+    for (int i = 0 ; i < starts.size() ; i++) {
+        ShadePathStart(n, starts[i], scene, states, gathers);
+    }
+
+    while (!states.empty()) {
+        vector<PathExtension> extensions;
+        ShadePathStates(n, states, scene, extensions, gathers);
+        states.clear();
+        ExtendPaths(extensions, scene, states, gathers);
+    }
+
+    //Queued in pixel order a bounce at a time, so neighbouring gathers search
+    //nearby photons
+    vector<vec3> estimates(gathers.size());
+    #pragma omp parallel for schedule(dynamic, 64)
+    for (int g = 0 ; g < gathers.size() ; g++) {
+        if (gathers[g].primary) {
+            estimates[g] = PrimarySurfaceEstimate(gathers[g].n, gathers[g].intersection, scene, camera, ls);
+        } else {
+            estimates[g] = SpecDiffSurfaceEstimate(gathers[g].n, gathers[g].intersection, scene, camera, ls, gathers[g].epsilon);
+        }
+    }
+    for (int g = 0 ; g < gathers.size() ; g++) {
+        colours[gathers[g].pixel] += gathers[g].weight * estimates[g];
+    }
+}
+
+//The four cases of RadianceEstimate
+void PhotonMap::ShadePathStart(int n, PathStart& start, Scene& scene, vector<PathState>& states, vector<GatherRequest>& gathers) {
+    Intersection& intersection = start.intersection;
+    Material& mat = scene.getMaterial(intersection.index);
+    float w = start.weight;
+    PathState reflected = {intersection, start.incidentRay, 0, false, start.pixel, w};
+    PathState transmitted = {intersection, start.incidentRay, 0, true, start.pixel, w};
+    GatherRequest diffuse = {intersection, n, gatherEpsilon, start.pixel, w * (1.0f - mat.getReflectRatio()), true};
+
+    if (mat.isReflective() && mat.isTransparent()) {
+        float reflectiveRatio = start.incidentRay.FresnelRatio(intersection, scene);
+        if (reflectiveRatio >= 1) {
+            states.push_back(reflected);
+        } else {
+            reflected.weight = w * 5.0f * reflectiveRatio * mat.getReflectRatio();
+            transmitted.weight = w * (1 - reflectiveRatio);
+            states.push_back(reflected);
+            states.push_back(transmitted);
+            PushGather(diffuse, gathers);
+        }
+    }
+    else if (mat.isReflective()) {
+        reflected.weight = w * mat.getReflectRatio();
+        states.push_back(reflected);
+        PushGather(diffuse, gathers);
+    }
+    else if (mat.isTransparent()) {
+        states.push_back(transmitted);
+    }
+    else {
+        diffuse.weight = w;
+        PushGather(diffuse, gathers);
+    }
+}
+
+//Sorts the vertices into a queue per action, as the materials choose it, then
+//runs each queue: mirrors reflect, glass refracts and diffuse surfaces end
+//the path. Reflective vertices check for a mirror first and transmissive
+//ones for glass, as in the recursive estimates
+void PhotonMap::ShadePathStates(int n, vector<PathState>& states, Scene& scene, vector<PathExtension>& extensions, vector<GatherRequest>& gathers) {
+    vector<int> reflectQueue;
+    vector<int> refractQueue;
+    vector<int> diffuseQueue;
+    for (int s = 0 ; s < states.size() ; s++) {
+        if (states[s].depth > MAX_PATH_DEPTH) continue;
+        Material& material = scene.getMaterial(states[s].intersection.index);
+        bool reflects = states[s].transmitted ? material.isReflective() && !material.isTransparent() : material.isReflective();
+        bool refracts = states[s].transmitted ? material.isTransparent() : material.isTransparent() && !material.isReflective();
+        if (reflects) {
+            reflectQueue.push_back(s);
+        } else if (refracts) {
+            refractQueue.push_back(s);
+        } else {
+            diffuseQueue.push_back(s);
+        }
+    }
+
+    //A path carries on the same way, reflecting from a reflective vertex or
+    //refracting from a transmissive one, only after a surface estimate at
+    //the next hit
+    for (int q = 0 ; q < reflectQueue.size() ; q++) {
+        PathState& state = states[reflectQueue[q]];
+        vec4 reflectedDirection = state.incidentRay.ReflectRay(state.intersection.normal);
+        Ray reflectedRay(state.intersection.position + 0.0001f * reflectedDirection, reflectedDirection);
+        state.incidentRay.BounceCone(reflectedRay, state.intersection, scene, false);
+        PushExtension({reflectedRay, state.depth + 1, false, !state.transmitted, state.pixel, 0.95f * state.weight}, extensions);
+    }
+    for (int q = 0 ; q < refractQueue.size() ; q++) {
+        PathState& state = states[refractQueue[q]];
+        vec4 refractedDirection = state.incidentRay.RefractLightRay(state.intersection, scene);
+        float offset = state.transmitted ? 0.001f : 0.0001f;
+        Ray refractedRay(state.intersection.position + offset * refractedDirection, refractedDirection);
+        state.incidentRay.BounceCone(refractedRay, state.intersection, scene, true);
+        if (state.transmitted) {
+            //TransmissiveSurfaceEstimate normalises the direction a second
+            //time, which can move it by a rounding error
+            refractedRay.setDirection(vec4(normalize(vec3(refractedRay.getDirection())), 1));
+        }
+        PushExtension({refractedRay, state.depth + 1, true, state.transmitted, state.pixel, 0.95f * state.weight}, extensions);
+    }
+    for (int q = 0 ; q < diffuseQueue.size() ; q++) {
+        PathState& state = states[diffuseQueue[q]];
+        if (state.depth > 0) {
+            PushGather({state.intersection, FootprintPhotons(n, state.incidentRay, state.intersection), secondaryGatherEpsilon, state.pixel, state.weight, false}, gathers);
+        }
+    }
+}
+
+//Traces every extension ray, then turns each hit into the next vertex. A
+//path that misses everything ends with nothing added
+void PhotonMap::ExtendPaths(vector<PathExtension>& extensions, Scene& scene, vector<PathState>& states, vector<GatherRequest>& gathers) {
+    vector<Intersection> hits(extensions.size());
+    vector<char> hit(extensions.size());
+    #pragma omp parallel for schedule(dynamic, 64)
+    for (int e = 0 ; e < extensions.size() ; e++) {
+        hit[e] = extensions[e].ray.closestIntersection(scene, hits[e]);
+    }
+
+    for (int e = 0 ; e < extensions.size() ; e++) {
+        if (!hit[e]) continue;
+        PathExtension& extension = extensions[e];
+        Material& material = scene.getMaterial(hits[e].index);
+        float weight = extension.weight;
+        float gatherWeight = 0;
+        if (extension.gatherAtHit) {
+            gatherWeight = weight * (1 - material.getReflectRatio());
+            weight *= material.getReflectRatio();
+        }
+        if (EndsPath(material, extension.depth, MAX_PATH_DEPTH)) {
+            //The vertex would only gather here again, so its share goes in
+            //with this gather instead
+            PushGather({hits[e], FootprintPhotons(getNumNearestPhotons(), extension.ray, hits[e]), secondaryGatherEpsilon, extension.pixel, gatherWeight + weight, false}, gathers);
+            continue;
+        }
+        if (extension.gatherAtHit) {
+            PushGather({hits[e], FootprintPhotons(getNumNearestPhotons(), extension.ray, hits[e]), secondaryGatherEpsilon, extension.pixel, gatherWeight, false}, gathers);
+        }
+        if (extension.depth <= MAX_PATH_DEPTH) {
+            states.push_back({hits[e], extension.ray, extension.depth, extension.transmitted, extension.pixel, weight});
+        }
+    }
+}
+
+//Secondary gathers take n photons over the square of how many times wider
+//the ray's cone is at the hit than a camera pixel's footprint would be after
+//the same length of path, down to MIN_FOOTPRINT_PHOTONS. Cones no wider, as
+//after flat mirrors, keep all n
+int PhotonMap::FootprintPhotons(int n, Ray& ray, const Intersection& hit) {
+    if (pixelSpread <= 0) return n;
+    float travelled = glm::distance(vec3(ray.getStart()), vec3(hit.position));
+    float width = fabs(ray.getConeWidth() + ray.getConeSpread() * travelled);
+    float pixelWidth = pixelSpread * (ray.getConePath() + travelled);
+    if (width <= pixelWidth) return n;
+    float growth = width / pixelWidth;
+    return glm::max(glm::min(n, MIN_FOOTPRINT_PHOTONS), (int) (n / (growth * growth) + 0.5f));
+}
+
+//Whether a path reaching a surface of this material at depth ends there with
+//one surface estimate, as a diffuse surface does short of the depth limit
+bool PhotonMap::EndsPath(Material& material, int depth, int maxDepth) {
+    return !material.isReflective() && !material.isTransparent() && depth <= maxDepth;
+}
+
+//Whether a branch or estimate scaled by weight is still worth its cost. Below
+//the cutoff it is dropped, or with Russian roulette kept with probability
+//weight / pathCutoff and scaled up by its inverse so the pixel comes out the
+//same on average
+bool PhotonMap::ContinuePath(float weight, float& scale, long& saved) {
+    scale = 1.0f;
+    if (weight >= pathCutoff) return true;
+    if (russianRoulette && weight > 0) {
+        float survival = weight / pathCutoff;
+        if (Random() < survival) {
+            scale = 1.0f / survival;
+            return true;
+        }
+    }
+    #pragma omp atomic
+    saved++;
+    return false;
+}
+
+//Marsaglia's xorshift. The state is never 0, which it would stay at
+float PhotonMap::Random() {
+    unsigned int& state = randomStates[omp_get_thread_num() % randomStates.size()];
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return (state >> 8) * (1.0f / 16777216.0f);
+}
+
+//FNV-1a over the bits of the position's coordinates
+void PhotonMap::SeedRandom(vec4 position) {
+    unsigned int hash = 2166136261u;
+    for (int i = 0 ; i < 3 ; i++) {
+        unsigned int bits;
+        memcpy(&bits, &position[i], sizeof(bits));
+        hash = (hash ^ bits) * 16777619u;
+    }
+    randomStates[omp_get_thread_num() % randomStates.size()] = hash != 0 ? hash : 1u;
+}
+
+void PhotonMap::PushExtension(PathExtension extension, vector<PathExtension>& extensions) {
+    float scale;
+    if (!ContinuePath(extension.weight, scale, pathsCut)) return;
+    extension.weight *= scale;
+    extensions.push_back(extension);
+}
+
+void PhotonMap::PushGather(GatherRequest gather, vector<GatherRequest>& gathers) {
+    float scale;
+    if (!ContinuePath(gather.weight, scale, gathersSaved)) return;
+    gather.weight *= scale;
+    gathers.push_back(gather);
+}
+
 KDTree * PhotonMap::GetGlobalPhotonsPointer(){
     return kdGlobalTraced[0];
 }
@@ -373,3 +845,63 @@ KDTree * PhotonMap::GetGlobalPhotonsPointer(){
 int PhotonMap::getNumNearestPhotons() {
     return numNearestPhotons;
 }
+
+int PhotonMap::getNumStoredPhotons() {
+    return numStoredPhotons;
+}
+
+ShadowPhotons& PhotonMap::getShadowPhotons() {
+    return shadowPhotons;
+}
+
+void PhotonMap::setGatherEpsilon(float gatherEpsilon, float secondaryGatherEpsilon) {
+    this->gatherEpsilon = gatherEpsilon;
+    this->secondaryGatherEpsilon = secondaryGatherEpsilon;
+}
+
+void PhotonMap::setAdaptiveNearestPhotons(int minNearestPhotons, int maxNearestPhotons, float densityRadius) {
+    this->adaptiveNearestPhotons = true;
+    this->minNearestPhotons = minNearestPhotons;
+    this->maxNearestPhotons = maxNearestPhotons;
+    this->densityRadius = densityRadius;
+}
+
+void PhotonMap::setRayCones(float pixelSpread) {
+    this->pixelSpread = pixelSpread;
+}
+
+void PhotonMap::useIrradianceCache(IrradianceCache * irradianceCache) {
+    this->irradianceCache = irradianceCache;
+}
+
+void PhotonMap::setFinalGather(int rays) {
+    finalGatherRays = rays;
+}
+
+void PhotonMap::setPathCutoff(float pathCutoff, bool russianRoulette) {
+    this->pathCutoff = pathCutoff;
+    this->russianRoulette = russianRoulette;
+}
+
+void PhotonMap::getPathsSaved(long& paths, long& gathers) {
+    paths = pathsCut;
+    gathers = gathersSaved;
+}
+
+void PhotonMap::resetPathsSaved() {
+    pathsCut = 0;
+    gathersSaved = 0;
+}
+
+long PhotonMap::getNumGathers() {
+    return numGathers;
+}
+
+long PhotonMap::getNumGatheredPhotons() {
+    return numGatheredPhotons;
+}
+
+void PhotonMap::resetNumGathers() {
+    numGathers = 0;
+    numGatheredPhotons = 0;
+}
@@ -3,12 +3,18 @@
 
 #include <glm/glm.hpp>
 #include <vector>
+#include <map>
 
 #include "Light.h"
 #include "Photon.h"
 #include "LightSphere.h"
+#include "LightTree.h"
+#include "EmissiveShapes.h"
+#include "ShadowPhotons.h"
+#include "IrradianceCache.h"
 #include "Ray.h"
 #include "KDTree.h"
+#include "Scene.h"
 
 using namespace std;
 using glm::vec3;
@@ -16,36 +22,207 @@ using glm::mat3;
 using glm::vec4;
 using glm::mat4;
 
+// Largest radius a photon gather will widen to
+#define MAX_GATHER_RADIUS 0.5f
+
+// Deepest reflected or refracted path vertex that is still shaded
+#define MAX_PATH_DEPTH 8
+
+// Fewest photons a secondary gather takes however wide its ray cone. Density
+// estimates from fewer are too often far off
+#define MIN_FOOTPRINT_PHOTONS 8
+
+// A camera ray's first hit, shaded by RadianceEstimates into colours[pixel]
+// scaled by weight
+struct PathStart {
+    Intersection intersection;
+    Ray incidentRay;
+    int pixel;
+    float weight;
+};
+
+// A vertex of a reflected or refracted path waiting to be shaded. It stands
+// for a call to ReflectiveSurfaceEstimate, or TransmissiveSurfaceEstimate if
+// transmitted is set, whose result is scaled by weight
+struct PathState {
+    Intersection intersection;
+    Ray incidentRay;
+    int depth;
+    bool transmitted;
+    int pixel;
+    float weight;
+};
+
+// A ray leaving a path vertex. Its hit becomes the next vertex, after a
+// surface estimate there if gatherAtHit is set
+struct PathExtension {
+    Ray ray;
+    int depth;
+    bool transmitted;
+    bool gatherAtHit;
+    int pixel;
+    float weight;
+};
+
+// A SpecDiffSurfaceEstimate to be added to colours[pixel] scaled by weight,
+// or a PrimarySurfaceEstimate if primary is set
+struct GatherRequest {
+    Intersection intersection;
+    int n;
+    float epsilon;
+    int pixel;
+    float weight;
+    bool primary;
+};
+
 class PhotonMap {
 
     private:
-        LightSphere ls = LightSphere(vec4(0), 0, 0, vec3(0), vec3(0), vec3(0), 0.0f);
         int initial_photon_count;
         vector<KDTree *> kdGlobalTraced;
         int numNearestPhotons;
+        // Photons held in the kd tree, one for each surface a photon was
+        // stored on
+        int numStoredPhotons = 0;
+
+        // Adaptive photon gathering: choose k per point from the local photon density
+        bool adaptiveNearestPhotons = false;
+        int minNearestPhotons = 0;
+        int maxNearestPhotons = 0;
+        float densityRadius = 0.0f;
 
-        void GeneratePhotonsFromPointLight(Light light, vector<Photon>& photons, int numPhotons, int offset);
-        void GeneratePhotonsFromLightSphere(vector<Photon>& photons);
-        void TracePhotons(vector<Photon> initial_photons, vector<Photon>& globalPhotons, vector<Shape *> shapes);
+        // Approximation bound for the nearest photon search at primary hits
+        // and at the vertices of reflected / refracted paths (0 = exact)
+        float gatherEpsilon = 0.0f;
+        float secondaryGatherEpsilon = 0.0f;
+
+        // Direct and shadow photons, if asked for when the map was built
+        ShadowPhotons shadowPhotons;
+
+        // Reflected and refracted paths end, and surface estimates are left
+        // out, once their share of the pixel falls below pathCutoff, or with
+        // Russian roulette only survive in proportion to it (0 = never)
+        float pathCutoff = 0.0f;
+        bool russianRoulette = false;
+        long pathsCut = 0;
+        long gathersSaved = 0;
+
+        // Photon gathers made since the last reset, and the photons they
+        // asked for
+        long numGathers = 0;
+        long numGatheredPhotons = 0;
+
+        // Spread of a camera ray's cone, which secondary gathers size
+        // themselves against (0 = always gather the full number)
+        float pixelSpread = 0.0f;
+
+        // Per thread, the radius the last gather of each size ended with,
+        // which the next one starts its search from
+        vector<map<int, float> > radiusHints;
+
+        // Per thread, the state of the generator Random draws from. Each
+        // shading point reseeds it with SeedRandom, so what it draws does not
+        // depend on which thread shades it or what that thread did before
+        vector<unsigned int> randomStates;
+
+        // Diffuse estimates are looked up in and added to this cache, if set
+        IrradianceCache * irradianceCache = nullptr;
+
+        // Rays cast from each primary diffuse hit by final gathering (0 =
+        // the photon map is shown directly)
+        int finalGatherRays = 0;
+
+        int FootprintPhotons(int n, Ray& ray, const Intersection& hit);
+        bool ContinuePath(float weight, float& scale, long& saved);
+        // A number in [0, 1) from the calling thread's generator
+        float Random();
+        // Restarts the calling thread's generator from a shading point
+        void SeedRandom(vec4 position);
+        static bool EndsPath(Material& material, int depth, int maxDepth);
+        void PushExtension(PathExtension extension, vector<PathExtension>& extensions);
+        void PushGather(GatherRequest gather, vector<GatherRequest>& gathers);
+        void BuildMap(LightTree& lights, EmissiveShapes& emitters, int initial_photon_count, int numNearestPhotons, Scene& scene, bool traceShadowPhotons);
+        void GeneratePhotonsFromLights(LightTree& lights, vector<Photon>& photons, int numPhotons);
+        void GeneratePhotonsFromEmitters(EmissiveShapes& emitters, vector<Photon>& photons, int offset, int numPhotons);
+        void TracePhotons(vector<Photon> initial_photons, vector<Photon>& globalPhotons, vector<Photon> * shadowPhotons, Scene& scene);
+        void ShadePathStart(int n, PathStart& start, Scene& scene, vector<PathState>& states, vector<GatherRequest>& gathers);
+        void ShadePathStates(int n, vector<PathState>& states, Scene& scene, vector<PathExtension>& extensions, vector<GatherRequest>& gathers);
+        void ExtendPaths(vector<PathExtension>& extensions, Scene& scene, vector<PathState>& states, vector<GatherRequest>& gathers);
 
     public:
         // CONSTRUCTOR
-        PhotonMap(LightSphere ls, int total_photon_count, int numNearestNeighbours, vector<Shape *> shapes);
+        PhotonMap(LightSphere ls, int total_photon_count, int numNearestNeighbours, Scene& scene);
+        // Photons are shared between the lights in proportion to their power
+        PhotonMap(LightTree& lights, int total_photon_count, int numNearestNeighbours, Scene& scene);
+        // Emissive shapes send photons too, shared with the lights by power
+        PhotonMap(LightTree& lights, EmissiveShapes& emitters, int total_photon_count, int numNearestNeighbours, Scene& scene);
+        // With traceShadowPhotons set, each photon's first hit also casts
+        // shadow photons behind it, for getShadowPhotons
+        PhotonMap(LightTree& lights, EmissiveShapes& emitters, int total_photon_count, int numNearestNeighbours, Scene& scene, bool traceShadowPhotons);
 
         // GETTERS
         KDTree * GetGlobalPhotonsPointer();
         int getNumNearestPhotons();
+        int getNumStoredPhotons();
+        ShadowPhotons& getShadowPhotons();
 
         // SETTERS
+        void setGatherEpsilon(float gatherEpsilon, float secondaryGatherEpsilon);
+        void setAdaptiveNearestPhotons(int minNearestPhotons, int maxNearestPhotons, float densityRadius);
+        void setPathCutoff(float pathCutoff, bool russianRoulette);
+        // Gather fewer photons where reflected or refracted rays' cones have
+        // grown wider than a camera pixel's footprint, which spreads by
+        // pixelSpread. Camera rays must carry their cones
+        void setRayCones(float pixelSpread);
+        // Reuse diffuse estimates through an irradiance cache (nullptr = off)
+        void useIrradianceCache(IrradianceCache * irradianceCache);
+        // Shade primary diffuse hits by final gathering with about rays rays,
+        // rounded down to a square (0 = off). Gathered frames come out
+        // brighter than the map shown directly (see FinalGather)
+        void setFinalGather(int rays);
+
+        // Reflected and refracted branches the path cutoff has ended, and
+        // surface estimates it has left out, since the last reset
+        void getPathsSaved(long& paths, long& gathers);
+        void resetPathsSaved();
+
+        // Photon gathers made by the surface estimates since the last reset
+        long getNumGathers();
+        long getNumGatheredPhotons();
+        void resetNumGathers();
 
         //Public Functions
-        vec3 RadianceEstimate(int n, Intersection intersection, vector<Shape *> shapes, Ray incidentRay, Camera camera, LightSphere ls);
-        vec3 DiffuseSurfaceEstimate(int n, Intersection intersection, vector<Shape *> shapes);
-        vec3 SpecularSurfaceEstimate(Intersection intersection, vector<Shape *> shapes, Camera camera, LightSphere ls);
-        vec3 SpecDiffSurfaceEstimate(int n, Intersection intersection, vector<Shape *> shapes, Camera camera, LightSphere ls);
-        vec3 ReflectiveSurfaceEstimate(const Intersection i, Ray incidentRay, vector<Shape *> shapes, const int rayDepth, int depth, vec3 hitColour, int n, Camera camera, LightSphere ls);
-        vec3 TransmissiveSurfaceEstimate(const Intersection i, Ray incidentRay, vector<Shape *> shapes, const int rayDepth, int depth, vec3 hitColour, int n, Camera camera, LightSphere ls);
+        vec3 RadianceEstimate(int n, Intersection intersection, Scene& scene, Ray incidentRay, Camera camera, LightSphere ls);
+
+        // RadianceEstimate for a whole batch of camera rays, run a stage at a
+        // time over queues of path states rather than recursing one ray at a
+        // time: shade every vertex by material, trace every reflected and
+        // refracted ray, then make every photon gather. colours must already
+        // hold an entry for each pixel the starts refer to
+        void RadianceEstimates(int n, vector<PathStart>& starts, Scene& scene, Camera camera, LightSphere ls, vector<vec3>& colours);
+        vector<Photon> GatherPhotons(int n, vec4 position, float epsilon);
+        vec3 DiffuseSurfaceEstimate(int n, Intersection intersection, Scene& scene, float epsilon);
+        vec3 SpecularSurfaceEstimate(Intersection intersection, Scene& scene, Camera camera, LightSphere ls);
+        vec3 SpecDiffSurfaceEstimate(int n, Intersection intersection, Scene& scene, Camera camera, LightSphere ls, float epsilon);
+        // The surface estimate at a camera ray's first hit: SpecDiffSurfaceEstimate,
+        // with FinalGather in place of the diffuse estimate when set
+        vec3 PrimarySurfaceEstimate(int n, Intersection intersection, Scene& scene, Camera camera, LightSphere ls);
+        // Diffuse estimate at a primary hit that takes only direct and caustic
+        // light from the photons there, and the rest from photon estimates
+        // where stratified, cosine weighted rays from it land
+        vec3 FinalGather(int n, Intersection intersection, Scene& scene, Camera camera);
+        // throughput is the share of the pixel the estimate is scaled by
+        vec3 ReflectiveSurfaceEstimate(const Intersection i, Ray incidentRay, Scene& scene, const int rayDepth, int depth, vec3 hitColour, int n, Camera camera, LightSphere ls, float throughput);
+        vec3 TransmissiveSurfaceEstimate(const Intersection i, Ray incidentRay, Scene& scene, const int rayDepth, int depth, vec3 hitColour, int n, Camera camera, LightSphere ls, float throughput);
         float CalculateGaussianFilter(float dp, float r);
+        // The filter's derivative with respect to distance, over the distance
+        float CalculateGaussianFilterSlope(float dp, float r);
+        // Change in a DiffuseSurfaceEstimate made from photons within r of
+        // the intersection per unit move of the intersection along x, y and z
+        mat3 DiffuseSurfaceGradient(vector<Photon>& photons, Intersection& intersection, Scene& scene, float r);
+        // DiffuseSurfaceEstimate from the direct and caustic photons alone
+        // among the n nearest
+        vec3 DirectSurfaceEstimate(int n, Intersection intersection, Scene& scene, float epsilon);
         bool ContainedInSphere(vec4 p, float r);
 };
 
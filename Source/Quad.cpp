@@ -0,0 +1,84 @@
+#include "Quad.h"
+#include "ImageBuffer.h" // For SCREEN_HEIGHT
+
+// Constructor
+Quad::Quad(vec4 v0, vec4 v1, vec4 v2, Material material) : Shape(material) {
+    setCorners(v0, v1, v2);
+}
+
+float Quad::Distance(const vec3& v0, const vec3& normal, const vec3& uAxis, const vec3& vAxis, const vec3& start, const vec3& dir) {
+    float denominator = dot(normal, dir);
+    if (denominator == 0.0f) return -1.0f;
+    float t = dot(normal, v0 - start) / denominator;
+    if (t < 0.0f) return -1.0f;
+
+    vec3 offset = start + t * dir - v0;
+    float u = dot(uAxis, offset);
+    float v = dot(vAxis, offset);
+    return u >= 0.0f && u <= 1.0f && v >= 0.0f && v <= 1.0f ? t : -1.0f;
+}
+
+//Check if a ray or photon intersects with the quad
+bool Quad::intersects(vec4 start, vec4 dir, Intersection & intersection, int index) {
+    dir = vec4(vec3(dir) * (float)SCREEN_HEIGHT, 1);
+
+    float t = Distance(vec3(v0), vec3(normal), uAxis, vAxis, vec3(start), vec3(dir));
+    if (t >= 0.0f && t < intersection.distance) {
+        intersection.position = start + t * dir;
+        intersection.distance = t;
+        intersection.index = index;
+        intersection.normal = normal;
+        return true;
+    }
+    return false;
+}
+
+AABB Quad::getBoundingBox() {
+    AABB box;
+    box.grow(vec3(v0));
+    box.grow(vec3(v1));
+    box.grow(vec3(v2));
+    box.grow(vec3(v1 + v2 - v0));
+    return box;
+}
+
+// Getters
+vec4 Quad::getV0() {
+    return v0;
+}
+
+vec4 Quad::getV1() {
+    return v1;
+}
+
+vec4 Quad::getV2() {
+    return v2;
+}
+
+vec4 Quad::getNormal() {
+    return normal;
+}
+
+vec3 Quad::getUAxis() {
+    return uAxis;
+}
+
+vec3 Quad::getVAxis() {
+    return vAxis;
+}
+
+// Setters
+//The normal is worked out as Triangle::computeAndSetNormal. Crossing each
+//edge with the plane's normal gives the vector perpendicular to the other
+//edge whose dot product with this edge is one
+void Quad::setCorners(vec4 v0, vec4 v1, vec4 v2) {
+    this->v0 = v0;
+    this->v1 = v1;
+    this->v2 = v2;
+    vec3 e1 = vec3(v1 - v0);
+    vec3 e2 = vec3(v2 - v0);
+    vec3 n = cross(e1, e2);
+    normal = vec4(normalize(-n), 1.0f);
+    uAxis = cross(e2, n) / dot(n, n);
+    vAxis = cross(n, e1) / dot(n, n);
+}
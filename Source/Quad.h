@@ -0,0 +1,45 @@
+#ifndef QUAD_H
+#define QUAD_H
+
+#include "Shape.h"
+
+// A flat parallelogram, such as a wall, tested as one plane intersection
+// rather than as two triangles
+class Quad : public Shape {
+
+    private:
+        vec4 v0;
+        vec4 v1;
+        vec4 v2;
+        vec4 normal;
+        // Dual edge vectors: the point v0 + u e1 + v e2 gives u and v back
+        // as its dot products with uAxis and vAxis
+        vec3 uAxis;
+        vec3 vAxis;
+
+    public:
+        // Constructor. The quad has corners v0, v1, v2 and v1 + v2 - v0, so
+        // is the triangle (v0, v1, v2) doubled, and faces the same way
+        Quad(vec4 v0, vec4 v1, vec4 v2, Material material);
+
+        // Distance along dir to the quad's plane, if the point reached there
+        // lies inside the quad, or -1
+        static float Distance(const vec3& v0, const vec3& normal, const vec3& uAxis, const vec3& vAxis, const vec3& start, const vec3& dir);
+
+        using Shape::intersects;
+        bool intersects(vec4 start, vec4 dir, Intersection & intersection, int index);
+        AABB getBoundingBox();
+
+        // Getters
+        vec4 getV0();
+        vec4 getV1();
+        vec4 getV2();
+        vec4 getNormal();
+        vec3 getUAxis();
+        vec3 getVAxis();
+
+        // Setters
+        // Moves the quad to the given corners, as the constructor
+        void setCorners(vec4 v0, vec4 v1, vec4 v2);
+};
+#endif
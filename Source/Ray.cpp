@@ -1,5 +1,6 @@
 #include "Ray.h"
 #include "Shape.h"
+#include "Scene.h"
 #include "Triangle.h"
 
 #include <iostream>
@@ -9,6 +10,7 @@ Ray::Ray(vec4 start, vec4 direction) {
     vec3 dir3 = normalize(vec3(direction));
     setDirection(vec4(dir3, 1));
     //setDirection(direction);
+    setCone(0, 0, 0);
 }
 
 bool Ray::closestIntersection(vector<Shape *> shapes, Intersection& closestIntersection) {
@@ -22,6 +24,11 @@ bool Ray::closestIntersection(vector<Shape *> shapes, Intersection& closestInter
     return returnVal;
 }
 
+//Finds the closest intersection for a ray using the scene's BVH
+bool Ray::closestIntersection(Scene& scene, Intersection& closestIntersection) {
+    return scene.closestIntersection(getStart(), getDirection(), closestIntersection);
+}
+
 // Rotate a ray by "yaw"
 void Ray::rotateRay(float yaw) {
     mat4 R = mat4(1.0);
@@ -40,10 +47,10 @@ vec4 Ray::ReflectRay(const vec4 normal) {
 }
 
 //Returns the direction of a refracted ray
-vec4 Ray::RefractLightRay(const Intersection i, vector<Shape *> shapes){
+vec4 Ray::RefractLightRay(const Intersection i, Scene& scene){
 
-    //Get the shape and its normal
-    Shape *  shape = shapes[i.index];
+    //Get the material and normal
+    Material& material = scene.getMaterial(i.index);
     vec4 dir4 = getDirection();
     vec4 N4 = i.normal;
 
@@ -52,7 +59,7 @@ vec4 Ray::RefractLightRay(const Intersection i, vector<Shape *> shapes){
 
     //Find and define the refractive indices
     float etai = 1.0f;
-    float etat = shape->getMaterial().getRefractiveIndex();
+    float etat = material.getRefractiveIndex();
 
     vec3 transmittedRayDir = vec3(0.0f,0.0f,0.0f);
 
@@ -91,14 +98,38 @@ vec4 Ray::RefractLightRay(const Intersection i, vector<Shape *> shapes){
     return transmittedRayDir4;
 }
 
+//The cone widens by its spread over the distance to i. A surface of curvature
+//k tilts the normal across a footprint of width w by about k w, which turns a
+//reflected cone by twice that and a refracted one by (1 - eta) times that,
+//spreading it where the surface bulges towards the ray and focusing it where
+//it curves away. A refracted cone's spread also scales by eta
+void Ray::BounceCone(Ray& next, const Intersection i, Scene& scene, bool refracted) {
+    float travelled = glm::distance(vec3(start), vec3(i.position));
+    float width = coneWidth + coneSpread * travelled;
+    float curvature = scene.getCurvature(i.index);
+    bool outside = dot(vec3(direction), vec3(i.normal)) < 0;
+    if (!outside) curvature = -curvature;
+
+    float spread;
+    if (!refracted) {
+        spread = coneSpread + 2.0f * curvature * fabs(width);
+    } else {
+        //As RefractLightRay picks the indices
+        float eta = 1.0f / scene.getMaterial(i.index).getRefractiveIndex();
+        if (!outside) eta = 1.0f / eta;
+        spread = eta * coneSpread - (1.0f - eta) * curvature * fabs(width);
+    }
+    next.setCone(width, spread, conePath + travelled);
+}
+
 //Returns the fresnel ratio of reflected light
-float Ray::FresnelRatio(const Intersection i, vector<Shape *> shapes){
+float Ray::FresnelRatio(const Intersection i, Scene& scene){
 
     //Define the reflected light Ratio
     float FR = 0.5f;
 
-    //Get the shape and its normal
-    Shape * shape = shapes[i.index];
+    //Get the material and normal
+    Material& material = scene.getMaterial(i.index);
     vec4 dir4 = getDirection();
     vec4 N4 = i.normal;
 
@@ -106,7 +137,7 @@ float Ray::FresnelRatio(const Intersection i, vector<Shape *> shapes){
     vec3 N(N4[0], N4[1], N4[2]);
 
     //Find and define the refractive indices
-    float etat = 1.0, etai = shape->getMaterial().getRefractiveIndex();
+    float etat = 1.0, etai = material.getRefractiveIndex();
 
     float NdotI = dot(normalize(N), normalize(dir));
 
@@ -165,6 +196,18 @@ vec4 Ray::getStart() {
     return start;
 }
 
+float Ray::getConeWidth() {
+    return coneWidth;
+}
+
+float Ray::getConeSpread() {
+    return coneSpread;
+}
+
+float Ray::getConePath() {
+    return conePath;
+}
+
 vec4 Ray::getDirection() {
     float lngth = length(vec3(direction));
     return direction;
@@ -178,3 +221,9 @@ void Ray::setStart(vec4 start) {
 void Ray::setDirection(vec4 dir) {
     this->direction = dir;
 }
+
+void Ray::setCone(float width, float spread, float path) {
+    coneWidth = width;
+    coneSpread = spread;
+    conePath = path;
+}
@@ -14,6 +14,7 @@ using glm::mat4;
 
 class Shape;
 class Triangle;
+class Scene;
 
 // Intersection struct
 struct Intersection {
@@ -23,18 +24,39 @@ struct Intersection {
     int index;
 };
 
+// Primary rays are traced in square tiles of RAY_PACKET_WIDTH pixels a side
+#define RAY_PACKET_WIDTH 4
+#define RAY_PACKET_SIZE (RAY_PACKET_WIDTH * RAY_PACKET_WIDTH)
+
+// Up to RAY_PACKET_SIZE rays sharing a start point, traced through the scene
+// together. Directions are unit length like a Ray's
+struct RayPacket {
+    vec4 start;
+    vec4 dir[RAY_PACKET_SIZE];
+    int count;
+};
+
 class Ray {
 
     private:
         vec4 start;
         vec4 direction;
 
+        // Ray cone, after Akenine-Moller et al.: the width of the pixel's
+        // footprint at start, the angle it spreads by per unit distance and
+        // the length of the path it has come along from the eye. All are 0
+        // for rays without one
+        float coneWidth;
+        float coneSpread;
+        float conePath;
+
     public:
         // Constructor
         Ray(vec4 start, vec4 direction);
 
         // Get the closest intersection for this ray (circle or triangle)
         bool closestIntersection(vector<Shape *> shapes, Intersection& closestIntersection);
+        bool closestIntersection(Scene& scene, Intersection& closestIntersection);
 
         // Cramer
         bool Cramer(mat3 A, vec3 b, vec3& solution);
@@ -46,20 +68,29 @@ class Ray {
         vec4 ReflectRay(const vec4 normal);
 
         // Refract a light ray and return its direction
-        vec4 RefractLightRay(const Intersection i, vector<Shape *> shapes);
+        vec4 RefractLightRay(const Intersection i, Scene& scene);
 
         //Calculates the fresnel ratio for a ray at a given intersection
-        float FresnelRatio(const Intersection i, vector<Shape *> shapes);
+        float FresnelRatio(const Intersection i, Scene& scene);
+
+        // Gives next, leaving the surface this ray hits at i, this ray's cone
+        // carried on to i and reflected or refracted there. Curved surfaces
+        // spread or focus it
+        void BounceCone(Ray& next, const Intersection i, Scene& scene, bool refracted);
 
         vector<Ray> SuperSamplePixel(int samples);
 
         // Getters
         vec4 getStart();
         vec4 getDirection();
+        float getConeWidth();
+        float getConeSpread();
+        float getConePath();
 
         // Setters
         void setStart(vec4 start);
         void setDirection(vec4 direction);
+        void setCone(float width, float spread, float path);
 };
 
 #endif
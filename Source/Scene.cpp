@@ -0,0 +1,1527 @@
+#include "Scene.h"
+#include "Triangle.h"
+#include "Sphere.h"
+#include "Quad.h"
+#include "Box.h"
+#include "ImageBuffer.h" // For SCREEN_HEIGHT
+
+#include <algorithm>
+#include <iostream>
+#include <fstream>
+#include <cstring>
+#include <cstdio>
+#include <omp.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Scene cache file format. Bump the version whenever the meaning of a section
+// changes; changes to a record's size are caught by recordSizes regardless
+#define SCENE_CACHE_MAGIC "RTSCENE"
+#define SCENE_CACHE_VERSION 2
+// Sections start on cache line boundaries so they can be read in place
+#define SCENE_CACHE_ALIGNMENT 64
+
+enum SceneCacheSectionId {
+    CACHE_MATERIALS,
+    CACHE_MATERIAL_INDEX,
+    CACHE_MESH_OFFSETS,
+    CACHE_BVH_NODES,
+    CACHE_BVH_PRIMITIVES,
+    CACHE_TRIANGLE_PACKETS,
+    CACHE_TRIANGLE_SHAPES,
+    CACHE_SPHERE_CENTRES,
+    CACHE_SPHERE_RADII,
+    CACHE_SPHERE_SHAPES,
+    CACHE_QUAD_CORNERS,
+    CACHE_QUAD_NORMALS,
+    CACHE_QUAD_U_AXES,
+    CACHE_QUAD_V_AXES,
+    CACHE_QUAD_SHAPES,
+    CACHE_BOX_CORNERS,
+    CACHE_BOX_FRAMES,
+    CACHE_BOX_SHAPES,
+    NUM_CACHE_SECTIONS
+};
+
+// Byte range of one array within the file
+struct SceneCacheSection {
+    uint64_t offset;
+    uint64_t bytes;
+};
+
+struct SceneCacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t numShapes;
+    uint64_t key;
+    uint32_t recordSizes[NUM_CACHE_SECTIONS];
+    SceneCacheSection sections[NUM_CACHE_SECTIONS];
+};
+
+// CONSTRUCTOR
+Scene::Scene() {
+    binnedBuild = true;
+    wide = false;
+    occluderCacheEnabled = true;
+    shadowPhotons = nullptr;
+}
+
+Scene::Scene(vector<Shape *> shapes, bool binnedBuild) : Scene(shapes, vector<Mesh *>(), binnedBuild) {
+}
+
+Scene::Scene(vector<Shape *> shapes, vector<Mesh *> meshes, bool binnedBuild) : Scene(shapes, meshes, vector<SceneInstance>(), binnedBuild) {
+}
+
+Scene::Scene(vector<Shape *> shapes, vector<Mesh *> meshes, vector<SceneInstance> instances, bool binnedBuild) {
+    this->shapes = shapes;
+    this->meshes = meshes;
+    this->binnedBuild = binnedBuild;
+
+    for (int i = 0 ; i < shapes.size() ; i++) {
+        materialIndex.push_back(AddMaterial(shapes[i]->getMaterial()));
+    }
+
+    //Mesh faces follow the shapes, each mesh's in one contiguous block
+    for (int m = 0 ; m < meshes.size() ; m++) {
+        meshOffsets.push_back(materialIndex.size());
+        vector<int> meshMaterials;
+        for (int k = 0 ; k < meshes[m]->getNumMaterials() ; k++) {
+            meshMaterials.push_back(AddMaterial(meshes[m]->getMaterial(k)));
+        }
+        for (int f = 0 ; f < meshes[m]->getNumFaces() ; f++) {
+            materialIndex.push_back(meshMaterials[meshes[m]->getFaceMaterial(f)]);
+        }
+    }
+
+    int numPrimitives = materialIndex.size();
+    for (int i = 0 ; i < instances.size() ; i++) {
+        InstanceRecord record;
+        record.object = instances[i].object;
+        SetTransform(record, instances[i].transform);
+        this->instances.push_back(record);
+        instanceOffsets.push_back(numPrimitives);
+        numPrimitives += record.object->getNumPrimitives();
+    }
+
+    wide = false;
+    occluderCacheEnabled = true;
+    shadowPhotons = nullptr;
+    BuildPrimitives();
+    if (!instances.empty()) {
+        BuildInstances();
+    }
+}
+
+//Builds the BVH over the shapes and mesh faces where they are now, and lays
+//them out for tracing
+void Scene::BuildPrimitives() {
+    //Sort the primitives by type, triangles are numbered before the other
+    //shapes, which are numbered spheres, then quads, then boxes
+    vector<int> trianglePrimitives;
+    vector<int> otherShapes;
+    for (int i = 0 ; i < shapes.size() ; i++) {
+        if (ShapeKind(shapes[i]) == TRIANGLE_PRIMITIVE) {
+            trianglePrimitives.push_back(i);
+        }
+    }
+    for (int kind = SPHERE_PRIMITIVE ; kind <= BOX_PRIMITIVE ; kind++) {
+        for (int i = 0 ; i < shapes.size() ; i++) {
+            if (ShapeKind(shapes[i]) == kind) otherShapes.push_back(i);
+        }
+    }
+    for (int m = 0 ; m < meshes.size() ; m++) {
+        for (int f = 0 ; f < meshes[m]->getNumFaces() ; f++) {
+            trianglePrimitives.push_back(meshOffsets[m] + f);
+        }
+    }
+
+    vector<AABB> boxes;
+    for (int i = 0 ; i < trianglePrimitives.size() ; i++) {
+        vec3 v0, v1, v2;
+        TriangleVertices(trianglePrimitives[i], v0, v1, v2);
+        AABB box;
+        box.grow(v0);
+        box.grow(v1);
+        box.grow(v2);
+        boxes.push_back(box);
+    }
+    for (int i = 0 ; i < otherShapes.size() ; i++) {
+        boxes.push_back(shapes[otherShapes[i]]->getBoundingBox());
+    }
+
+    double start = omp_get_wtime();
+    if (binnedBuild) {
+        bvh.BuildBinned(boxes);
+    } else {
+        bvh.Build(boxes);
+    }
+    double buildTime = omp_get_wtime() - start;
+
+    LayoutPrimitives(trianglePrimitives, otherShapes);
+    if (wide && !wideBVH.Build(bvh)) {
+        wide = false;
+    }
+
+    if (!materialIndex.empty() || instances.empty()) {
+        cout << "Built BVH with " << bvh.getNumNodes() << " nodes over " << materialIndex.size() << " primitives in "
+             << buildTime * 1000 << "ms, SAH cost " << bvh.SAHCost() << endl;
+    }
+}
+
+void Scene::BuildInstances() {
+    vector<AABB> instanceBoxes;
+    for (int i = 0 ; i < instances.size() ; i++) {
+        instanceBoxes.push_back(InstanceBounds(i));
+    }
+
+    double start = omp_get_wtime();
+    if (binnedBuild) {
+        instanceBVH.BuildBinned(instanceBoxes);
+    } else {
+        instanceBVH.Build(instanceBoxes);
+    }
+    cout << "Built top level BVH with " << instanceBVH.getNumNodes() << " nodes over " << instances.size() << " instances in "
+         << (omp_get_wtime() - start) * 1000 << "ms" << endl;
+}
+
+void Scene::SetTransform(InstanceRecord& record, mat4 transform) {
+    mat4 toObject = inverse(transform);
+    record.objectToWorld = glm::mat4x3(transform);
+    record.worldToObject = glm::mat4x3(toObject);
+    record.normalToWorld = transpose(mat3(toObject));
+}
+
+//The world box around the corners of the instanced scene's bounds
+AABB Scene::InstanceBounds(int instance) {
+    InstanceRecord& record = instances[instance];
+    AABB objectBounds = record.object->getBounds();
+    AABB box;
+    for (int c = 0 ; c < 8 ; c++) {
+        vec3 corner((c & 1) ? objectBounds.upper.x : objectBounds.lower.x,
+                    (c & 2) ? objectBounds.upper.y : objectBounds.lower.y,
+                    (c & 4) ? objectBounds.upper.z : objectBounds.lower.z);
+        box.grow(record.objectToWorld * vec4(corner, 1));
+    }
+    return box;
+}
+
+//Vertices of a triangle shape or mesh face
+void Scene::TriangleVertices(int primitive, vec3& v0, vec3& v1, vec3& v2) {
+    if (primitive < shapes.size()) {
+        Triangle * triangle = static_cast<Triangle *>(shapes[primitive]);
+        v0 = vec3(triangle->getV0());
+        v1 = vec3(triangle->getV1());
+        v2 = vec3(triangle->getV2());
+    } else {
+        int m = upper_bound(meshOffsets.begin(), meshOffsets.end(), primitive) - meshOffsets.begin() - 1;
+        meshes[m]->getFace(primitive - meshOffsets[m], v0, v1, v2);
+    }
+}
+
+//Returns the index of the material in the table, adding it if it is new
+int Scene::AddMaterial(Material material) {
+    for (int i = 0 ; i < materials.size() ; i++) {
+        if (materials[i].equals(material)) return i;
+    }
+    materials.push_back(material);
+    return materials.size() - 1;
+}
+
+//Copies the primitives into the triangle packets and the sphere, quad and box
+//buffers in the order the BVH leaves visit them, so a leaf is one contiguous
+//run of triangle slots followed by one each of spheres, quads and boxes. The
+//leaves are renumbered to index the buffers
+void Scene::LayoutPrimitives(vector<int>& trianglePrimitives, vector<int>& otherShapes) {
+    vector<BVHNode>& nodes = bvh.getNodes();
+    vector<int>& primitiveIndices = bvh.getPrimitiveIndices();
+    int numTriangles = trianglePrimitives.size();
+
+    vector<int> leaves;
+    for (int i = 0 ; i < nodes.size() ; i++) {
+        if (nodes[i].count > 0) leaves.push_back(i);
+    }
+    sort(leaves.begin(), leaves.end(), [&](int a, int b) { return nodes[a].leftFirst < nodes[b].leftFirst; });
+
+    //Each kind of shape takes the next entries of its own buffer, which
+    //follow on from the kinds before it
+    int numOfKind[BOX_PRIMITIVE + 1] = {};
+    for (int i = 0 ; i < otherShapes.size() ; i++) {
+        numOfKind[ShapeKind(shapes[otherShapes[i]])]++;
+    }
+    int nextOfKind[BOX_PRIMITIVE + 1];
+    nextOfKind[SPHERE_PRIMITIVE] = 0;
+    nextOfKind[QUAD_PRIMITIVE] = numOfKind[SPHERE_PRIMITIVE];
+    nextOfKind[BOX_PRIMITIVE] = nextOfKind[QUAD_PRIMITIVE] + numOfKind[QUAD_PRIMITIVE];
+
+    triangles = TrianglePackets();
+    spheres = SphereBuffer();
+    spheres.centre.resize(numOfKind[SPHERE_PRIMITIVE]);
+    spheres.radius.resize(numOfKind[SPHERE_PRIMITIVE]);
+    spheres.shapeIndex.resize(numOfKind[SPHERE_PRIMITIVE]);
+    quads = QuadBuffer();
+    quads.v0.resize(numOfKind[QUAD_PRIMITIVE]);
+    quads.normal.resize(numOfKind[QUAD_PRIMITIVE]);
+    quads.uAxis.resize(numOfKind[QUAD_PRIMITIVE]);
+    quads.vAxis.resize(numOfKind[QUAD_PRIMITIVE]);
+    quads.shapeIndex.resize(numOfKind[QUAD_PRIMITIVE]);
+    boxes = BoxBuffer();
+    boxes.v0.resize(numOfKind[BOX_PRIMITIVE]);
+    boxes.toLocal.resize(numOfKind[BOX_PRIMITIVE]);
+    boxes.shapeIndex.resize(numOfKind[BOX_PRIMITIVE]);
+
+    for (int l = 0 ; l < leaves.size() ; l++) {
+        vector<int>::iterator begin = primitiveIndices.begin() + nodes[leaves[l]].leftFirst;
+        vector<int>::iterator end = begin + nodes[leaves[l]].count;
+        vector<int>::iterator firstOther = stable_partition(begin, end, [&](int p) { return p < numTriangles; });
+        //The other shapes were numbered in kind order
+        sort(firstOther, end);
+
+        vector<vec3> run;
+        vector<int> runPrimitives;
+        for (vector<int>::iterator it = begin ; it != firstOther ; it++) {
+            vec3 v0, v1, v2;
+            TriangleVertices(trianglePrimitives[*it], v0, v1, v2);
+            run.push_back(v0);
+            run.push_back(v1);
+            run.push_back(v2);
+            runPrimitives.push_back(trianglePrimitives[*it]);
+        }
+        if (!runPrimitives.empty()) {
+            int slot = triangles.AddRun(run, runPrimitives);
+            for (vector<int>::iterator it = begin ; it != firstOther ; it++) {
+                *it = slot++;
+            }
+        }
+
+        for (vector<int>::iterator it = firstOther ; it != end ; it++) {
+            int shapeIndex = otherShapes[*it - numTriangles];
+            *it = -1 - nextOfKind[ShapeKind(shapes[shapeIndex])]++;
+            StoreShape(*it, shapeIndex);
+        }
+    }
+}
+
+PrimitiveKind Scene::ShapeKind(Shape * shape) {
+    if (dynamic_cast<Sphere *>(shape)) return SPHERE_PRIMITIVE;
+    if (dynamic_cast<Quad *>(shape)) return QUAD_PRIMITIVE;
+    if (dynamic_cast<Box *>(shape)) return BOX_PRIMITIVE;
+    return TRIANGLE_PRIMITIVE;
+}
+
+//Which buffer a leaf entry refers to, setting index to its place there
+PrimitiveKind Scene::EntryKind(int entry, int& index) {
+    if (entry >= 0) {
+        index = entry;
+        return TRIANGLE_PRIMITIVE;
+    }
+    index = -1 - entry;
+    if (index < spheres.centre.size()) return SPHERE_PRIMITIVE;
+    index -= spheres.centre.size();
+    if (index < quads.v0.size()) return QUAD_PRIMITIVE;
+    index -= quads.v0.size();
+    return BOX_PRIMITIVE;
+}
+
+//Copies a sphere, quad or box shape into the buffer entry laid out for it
+void Scene::StoreShape(int entry, int shape) {
+    int j;
+    PrimitiveKind kind = EntryKind(entry, j);
+    if (kind == SPHERE_PRIMITIVE) {
+        Sphere * sphere = static_cast<Sphere *>(shapes[shape]);
+        spheres.centre[j] = vec3(sphere->getCentre());
+        spheres.radius[j] = sphere->getRadius();
+        spheres.shapeIndex[j] = shape;
+    } else if (kind == QUAD_PRIMITIVE) {
+        Quad * quad = static_cast<Quad *>(shapes[shape]);
+        quads.v0[j] = vec3(quad->getV0());
+        quads.normal[j] = vec3(quad->getNormal());
+        quads.uAxis[j] = quad->getUAxis();
+        quads.vAxis[j] = quad->getVAxis();
+        quads.shapeIndex[j] = shape;
+    } else if (kind == BOX_PRIMITIVE) {
+        Box * box = static_cast<Box *>(shapes[shape]);
+        boxes.v0[j] = vec3(box->getV0());
+        boxes.toLocal[j] = box->getToLocal();
+        boxes.shapeIndex[j] = shape;
+    }
+}
+
+//Reciprocal of the direction for the slab tests, keeping zero components finite
+static vec3 InverseDirection(const vec4& dir) {
+    vec3 invDir;
+    for (int a = 0 ; a < 3 ; a++) {
+        invDir[a] = 1.0f / (fabs(dir[a]) > 1e-12f ? dir[a] : 1e-12f);
+    }
+    return invDir;
+}
+
+bool Scene::closestIntersection(vec4 start, vec4 dir, Intersection& closestIntersection) {
+    closestIntersection.distance = numeric_limits<float>::max();
+
+    //Shapes are intersected with the direction scaled by SCREEN_HEIGHT, so
+    //distances along the ray are measured in the same units here
+    vec4 dirScaled = vec4(vec3(dir) * (float)SCREEN_HEIGHT, 1);
+    return TraceClosest(start, dirScaled, closestIntersection);
+}
+
+//Finds the closest intersection nearer than closestIntersection.distance by
+//walking the BVH front to back, skipping any node that starts further away
+//than the closest hit found so far, then doing the same over the instances
+bool Scene::TraceClosest(const vec4& start, const vec4& dir, Intersection& closestIntersection) {
+    bool returnVal = false;
+    if (wide) {
+        TraceWide(start, dir, closestIntersection, returnVal);
+        if (!instances.empty()) {
+            TraceInstances(start, dir, closestIntersection, returnVal);
+        }
+        return returnVal;
+    }
+
+    vector<BVHNode>& nodes = bvh.getNodes();
+    vector<int>& primitiveIndices = bvh.getPrimitiveIndices();
+    vec3 start3(start);
+    vec3 invDir = InverseDirection(dir);
+
+    //Stack of nodes still to visit along with the distance the ray enters them
+    int stack[BVH_STACK_SIZE];
+    float stackDist[BVH_STACK_SIZE];
+    int stackSize = 0;
+    if (!nodes.empty()) {
+        float tRoot = nodes[0].bounds.intersects(start3, invDir, closestIntersection.distance);
+        if (tRoot >= 0) {
+            stack[stackSize] = 0;
+            stackDist[stackSize++] = tRoot;
+        }
+    }
+
+    while (stackSize > 0) {
+        stackSize--;
+        if (stackDist[stackSize] > closestIntersection.distance) continue;
+        const BVHNode& node = nodes[stack[stackSize]];
+
+        if (node.count > 0) {
+            IntersectLeaf(&primitiveIndices[node.leftFirst], node.count, start, dir, closestIntersection, returnVal);
+        }
+        else {
+            int near = node.leftFirst;
+            int far = node.leftFirst + 1;
+            float tNear = nodes[near].bounds.intersects(start3, invDir, closestIntersection.distance);
+            float tFar = nodes[far].bounds.intersects(start3, invDir, closestIntersection.distance);
+            if (tFar >= 0 && (tNear < 0 || tFar < tNear)) {
+                swap(near, far);
+                swap(tNear, tFar);
+            }
+            //Push the far child first so the near one is visited next
+            if (tFar >= 0) {
+                stack[stackSize] = far;
+                stackDist[stackSize++] = tFar;
+            }
+            if (tNear >= 0) {
+                stack[stackSize] = near;
+                stackDist[stackSize++] = tNear;
+            }
+        }
+    }
+
+    if (!instances.empty()) {
+        TraceInstances(start, dir, closestIntersection, returnVal);
+    }
+    return returnVal;
+}
+
+//The same front to back walk over the top level BVH, tracing the ray through
+//every instance it reaches before the closest hit so far
+void Scene::TraceInstances(const vec4& start, const vec4& dir, Intersection& closestIntersection, bool& hit) {
+    vector<BVHNode>& nodes = instanceBVH.getNodes();
+    vector<int>& primitiveIndices = instanceBVH.getPrimitiveIndices();
+    vec3 start3(start);
+    vec3 invDir = InverseDirection(dir);
+
+    int stack[BVH_STACK_SIZE];
+    float stackDist[BVH_STACK_SIZE];
+    int stackSize = 0;
+    float tRoot = nodes[0].bounds.intersects(start3, invDir, closestIntersection.distance);
+    if (tRoot >= 0) {
+        stack[stackSize] = 0;
+        stackDist[stackSize++] = tRoot;
+    }
+
+    while (stackSize > 0) {
+        stackSize--;
+        if (stackDist[stackSize] > closestIntersection.distance) continue;
+        const BVHNode& node = nodes[stack[stackSize]];
+
+        if (node.count > 0) {
+            for (int i = node.leftFirst ; i < node.leftFirst + node.count ; i++) {
+                IntersectInstance(primitiveIndices[i], start, dir, closestIntersection, hit);
+            }
+        }
+        else {
+            int near = node.leftFirst;
+            int far = node.leftFirst + 1;
+            float tNear = nodes[near].bounds.intersects(start3, invDir, closestIntersection.distance);
+            float tFar = nodes[far].bounds.intersects(start3, invDir, closestIntersection.distance);
+            if (tFar >= 0 && (tNear < 0 || tFar < tNear)) {
+                swap(near, far);
+                swap(tNear, tFar);
+            }
+            if (tFar >= 0) {
+                stack[stackSize] = far;
+                stackDist[stackSize++] = tFar;
+            }
+            if (tNear >= 0) {
+                stack[stackSize] = near;
+                stackDist[stackSize++] = tNear;
+            }
+        }
+    }
+}
+
+//An affine map keeps the ray parameter, so the object's hit distance is
+//already the world one. The hit record is then brought back to world space
+//and renumbered past the primitives before the instance
+void Scene::IntersectInstance(int instance, const vec4& start, const vec4& dir, Intersection& closestIntersection, bool& hit) {
+    InstanceRecord& record = instances[instance];
+    vec4 objectStart(record.worldToObject * vec4(vec3(start), 1), 1);
+    vec4 objectDir(record.worldToObject * vec4(vec3(dir), 0), 1);
+    if (record.object->TraceClosest(objectStart, objectDir, closestIntersection)) {
+        closestIntersection.position = start + closestIntersection.distance * dir;
+        closestIntersection.normal = vec4(normalize(record.normalToWorld * vec3(closestIntersection.normal)), 1);
+        closestIntersection.index += instanceOffsets[instance];
+        hit = true;
+    }
+}
+
+//A leaf's entries are a run of triangle slots followed by runs of spheres,
+//quads and boxes
+void Scene::IntersectLeaf(const int * entries, int count, const vec4& start, const vec4& dir, Intersection& closestIntersection, bool& hit) {
+    int i = 0;
+    while (i < count && entries[i] >= 0) i++;
+
+    if (i > 0 && triangles.Intersect(entries[0], i, start, dir, closestIntersection)) {
+        hit = true;
+    }
+    while (i < count) {
+        int first;
+        PrimitiveKind kind = EntryKind(entries[i], first);
+        int run = 1;
+        int index;
+        while (i + run < count && EntryKind(entries[i + run], index) == kind) run++;
+
+        if (kind == SPHERE_PRIMITIVE) {
+            IntersectSpheres(first, run, start, dir, closestIntersection, hit);
+        } else if (kind == QUAD_PRIMITIVE) {
+            IntersectQuads(first, run, start, dir, closestIntersection, hit);
+        } else {
+            IntersectBoxes(first, run, start, dir, closestIntersection, hit);
+        }
+        i += run;
+    }
+}
+
+//Front to back walk of the wide BVH. The children a ray enters are pushed
+//furthest first so the nearest is visited next, leaves included, each stack
+//entry being an inner node (count 0) or a leaf's run of entries
+void Scene::TraceWide(const vec4& start, const vec4& dir, Intersection& closestIntersection, bool& hit) {
+    vector<WideBVHNode>& nodes = wideBVH.getNodes();
+    vector<int>& primitiveIndices = wideBVH.getPrimitiveIndices();
+    if (nodes.empty()) return;
+    vec3 start3(start);
+    vec3 invDir = InverseDirection(dir);
+
+    int stack[WIDE_BVH_STACK_SIZE];
+    int stackCount[WIDE_BVH_STACK_SIZE];
+    float stackDist[WIDE_BVH_STACK_SIZE];
+    int stackSize = 0;
+    float tRoot = wideBVH.getBounds().intersects(start3, invDir, closestIntersection.distance);
+    if (tRoot >= 0) {
+        stack[stackSize] = 0;
+        stackCount[stackSize] = 0;
+        stackDist[stackSize++] = tRoot;
+    }
+
+    while (stackSize > 0) {
+        stackSize--;
+        if (stackDist[stackSize] > closestIntersection.distance) continue;
+        if (stackCount[stackSize] > 0) {
+            IntersectLeaf(&primitiveIndices[stack[stackSize]], stackCount[stackSize], start, dir, closestIntersection, hit);
+            continue;
+        }
+        const WideBVHNode& node = nodes[stack[stackSize]];
+
+        float tEnter[WIDE_BVH_WIDTH];
+        WideBVH::ChildDistances(node, start3, invDir, closestIntersection.distance, tEnter);
+
+        //Insertion sort of the children entered, furthest first
+        int order[WIDE_BVH_WIDTH];
+        int numEntered = 0;
+        for (int k = 0 ; k < WIDE_BVH_WIDTH ; k++) {
+            if (tEnter[k] == numeric_limits<float>::max() || (node.meta[k] == 0 && !(node.innerMask & (1 << k)))) continue;
+            int j = numEntered++;
+            while (j > 0 && tEnter[order[j - 1]] < tEnter[k]) {
+                order[j] = order[j - 1];
+                j--;
+            }
+            order[j] = k;
+        }
+
+        for (int j = 0 ; j < numEntered ; j++) {
+            int k = order[j];
+            if (node.innerMask & (1 << k)) {
+                stack[stackSize] = node.childBase + __builtin_popcount(node.innerMask & ((1 << k) - 1));
+                stackCount[stackSize] = 0;
+            } else {
+                int first = node.primitiveBase;
+                for (int c = 0 ; c < k ; c++) first += node.meta[c];
+                stack[stackSize] = first;
+                stackCount[stackSize] = node.meta[k];
+            }
+            stackDist[stackSize++] = tEnter[k];
+        }
+    }
+}
+
+//Traces a packet of rays sharing a start point down the BVH together. A node
+//is entered if any ray in the packet reaches it before its closest hit so
+//far, with the children visited in the order the packet first enters them.
+//When the rays' directions agree in sign on every axis, nodes entirely
+//outside the packet's frustum are culled with one interval test first
+void Scene::closestIntersections(RayPacket& packet, Intersection closestIntersections[], bool hits[]) {
+    int n = packet.count;
+    vec3 start3(packet.start);
+
+    //Directions scaled and inverted as for a single ray, stored by component
+    vec4 dirScaled[RAY_PACKET_SIZE];
+    float invDir[3][RAY_PACKET_SIZE];
+    float tmax[RAY_PACKET_SIZE];
+    vec3 invLower(numeric_limits<float>::max());
+    vec3 invUpper(-numeric_limits<float>::max());
+    for (int r = 0 ; r < n ; r++) {
+        closestIntersections[r].distance = numeric_limits<float>::max();
+        hits[r] = false;
+        dirScaled[r] = vec4(vec3(packet.dir[r]) * (float)SCREEN_HEIGHT, 1);
+        vec3 inv = InverseDirection(dirScaled[r]);
+        for (int a = 0 ; a < 3 ; a++) {
+            invDir[a][r] = inv[a];
+        }
+        invLower = glm::min(invLower, inv);
+        invUpper = glm::max(invUpper, inv);
+        tmax[r] = numeric_limits<float>::max();
+    }
+    bool coherent = n > 0;
+    for (int a = 0 ; a < 3 ; a++) {
+        if (invLower[a] * invUpper[a] <= 0) coherent = false;
+    }
+
+    vector<BVHNode>& nodes = bvh.getNodes();
+    vector<int>& primitiveIndices = bvh.getPrimitiveIndices();
+    int stack[BVH_STACK_SIZE];
+    int stackSize = 0;
+    if (!nodes.empty()) {
+        stack[stackSize++] = 0;
+    }
+
+    while (stackSize > 0) {
+        const BVHNode& node = nodes[stack[--stackSize]];
+
+        if (node.count > 0) {
+            for (int r = 0 ; r < n ; r++) {
+                vec3 inv(invDir[0][r], invDir[1][r], invDir[2][r]);
+                if (node.bounds.intersects(start3, inv, tmax[r]) >= 0) {
+                    IntersectLeaf(&primitiveIndices[node.leftFirst], node.count, packet.start, dirScaled[r], closestIntersections[r], hits[r]);
+                    tmax[r] = closestIntersections[r].distance;
+                }
+            }
+        }
+        else {
+            int near = node.leftFirst;
+            int far = node.leftFirst + 1;
+            float tNear = PacketEntry(nodes[near].bounds, start3, invDir, tmax, n, coherent, invLower, invUpper);
+            float tFar = PacketEntry(nodes[far].bounds, start3, invDir, tmax, n, coherent, invLower, invUpper);
+            if (tFar >= 0 && (tNear < 0 || tFar < tNear)) {
+                swap(near, far);
+                swap(tNear, tFar);
+            }
+            if (tFar >= 0) stack[stackSize++] = far;
+            if (tNear >= 0) stack[stackSize++] = near;
+        }
+    }
+
+    //Instances are traced ray by ray
+    if (!instances.empty()) {
+        for (int r = 0 ; r < n ; r++) {
+            TraceInstances(packet.start, dirScaled[r], closestIntersections[r], hits[r]);
+        }
+    }
+}
+
+//Earliest distance at which any ray of the packet enters the box before its
+//own tmax, or -1 if none does
+float Scene::PacketEntry(const AABB& box, const vec3& start, float invDir[3][RAY_PACKET_SIZE], float tmax[], int n, bool coherent, const vec3& invLower, const vec3& invUpper) {
+    vec3 lower = box.lower - start;
+    vec3 upper = box.upper - start;
+
+    //Interval arithmetic over the range of inverse directions bounds the
+    //entry and exit of every ray at once
+    if (coherent) {
+        float tEnter = 0.0f;
+        float tExit = numeric_limits<float>::max();
+        for (int a = 0 ; a < 3 ; a++) {
+            float p0 = lower[a] * invLower[a], p1 = lower[a] * invUpper[a];
+            float p2 = upper[a] * invLower[a], p3 = upper[a] * invUpper[a];
+            tEnter = glm::max(tEnter, glm::min(glm::min(p0, p1), glm::min(p2, p3)));
+            tExit = glm::min(tExit, glm::max(glm::max(p0, p1), glm::max(p2, p3)));
+        }
+        if (tEnter > tExit) return -1.0f;
+    }
+
+    float best = numeric_limits<float>::max();
+    #pragma omp simd reduction(min:best)
+    for (int r = 0 ; r < n ; r++) {
+        float t1x = lower.x * invDir[0][r], t2x = upper.x * invDir[0][r];
+        float t1y = lower.y * invDir[1][r], t2y = upper.y * invDir[1][r];
+        float t1z = lower.z * invDir[2][r], t2z = upper.z * invDir[2][r];
+        float tEnter = glm::max(glm::max(glm::min(t1x, t2x), glm::min(t1y, t2y)), glm::max(glm::min(t1z, t2z), 0.0f));
+        float tExit = glm::min(glm::min(glm::max(t1x, t2x), glm::max(t1y, t2y)), glm::min(glm::max(t1z, t2z), tmax[r]));
+        best = glm::min(best, tEnter <= tExit ? tEnter : numeric_limits<float>::max());
+    }
+    return best < numeric_limits<float>::max() ? best : -1.0f;
+}
+
+bool Scene::occluded(vec4 start, vec4 dir, float tmax) {
+    bool transparentOnly;
+    return Occluded(start, dir, tmax, false, transparentOnly, -1);
+}
+
+bool Scene::occluded(vec4 start, vec4 dir, float tmax, bool& transparentOnly) {
+    return Occluded(start, dir, tmax, true, transparentOnly, -1);
+}
+
+bool Scene::occluded(vec4 start, vec4 dir, float tmax, bool& transparentOnly, int cacheSlot) {
+    return Occluded(start, dir, tmax, true, transparentOnly, cacheSlot);
+}
+
+// Each thread's last opaque blocker for each cache slot, as a leaf entry of
+// the scene it was found in, or OCCLUDER_CACHE_EMPTY. Its counts are added to
+// the shared ones every OCCLUDER_CACHE_FLUSH tests so those are seldom written
+struct OccluderCache {
+    const Scene * scene = nullptr;
+    vector<int> entries;
+    long tests = 0;
+    long hits = 0;
+};
+
+static thread_local OccluderCache occluderCache;
+static atomic<long> occluderCacheTests(0);
+static atomic<long> occluderCacheHits(0);
+
+static void FlushOccluderCounts(OccluderCache& cache) {
+    occluderCacheTests += cache.tests;
+    occluderCacheHits += cache.hits;
+    cache.tests = 0;
+    cache.hits = 0;
+}
+
+//A cached blocker is tried before anything else. It is replaced when the full
+//walk finds a different one and dropped when the ray turns out to be clear,
+//so lit points do not keep paying for it. It is only taken if the ray really
+//does hit it, so the result is the same as without the cache
+bool Scene::Occluded(vec4 start, vec4 dir, float tmax, bool passTransparent, bool& transparentOnly, int cacheSlot) {
+    vec4 dirScaled = vec4(vec3(dir) * (float)SCREEN_HEIGHT, 1);
+
+    //Intersection distances are in multiples of the scaled direction
+    float tEnd = tmax / length(vec3(dirScaled));
+
+    int * cached = nullptr;
+    if (occluderCacheEnabled && cacheSlot >= 0) {
+        OccluderCache& cache = occluderCache;
+        if (cache.scene != this) {
+            cache.scene = this;
+            cache.entries.clear();
+        }
+        if (cacheSlot >= cache.entries.size()) {
+            cache.entries.resize(cacheSlot + 1, OCCLUDER_CACHE_EMPTY);
+        }
+        cached = &cache.entries[cacheSlot];
+        if (*cached != OCCLUDER_CACHE_EMPTY) {
+            cache.tests++;
+            bool hit = EntryBlocks(*cached, start, dirScaled, tEnd, passTransparent);
+            if (hit) cache.hits++;
+            if (cache.tests >= OCCLUDER_CACHE_FLUSH) FlushOccluderCounts(cache);
+            if (hit) {
+                transparentOnly = false;
+                return true;
+            }
+        }
+    }
+
+    bool blocked = false;
+    int blocker = 0;
+    bool blockerFound = false;
+    if (AnyHit(start, dirScaled, tEnd, passTransparent, blocked, blocker, blockerFound)) {
+        if (cached) *cached = blockerFound ? blocker : OCCLUDER_CACHE_EMPTY;
+        transparentOnly = false;
+        return true;
+    }
+    if (cached) *cached = OCCLUDER_CACHE_EMPTY;
+    transparentOnly = blocked;
+    return blocked;
+}
+
+//Whether a leaf entry blocks the ray before tEnd, as LeafAnyHit tests it.
+//Entries out of range, left from a scene since rebuilt, never block
+bool Scene::EntryBlocks(int entry, const vec4& start, const vec4& dir, float tEnd, bool passTransparent) {
+    int shape;
+    if (entry >= 0) {
+        if (entry >= triangles.getShapeIndices().size()) return false;
+        if (triangles.PacketHits(entry / TRIANGLE_PACKET_WIDTH, entry, 1, start, dir, tEnd) == 0) return false;
+        shape = triangles.getShapeIndex(entry);
+    } else {
+        if (-1 - entry >= spheres.centre.size() + quads.v0.size() + boxes.v0.size()) return false;
+        float t = EntryDistance(entry, vec3(start), vec3(dir));
+        if (!(t > 0 && t < tEnd)) return false;
+        shape = EntryShape(entry);
+    }
+    return !passTransparent || !getMaterial(shape).isTransparent();
+}
+
+void Scene::useOccluderCache(bool enabled) {
+    occluderCacheEnabled = enabled;
+}
+
+void Scene::useShadowPhotons(ShadowPhotons * shadowPhotons) {
+    this->shadowPhotons = shadowPhotons;
+}
+
+ShadowPhotons * Scene::getShadowPhotons() {
+    return shadowPhotons;
+}
+
+void Scene::getOccluderCacheCounts(long& tests, long& hits) {
+    FlushOccluderCounts(occluderCache);
+    tests = occluderCacheTests;
+    hits = occluderCacheHits;
+}
+
+void Scene::resetOccluderCacheCounts() {
+    occluderCache.tests = 0;
+    occluderCache.hits = 0;
+    occluderCacheTests = 0;
+    occluderCacheHits = 0;
+}
+
+//Walks the BVH until a blocker closer than tEnd is found, in no particular
+//order since any blocker will do, then the instances. Returns true at the
+//first blocker, unless passTransparent is set in which case transparent
+//blockers only set blocked and the walk carries on looking for an opaque one.
+//blocker is set to the leaf entry that stopped the walk if it was one of the
+//scene's own
+bool Scene::AnyHit(const vec4& start, const vec4& dir, float tEnd, bool passTransparent, bool& blocked, int& blocker, bool& blockerFound) {
+    if (wide) {
+        return AnyHitWide(start, dir, tEnd, passTransparent, blocked, blocker, blockerFound)
+            || (!instances.empty() && AnyInstanceHit(start, dir, tEnd, passTransparent, blocked));
+    }
+
+    vector<BVHNode>& nodes = bvh.getNodes();
+    vector<int>& primitiveIndices = bvh.getPrimitiveIndices();
+    vec3 start3(start);
+    vec3 invDir = InverseDirection(dir);
+
+    int stack[BVH_STACK_SIZE];
+    int stackSize = 0;
+    if (!nodes.empty() && nodes[0].bounds.intersects(start3, invDir, tEnd) >= 0) {
+        stack[stackSize++] = 0;
+    }
+
+    while (stackSize > 0) {
+        const BVHNode& node = nodes[stack[--stackSize]];
+
+        if (node.count > 0) {
+            if (LeafAnyHit(&primitiveIndices[node.leftFirst], node.count, start, dir, tEnd, passTransparent, blocked, blocker)) {
+                blockerFound = true;
+                return true;
+            }
+        }
+        else {
+            for (int c = node.leftFirst ; c < node.leftFirst + 2 ; c++) {
+                if (nodes[c].bounds.intersects(start3, invDir, tEnd) >= 0) {
+                    stack[stackSize++] = c;
+                }
+            }
+        }
+    }
+
+    return !instances.empty() && AnyInstanceHit(start, dir, tEnd, passTransparent, blocked);
+}
+
+//AnyHit's walk over the wide BVH, visiting children in node order
+bool Scene::AnyHitWide(const vec4& start, const vec4& dir, float tEnd, bool passTransparent, bool& blocked, int& blocker, bool& blockerFound) {
+    vector<WideBVHNode>& nodes = wideBVH.getNodes();
+    vector<int>& primitiveIndices = wideBVH.getPrimitiveIndices();
+    if (nodes.empty()) return false;
+    vec3 start3(start);
+    vec3 invDir = InverseDirection(dir);
+
+    int stack[WIDE_BVH_STACK_SIZE];
+    int stackSize = 0;
+    if (wideBVH.getBounds().intersects(start3, invDir, tEnd) >= 0) {
+        stack[stackSize++] = 0;
+    }
+
+    while (stackSize > 0) {
+        const WideBVHNode& node = nodes[stack[--stackSize]];
+
+        float tEnter[WIDE_BVH_WIDTH];
+        WideBVH::ChildDistances(node, start3, invDir, tEnd, tEnter);
+
+        int first = node.primitiveBase;
+        for (int k = 0 ; k < WIDE_BVH_WIDTH ; k++) {
+            bool entered = tEnter[k] != numeric_limits<float>::max();
+            if (node.innerMask & (1 << k)) {
+                if (entered) stack[stackSize++] = node.childBase + __builtin_popcount(node.innerMask & ((1 << k) - 1));
+            } else {
+                if (entered && node.meta[k] > 0 && LeafAnyHit(&primitiveIndices[first], node.meta[k], start, dir, tEnd, passTransparent, blocked, blocker)) {
+                    blockerFound = true;
+                    return true;
+                }
+                first += node.meta[k];
+            }
+        }
+    }
+    return false;
+}
+
+//Tests a leaf's entries for a blocker closer than tEnd, as described for AnyHit
+bool Scene::LeafAnyHit(const int * entries, int count, const vec4& start, const vec4& dir, float tEnd, bool passTransparent, bool& blocked, int& blocker) {
+    int i = 0;
+    while (i < count && entries[i] >= 0) i++;
+
+    int first = i > 0 ? entries[0] : 0;
+    for (int p = first / TRIANGLE_PACKET_WIDTH ; p * TRIANGLE_PACKET_WIDTH < first + i ; p++) {
+        int mask = triangles.PacketHits(p, first, i, start, dir, tEnd);
+        for (int lane = 0 ; mask != 0 ; lane++, mask >>= 1) {
+            if (!(mask & 1)) continue;
+            if (!passTransparent || !getMaterial(triangles.getShapeIndex(p * TRIANGLE_PACKET_WIDTH + lane)).isTransparent()) {
+                blocker = p * TRIANGLE_PACKET_WIDTH + lane;
+                return true;
+            }
+            blocked = true;
+        }
+    }
+
+    vec3 start3(start);
+    vec3 dir3(dir);
+    for ( ; i < count ; i++) {
+        float t = EntryDistance(entries[i], start3, dir3);
+        if (t > 0 && t < tEnd) {
+            if (!passTransparent || !getMaterial(EntryShape(entries[i])).isTransparent()) {
+                blocker = entries[i];
+                return true;
+            }
+            blocked = true;
+        }
+    }
+    return false;
+}
+
+//The top level walk for AnyHit, asking each instance reached in its own space
+bool Scene::AnyInstanceHit(const vec4& start, const vec4& dir, float tEnd, bool passTransparent, bool& blocked) {
+    vector<BVHNode>& nodes = instanceBVH.getNodes();
+    vector<int>& primitiveIndices = instanceBVH.getPrimitiveIndices();
+    vec3 start3(start);
+    vec3 invDir = InverseDirection(dir);
+
+    int stack[BVH_STACK_SIZE];
+    int stackSize = 0;
+    if (nodes[0].bounds.intersects(start3, invDir, tEnd) >= 0) {
+        stack[stackSize++] = 0;
+    }
+
+    while (stackSize > 0) {
+        const BVHNode& node = nodes[stack[--stackSize]];
+
+        if (node.count > 0) {
+            for (int i = node.leftFirst ; i < node.leftFirst + node.count ; i++) {
+                InstanceRecord& record = instances[primitiveIndices[i]];
+                vec4 objectStart(record.worldToObject * vec4(start3, 1), 1);
+                vec4 objectDir(record.worldToObject * vec4(vec3(dir), 0), 1);
+                int blocker;
+                bool blockerFound = false;
+                if (record.object->AnyHit(objectStart, objectDir, tEnd, passTransparent, blocked, blocker, blockerFound)) {
+                    return true;
+                }
+            }
+        }
+        else {
+            for (int c = node.leftFirst ; c < node.leftFirst + 2 ; c++) {
+                if (nodes[c].bounds.intersects(start3, invDir, tEnd) >= 0) {
+                    stack[stackSize++] = c;
+                }
+            }
+        }
+    }
+    return false;
+}
+
+//Tests a run of spheres, exactly as Sphere::intersects does
+void Scene::IntersectSpheres(int first, int count, const vec4& start, const vec4& dir, Intersection& closestIntersection, bool& hit) {
+    vec3 start3 = vec3(start);
+    vec3 dir3 = vec3(dir);
+    for (int j = first ; j < first + count ; j++) {
+        float t = SphereDistance(j, start3, dir3);
+        if (t > 0 && t < closestIntersection.distance) {
+            closestIntersection.position = start + t * dir;
+            closestIntersection.distance = t;
+            closestIntersection.index = spheres.shapeIndex[j];
+            closestIntersection.normal = vec4(normalize((start3 + t * dir3) - spheres.centre[j]), 1);
+            hit = true;
+        }
+    }
+}
+
+//Distance along dir to the sphere's nearest intersection in front of start,
+//or -1 if there is none
+float Scene::SphereDistance(int sphere, const vec3& start, const vec3& dir) {
+    float r = spheres.radius[sphere];
+    vec3 L = start - spheres.centre[sphere];
+    float a = dot(dir, dir);
+    float b = 2 * dot(dir, L);
+    float c = dot(L, L) - r * r;
+
+    float t0, t1;
+    if (!Sphere::solveQuadratic(a, b, c, t0, t1)) return -1.0f;
+    if (t0 < 0) {
+        t0 = t1; // if t0 is negative use t1 instead
+    }
+    return t0 > 0 ? t0 : -1.0f;
+}
+
+//Tests a run of quads, exactly as Quad::intersects does
+void Scene::IntersectQuads(int first, int count, const vec4& start, const vec4& dir, Intersection& closestIntersection, bool& hit) {
+    vec3 start3 = vec3(start);
+    vec3 dir3 = vec3(dir);
+    for (int j = first ; j < first + count ; j++) {
+        float t = Quad::Distance(quads.v0[j], quads.normal[j], quads.uAxis[j], quads.vAxis[j], start3, dir3);
+        if (t >= 0 && t < closestIntersection.distance) {
+            closestIntersection.position = start + t * dir;
+            closestIntersection.distance = t;
+            closestIntersection.index = quads.shapeIndex[j];
+            closestIntersection.normal = vec4(quads.normal[j], 1);
+            hit = true;
+        }
+    }
+}
+
+//Tests a run of boxes, exactly as Box::intersects does
+void Scene::IntersectBoxes(int first, int count, const vec4& start, const vec4& dir, Intersection& closestIntersection, bool& hit) {
+    vec3 start3 = vec3(start);
+    vec3 dir3 = vec3(dir);
+    for (int j = first ; j < first + count ; j++) {
+        int face;
+        float t = Box::Distance(boxes.v0[j], boxes.toLocal[j], start3, dir3, face);
+        if (t >= 0 && t < closestIntersection.distance) {
+            closestIntersection.position = start + t * dir;
+            closestIntersection.distance = t;
+            closestIntersection.index = boxes.shapeIndex[j];
+            closestIntersection.normal = vec4(Box::FaceNormal(boxes.toLocal[j], face), 1);
+            hit = true;
+        }
+    }
+}
+
+//Distance along dir to a sphere, quad or box entry, or -1 if it is missed
+float Scene::EntryDistance(int entry, const vec3& start, const vec3& dir) {
+    int j;
+    PrimitiveKind kind = EntryKind(entry, j);
+    if (kind == SPHERE_PRIMITIVE) {
+        return SphereDistance(j, start, dir);
+    }
+    if (kind == QUAD_PRIMITIVE) {
+        return Quad::Distance(quads.v0[j], quads.normal[j], quads.uAxis[j], quads.vAxis[j], start, dir);
+    }
+    int face;
+    return Box::Distance(boxes.v0[j], boxes.toLocal[j], start, dir, face);
+}
+
+//The shape a sphere, quad or box entry was laid out from
+int Scene::EntryShape(int entry) {
+    int j;
+    PrimitiveKind kind = EntryKind(entry, j);
+    if (kind == SPHERE_PRIMITIVE) return spheres.shapeIndex[j];
+    if (kind == QUAD_PRIMITIVE) return quads.shapeIndex[j];
+    return boxes.shapeIndex[j];
+}
+
+void Scene::useWideBVH(bool wide) {
+    this->wide = wide;
+    if (wide) {
+        //Falls back to the binary tree if the wide one is too deep to walk
+        this->wide = wideBVH.Build(bvh);
+    } else {
+        wideBVH.Clear();
+    }
+}
+
+void Scene::shapeChanged(int shape) {
+    changedShapes.push_back(shape);
+}
+
+void Scene::setInstanceTransform(int instance, mat4 transform) {
+    SetTransform(instances[instance], transform);
+    changedInstances.push_back(instance);
+}
+
+//Copies the changed shapes into the laid out buffers, refits each leaf they
+//touched once, then does the same for the moved instances
+bool Scene::Update() {
+    bool rebuilt = false;
+
+    if (!changedShapes.empty() && bvh.getNumNodes() > 0) {
+        if (!bvh.isRefitPrepared()) PrepareRefit();
+
+        vector<int> leaves;
+        for (int i = 0 ; i < changedShapes.size() ; i++) {
+            int shape = changedShapes[i];
+            if (Triangle * triangle = dynamic_cast<Triangle *>(shapes[shape])) {
+                int slot = shapeLayout[shape];
+                triangles.SetTriangle(slot, vec3(triangle->getV0()), vec3(triangle->getV1()), vec3(triangle->getV2()));
+                leaves.push_back(slotLeaves[slot]);
+            } else {
+                StoreShape(shapeLayout[shape], shape);
+                leaves.push_back(entryLeaves[-1 - shapeLayout[shape]]);
+            }
+        }
+        sort(leaves.begin(), leaves.end());
+        leaves.erase(unique(leaves.begin(), leaves.end()), leaves.end());
+        for (int l = 0 ; l < leaves.size() ; l++) {
+            bvh.RefitLeaf(leaves[l], LeafBounds(leaves[l]));
+        }
+
+        //The mesh faces can only be gathered again if the meshes are still
+        //here, which they are not for a scene loaded from the cache
+        if (bvh.RefitCostRatio() > BVH_REFIT_REBUILD_RATIO && meshes.size() == meshOffsets.size()) {
+            BuildPrimitives();
+            rebuilt = true;
+        } else if (wide) {
+            //Quantised boxes cannot grow in place, so collapse the refitted tree again
+            wide = wideBVH.Build(bvh);
+        }
+    }
+    changedShapes.clear();
+
+    if (!changedInstances.empty()) {
+        if (!instanceBVH.isRefitPrepared()) PrepareInstanceRefit();
+
+        vector<int> leaves;
+        for (int i = 0 ; i < changedInstances.size() ; i++) {
+            leaves.push_back(instanceLeaves[changedInstances[i]]);
+        }
+        sort(leaves.begin(), leaves.end());
+        leaves.erase(unique(leaves.begin(), leaves.end()), leaves.end());
+        for (int l = 0 ; l < leaves.size() ; l++) {
+            vector<BVHNode>& nodes = instanceBVH.getNodes();
+            vector<int>& primitiveIndices = instanceBVH.getPrimitiveIndices();
+            AABB bounds;
+            for (int k = nodes[leaves[l]].leftFirst ; k < nodes[leaves[l]].leftFirst + nodes[leaves[l]].count ; k++) {
+                bounds.grow(PaddedBox(InstanceBounds(primitiveIndices[k])));
+            }
+            instanceBVH.RefitLeaf(leaves[l], bounds);
+        }
+
+        if (instanceBVH.RefitCostRatio() > BVH_REFIT_REBUILD_RATIO) {
+            BuildInstances();
+            rebuilt = true;
+        }
+    }
+    changedInstances.clear();
+
+    return rebuilt;
+}
+
+//Finds where each shape was laid out and which leaf holds each triangle slot
+//and other entry
+void Scene::PrepareRefit() {
+    bvh.PrepareRefit();
+    vector<BVHNode>& nodes = bvh.getNodes();
+    vector<int>& primitiveIndices = bvh.getPrimitiveIndices();
+
+    shapeLayout.assign(shapes.size(), 0);
+    for (int slot = 0 ; slot < triangles.getShapeIndices().size() ; slot++) {
+        int primitive = triangles.getShapeIndex(slot);
+        if (primitive < shapes.size()) shapeLayout[primitive] = slot;
+    }
+    //Entries run through the sphere, quad and box buffers in turn
+    vector<int> otherShapes = spheres.shapeIndex;
+    otherShapes.insert(otherShapes.end(), quads.shapeIndex.begin(), quads.shapeIndex.end());
+    otherShapes.insert(otherShapes.end(), boxes.shapeIndex.begin(), boxes.shapeIndex.end());
+    for (int j = 0 ; j < otherShapes.size() ; j++) {
+        shapeLayout[otherShapes[j]] = -1 - j;
+    }
+
+    slotLeaves.assign(triangles.getShapeIndices().size(), 0);
+    entryLeaves.assign(otherShapes.size(), 0);
+    for (int i = 0 ; i < nodes.size() ; i++) {
+        for (int k = nodes[i].leftFirst ; k < nodes[i].leftFirst + nodes[i].count ; k++) {
+            if (primitiveIndices[k] >= 0) {
+                slotLeaves[primitiveIndices[k]] = i;
+            } else {
+                entryLeaves[-1 - primitiveIndices[k]] = i;
+            }
+        }
+    }
+}
+
+void Scene::PrepareInstanceRefit() {
+    instanceBVH.PrepareRefit();
+    vector<BVHNode>& nodes = instanceBVH.getNodes();
+    vector<int>& primitiveIndices = instanceBVH.getPrimitiveIndices();
+
+    instanceLeaves.assign(instances.size(), 0);
+    for (int i = 0 ; i < nodes.size() ; i++) {
+        for (int k = nodes[i].leftFirst ; k < nodes[i].leftFirst + nodes[i].count ; k++) {
+            instanceLeaves[primitiveIndices[k]] = i;
+        }
+    }
+}
+
+//Box around a leaf's primitives, padded as the builders pad them
+AABB Scene::LeafBounds(int leaf) {
+    BVHNode& node = bvh.getNodes()[leaf];
+    vector<int>& primitiveIndices = bvh.getPrimitiveIndices();
+    AABB bounds;
+    for (int k = node.leftFirst ; k < node.leftFirst + node.count ; k++) {
+        if (primitiveIndices[k] >= 0) {
+            bounds.grow(PaddedBox(triangles.getBounds(primitiveIndices[k])));
+        } else {
+            //The shape has already been copied into its entry, so its own box
+            //is the entry's
+            bounds.grow(PaddedBox(shapes[EntryShape(primitiveIndices[k])]->getBoundingBox()));
+        }
+    }
+    return bounds;
+}
+
+AABB Scene::PaddedBox(AABB box) {
+    box.lower -= vec3(BVH_BOX_PADDING);
+    box.upper += vec3(BVH_BOX_PADDING);
+    return box;
+}
+
+size_t Scene::getMemoryUsage() {
+    return triangles.getMemoryUsage()
+        + spheres.centre.size() * (sizeof(vec3) + sizeof(float) + sizeof(int))
+        + quads.v0.size() * (4 * sizeof(vec3) + sizeof(int))
+        + boxes.v0.size() * (sizeof(vec3) + sizeof(mat3) + sizeof(int))
+        + materialIndex.size() * sizeof(int)
+        + bvh.getNodes().size() * sizeof(BVHNode)
+        + bvh.getPrimitiveIndices().size() * sizeof(int)
+        + instances.size() * sizeof(InstanceRecord)
+        + instanceOffsets.size() * sizeof(int)
+        + instanceBVH.getNodes().size() * sizeof(BVHNode)
+        + instanceBVH.getPrimitiveIndices().size() * sizeof(int)
+        + wideBVH.getMemoryUsage();
+}
+
+void Scene::HashShapes(vector<Shape *>& shapes, ContentHash& hash) {
+    hash.Add((uint64_t)shapes.size());
+    for (int i = 0 ; i < shapes.size() ; i++) {
+        if (Triangle * triangle = dynamic_cast<Triangle *>(shapes[i])) {
+            hash.Add('t');
+            hash.Add(triangle->getV0());
+            hash.Add(triangle->getV1());
+            hash.Add(triangle->getV2());
+        } else if (Sphere * sphere = dynamic_cast<Sphere *>(shapes[i])) {
+            hash.Add('s');
+            hash.Add(sphere->getCentre());
+            hash.Add(sphere->getRadius());
+        } else if (Quad * quad = dynamic_cast<Quad *>(shapes[i])) {
+            hash.Add('q');
+            hash.Add(quad->getV0());
+            hash.Add(quad->getV1());
+            hash.Add(quad->getV2());
+        } else if (Box * box = dynamic_cast<Box *>(shapes[i])) {
+            hash.Add('b');
+            hash.Add(box->getV0());
+            hash.Add(box->getV1());
+            hash.Add(box->getV2());
+            hash.Add(box->getV3());
+        }
+        HashMaterial(shapes[i]->getMaterial(), hash);
+    }
+}
+
+//Property by property, as the padding between Material's fields is undefined
+void Scene::HashMaterial(Material material, ContentHash& hash) {
+    hash.Add(material.getAmbient());
+    hash.Add(material.getDiffuse());
+    hash.Add(material.getSpecular());
+    hash.Add(material.getEmitted());
+    hash.Add(material.getCoefSpec());
+    hash.Add(material.getCoefDiff());
+    hash.Add(material.getCoefTrans());
+    hash.Add(material.getShininess());
+    hash.Add(material.isReflective());
+    hash.Add(material.getReflectRatio());
+    hash.Add(material.isTransparent());
+    hash.Add(material.getRefractiveIndex());
+}
+
+template<typename T>
+static void DescribeSection(SceneCacheHeader& header, const char * data[], int section, vector<T>& items) {
+    header.recordSizes[section] = sizeof(T);
+    header.sections[section].bytes = items.size() * sizeof(T);
+    data[section] = (const char *)items.data();
+}
+
+//The header is followed by each section in turn, zero padded to the
+//alignment. The file is written under a temporary name and renamed into
+//place so an interrupted save never leaves a damaged cache behind
+bool Scene::SaveCache(string path, uint64_t key) {
+    if (!instances.empty()) {
+        cout << "Scene: scenes with instances are not cached" << endl;
+        return false;
+    }
+
+    SceneCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SCENE_CACHE_MAGIC, sizeof(header.magic));
+    header.version = SCENE_CACHE_VERSION;
+    header.numShapes = shapes.size();
+    header.key = key;
+
+    const char * data[NUM_CACHE_SECTIONS];
+    DescribeSection(header, data, CACHE_MATERIALS, materials);
+    DescribeSection(header, data, CACHE_MATERIAL_INDEX, materialIndex);
+    DescribeSection(header, data, CACHE_MESH_OFFSETS, meshOffsets);
+    DescribeSection(header, data, CACHE_BVH_NODES, bvh.getNodes());
+    DescribeSection(header, data, CACHE_BVH_PRIMITIVES, bvh.getPrimitiveIndices());
+    DescribeSection(header, data, CACHE_TRIANGLE_PACKETS, triangles.getPackets());
+    DescribeSection(header, data, CACHE_TRIANGLE_SHAPES, triangles.getShapeIndices());
+    DescribeSection(header, data, CACHE_SPHERE_CENTRES, spheres.centre);
+    DescribeSection(header, data, CACHE_SPHERE_RADII, spheres.radius);
+    DescribeSection(header, data, CACHE_SPHERE_SHAPES, spheres.shapeIndex);
+    DescribeSection(header, data, CACHE_QUAD_CORNERS, quads.v0);
+    DescribeSection(header, data, CACHE_QUAD_NORMALS, quads.normal);
+    DescribeSection(header, data, CACHE_QUAD_U_AXES, quads.uAxis);
+    DescribeSection(header, data, CACHE_QUAD_V_AXES, quads.vAxis);
+    DescribeSection(header, data, CACHE_QUAD_SHAPES, quads.shapeIndex);
+    DescribeSection(header, data, CACHE_BOX_CORNERS, boxes.v0);
+    DescribeSection(header, data, CACHE_BOX_FRAMES, boxes.toLocal);
+    DescribeSection(header, data, CACHE_BOX_SHAPES, boxes.shapeIndex);
+
+    uint64_t offset = sizeof(header);
+    for (int s = 0 ; s < NUM_CACHE_SECTIONS ; s++) {
+        offset = (offset + SCENE_CACHE_ALIGNMENT - 1) / SCENE_CACHE_ALIGNMENT * SCENE_CACHE_ALIGNMENT;
+        header.sections[s].offset = offset;
+        offset += header.sections[s].bytes;
+    }
+
+    string tempPath = path + ".tmp";
+    ofstream file(tempPath, ios::binary | ios::trunc);
+    if (!file) {
+        cout << "Scene: could not write cache " << path << endl;
+        return false;
+    }
+    file.write((const char *)&header, sizeof(header));
+    const char padding[SCENE_CACHE_ALIGNMENT] = {};
+    for (int s = 0 ; s < NUM_CACHE_SECTIONS ; s++) {
+        file.write(padding, header.sections[s].offset - file.tellp());
+        file.write(data[s], header.sections[s].bytes);
+    }
+    file.close();
+    if (!file || rename(tempPath.c_str(), path.c_str()) != 0) {
+        cout << "Scene: could not write cache " << path << endl;
+        remove(tempPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+//Copies a section out of the mapped file, checking it was written with the
+//same record size and lies within the file
+template<typename T>
+static bool ReadSection(const char * base, size_t fileSize, int section, vector<T>& items) {
+    const SceneCacheHeader * header = (const SceneCacheHeader *)base;
+    const SceneCacheSection& range = header->sections[section];
+    if (header->recordSizes[section] != sizeof(T) || range.bytes % sizeof(T) != 0
+        || range.offset % SCENE_CACHE_ALIGNMENT != 0 || range.offset > fileSize || range.bytes > fileSize - range.offset) {
+        return false;
+    }
+    const T * first = (const T *)(base + range.offset);
+    items.assign(first, first + range.bytes / sizeof(T));
+    return true;
+}
+
+//Whether a scene read from the cache can be traced without indexing out of
+//any of its tables: every material, shape and slot index in range, BVH
+//children after their parents and no deeper than the traversal stack, and
+//each leaf's entries laid out as IntersectLeaf reads them, its triangles
+//first on consecutive slots and then runs of consecutive spheres, quads
+//and boxes
+bool Scene::CacheIsConsistent() {
+    int numPrimitives = materialIndex.size();
+    if (numPrimitives < shapes.size()) return false;
+    for (int i = 0 ; i < numPrimitives ; i++) {
+        if (materialIndex[i] < 0 || materialIndex[i] >= materials.size()) return false;
+    }
+    for (int m = 0 ; m < meshOffsets.size() ; m++) {
+        int previous = m == 0 ? shapes.size() : meshOffsets[m - 1];
+        if (meshOffsets[m] < previous || meshOffsets[m] > numPrimitives) return false;
+    }
+
+    vector<int>& triangleShapes = triangles.getShapeIndices();
+    int numSlots = triangleShapes.size();
+    if ((numSlots + TRIANGLE_PACKET_WIDTH - 1) / TRIANGLE_PACKET_WIDTH != triangles.getNumPackets()) return false;
+    for (int i = 0 ; i < numSlots ; i++) {
+        int primitive = triangleShapes[i];
+        if (primitive < 0 || primitive >= numPrimitives) return false;
+        if (primitive < shapes.size() && ShapeKind(shapes[primitive]) != TRIANGLE_PRIMITIVE) return false;
+    }
+
+    int numSpheres = spheres.centre.size();
+    int numQuads = quads.v0.size();
+    int numBoxes = boxes.v0.size();
+    if (spheres.radius.size() != numSpheres || spheres.shapeIndex.size() != numSpheres
+        || quads.normal.size() != numQuads || quads.uAxis.size() != numQuads || quads.vAxis.size() != numQuads
+        || quads.shapeIndex.size() != numQuads || boxes.toLocal.size() != numBoxes || boxes.shapeIndex.size() != numBoxes) {
+        return false;
+    }
+    for (int e = 0 ; e < numSpheres + numQuads + numBoxes ; e++) {
+        int shape = EntryShape(-1 - e);
+        int j;
+        if (shape < 0 || shape >= shapes.size() || ShapeKind(shapes[shape]) != EntryKind(-1 - e, j)) return false;
+    }
+
+    vector<BVHNode>& nodes = bvh.getNodes();
+    vector<int>& entries = bvh.getPrimitiveIndices();
+    vector<int> depth(nodes.size(), 0);
+    for (int i = 0 ; i < nodes.size() ; i++) {
+        const BVHNode& node = nodes[i];
+        if (node.count == 0) {
+            if (node.leftFirst <= i || node.leftFirst + 1 >= nodes.size()) return false;
+            depth[node.leftFirst] = depth[node.leftFirst + 1] = depth[i] + 1;
+            if (depth[i] + 1 >= BVH_STACK_SIZE) return false;
+            continue;
+        }
+        if (node.count < 0 || node.count > MAX_LEAF_PRIMITIVES || node.leftFirst < 0 || node.leftFirst > (int)entries.size() - node.count) return false;
+
+        const int * leaf = &entries[node.leftFirst];
+        int k = 0;
+        while (k < node.count && leaf[k] >= 0) {
+            if (leaf[k] != leaf[0] + k || leaf[k] >= numSlots) return false;
+            k++;
+        }
+        for ( ; k < node.count ; k++) {
+            if (leaf[k] >= 0 || -1 - leaf[k] >= numSpheres + numQuads + numBoxes) return false;
+            int index, previous;
+            if (k > 0 && leaf[k - 1] < 0 && EntryKind(leaf[k], index) == EntryKind(leaf[k - 1], previous) && leaf[k] != leaf[k - 1] - 1) return false;
+        }
+    }
+    return true;
+}
+
+//The file is mapped rather than read so the sections are copied straight from
+//the page cache into the scene's buffers, with no parsing on the way
+bool Scene::LoadCache(string path, uint64_t key, vector<Shape *> shapes) {
+    double start = omp_get_wtime();
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size < (off_t)sizeof(SceneCacheHeader)) {
+        close(fd);
+        cout << "Scene: ignoring damaged cache " << path << endl;
+        return false;
+    }
+    size_t fileSize = info.st_size;
+    void * mapping = mmap(NULL, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        cout << "Scene: could not map cache " << path << endl;
+        return false;
+    }
+
+    const char * base = (const char *)mapping;
+    const SceneCacheHeader * header = (const SceneCacheHeader *)base;
+    if (memcmp(header->magic, SCENE_CACHE_MAGIC, sizeof(header->magic)) != 0 || header->version != SCENE_CACHE_VERSION) {
+        munmap(mapping, fileSize);
+        cout << "Scene: ignoring cache " << path << " from another version" << endl;
+        return false;
+    }
+    if (header->key != key || header->numShapes != shapes.size()) {
+        munmap(mapping, fileSize);
+        cout << "Scene: cache " << path << " is stale" << endl;
+        return false;
+    }
+
+    Scene cached;
+    cached.shapes = shapes;
+    bool valid = ReadSection(base, fileSize, CACHE_MATERIALS, cached.materials)
+        && ReadSection(base, fileSize, CACHE_MATERIAL_INDEX, cached.materialIndex)
+        && ReadSection(base, fileSize, CACHE_MESH_OFFSETS, cached.meshOffsets)
+        && ReadSection(base, fileSize, CACHE_BVH_NODES, cached.bvh.getNodes())
+        && ReadSection(base, fileSize, CACHE_BVH_PRIMITIVES, cached.bvh.getPrimitiveIndices())
+        && ReadSection(base, fileSize, CACHE_TRIANGLE_PACKETS, cached.triangles.getPackets())
+        && ReadSection(base, fileSize, CACHE_TRIANGLE_SHAPES, cached.triangles.getShapeIndices())
+        && ReadSection(base, fileSize, CACHE_SPHERE_CENTRES, cached.spheres.centre)
+        && ReadSection(base, fileSize, CACHE_SPHERE_RADII, cached.spheres.radius)
+        && ReadSection(base, fileSize, CACHE_SPHERE_SHAPES, cached.spheres.shapeIndex)
+        && ReadSection(base, fileSize, CACHE_QUAD_CORNERS, cached.quads.v0)
+        && ReadSection(base, fileSize, CACHE_QUAD_NORMALS, cached.quads.normal)
+        && ReadSection(base, fileSize, CACHE_QUAD_U_AXES, cached.quads.uAxis)
+        && ReadSection(base, fileSize, CACHE_QUAD_V_AXES, cached.quads.vAxis)
+        && ReadSection(base, fileSize, CACHE_QUAD_SHAPES, cached.quads.shapeIndex)
+        && ReadSection(base, fileSize, CACHE_BOX_CORNERS, cached.boxes.v0)
+        && ReadSection(base, fileSize, CACHE_BOX_FRAMES, cached.boxes.toLocal)
+        && ReadSection(base, fileSize, CACHE_BOX_SHAPES, cached.boxes.shapeIndex);
+    munmap(mapping, fileSize);
+    if (!valid || !cached.CacheIsConsistent()) {
+        cout << "Scene: ignoring damaged cache " << path << endl;
+        return false;
+    }
+
+    *this = move(cached);
+    cout << "Loaded BVH with " << bvh.getNumNodes() << " nodes over " << materialIndex.size() << " primitives from "
+         << path << " in " << (omp_get_wtime() - start) * 1000 << "ms" << endl;
+    return true;
+}
+
+// GETTERS
+vector<Shape *>& Scene::getShapes() {
+    return shapes;
+}
+
+Shape * Scene::getShape(int index) {
+    return shapes[index];
+}
+
+float Scene::getCurvature(int primitive) {
+    if (primitive >= shapes.size()) return 0;
+    Sphere * sphere = dynamic_cast<Sphere *>(shapes[primitive]);
+    return sphere ? 1.0f / sphere->getRadius() : 0;
+}
+
+Material& Scene::getMaterial(int primitive) {
+    if (primitive < materialIndex.size()) {
+        return materials[materialIndex[primitive]];
+    }
+    int i = upper_bound(instanceOffsets.begin(), instanceOffsets.end(), primitive) - instanceOffsets.begin() - 1;
+    return instances[i].object->getMaterial(primitive - instanceOffsets[i]);
+}
+
+BVH& Scene::getBVH() {
+    return bvh;
+}
+
+int Scene::getNumPrimitives() {
+    if (instances.empty()) return materialIndex.size();
+    return instanceOffsets.back() + instances.back().object->getNumPrimitives();
+}
+
+AABB Scene::getBounds() {
+    AABB bounds;
+    if (bvh.getNumNodes() > 0) bounds.grow(bvh.getNodes()[0].bounds);
+    if (instanceBVH.getNumNodes() > 0) bounds.grow(instanceBVH.getNodes()[0].bounds);
+    return bounds;
+}
@@ -0,0 +1,259 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <climits>
+#include "Shape.h"
+#include "Material.h"
+#include "BVH.h"
+#include "WideBVH.h"
+#include "TrianglePackets.h"
+#include "Mesh.h"
+#include "ContentHash.h"
+
+// Tests each thread adds to the shared occluder cache counts at once
+#define OCCLUDER_CACHE_FLUSH 4096
+// Marks an occluder cache slot with no blocker in it
+#define OCCLUDER_CACHE_EMPTY INT_MIN
+
+using namespace std;
+using glm::vec3;
+using glm::mat3;
+using glm::vec4;
+using glm::mat4;
+
+struct SphereBuffer {
+    vector<vec3> centre;
+    vector<float> radius;
+    vector<int> shapeIndex;
+};
+
+// Quads and boxes as Quad::Distance and Box::Distance take them
+struct QuadBuffer {
+    vector<vec3> v0;
+    vector<vec3> normal;
+    vector<vec3> uAxis;
+    vector<vec3> vAxis;
+    vector<int> shapeIndex;
+};
+
+struct BoxBuffer {
+    vector<vec3> v0;
+    vector<mat3> toLocal;
+    vector<int> shapeIndex;
+};
+
+enum PrimitiveKind { TRIANGLE_PRIMITIVE, SPHERE_PRIMITIVE, QUAD_PRIMITIVE, BOX_PRIMITIVE };
+
+class Scene;
+class ShadowPhotons;
+
+// One placement of a shared scene. Its geometry is traced through the
+// transform rather than copied, so memory grows with the unique geometry
+struct SceneInstance {
+    Scene * object;
+    // Object space to world space. Must be affine
+    mat4 transform;
+};
+
+// An instance as traced: rays are taken into object space by the 4x3
+// worldToObject, and hit normals brought back out by normalToWorld
+struct InstanceRecord {
+    Scene * object;
+    glm::mat4x3 objectToWorld;
+    glm::mat4x3 worldToObject;
+    mat3 normalToWorld;
+};
+
+class Scene {
+
+    private:
+        vector<Shape *> shapes;
+        vector<Mesh *> meshes;
+
+        // Primitives are numbered shapes first, then each mesh's faces from
+        // meshOffsets[m]. Intersections report these numbers as their index
+        vector<int> meshOffsets;
+
+        // Each primitive's material is an index into the shared material table
+        vector<Material> materials;
+        vector<int> materialIndex;
+
+        // Primitives in the order the BVH leaves reference them. Once laid out,
+        // leaves refer to triangles by their packet slot and to the rest by
+        // -1 - i, numbering the spheres, then the quads, then the boxes
+        TrianglePackets triangles;
+        SphereBuffer spheres;
+        QuadBuffer quads;
+        BoxBuffer boxes;
+        BVH bvh;
+
+        // Instances sit under their own top level BVH. Instance i's primitives
+        // are numbered from instanceOffsets[i], after the scene's own
+        vector<InstanceRecord> instances;
+        vector<int> instanceOffsets;
+        BVH instanceBVH;
+
+        bool binnedBuild;
+
+        // When set, single rays walk the compressed wide BVH collapsed from
+        // bvh. Packets, refitting and the cache still use the binary tree
+        bool wide;
+        WideBVH wideBVH;
+
+        bool occluderCacheEnabled;
+
+        // Lets direct lighting skip shadow rays, if set
+        ShadowPhotons * shadowPhotons;
+
+        // Dynamic scenes. Where each shape was laid out (its leaf entry) and
+        // the leaf holding each triangle slot, other entry and instance,
+        // filled on the first update after a build
+        vector<int> shapeLayout;
+        vector<int> slotLeaves;
+        vector<int> entryLeaves;
+        vector<int> instanceLeaves;
+        vector<int> changedShapes;
+        vector<int> changedInstances;
+
+        int AddMaterial(Material material);
+        void TriangleVertices(int primitive, vec3& v0, vec3& v1, vec3& v2);
+        void BuildPrimitives();
+        void BuildInstances();
+        void LayoutPrimitives(vector<int>& trianglePrimitives, vector<int>& otherShapes);
+        static PrimitiveKind ShapeKind(Shape * shape);
+        PrimitiveKind EntryKind(int entry, int& index);
+        void StoreShape(int entry, int shape);
+        bool CacheIsConsistent();
+        static void SetTransform(InstanceRecord& record, mat4 transform);
+        AABB InstanceBounds(int instance);
+        void PrepareRefit();
+        void PrepareInstanceRefit();
+        AABB LeafBounds(int leaf);
+        static AABB PaddedBox(AABB box);
+        void IntersectLeaf(const int * entries, int count, const vec4& start, const vec4& dir, Intersection& closestIntersection, bool& hit);
+        void TraceWide(const vec4& start, const vec4& dir, Intersection& closestIntersection, bool& hit);
+        bool AnyHitWide(const vec4& start, const vec4& dir, float tEnd, bool passTransparent, bool& blocked, int& blocker, bool& blockerFound);
+        bool LeafAnyHit(const int * entries, int count, const vec4& start, const vec4& dir, float tEnd, bool passTransparent, bool& blocked, int& blocker);
+        bool EntryBlocks(int entry, const vec4& start, const vec4& dir, float tEnd, bool passTransparent);
+        void IntersectSpheres(int first, int count, const vec4& start, const vec4& dir, Intersection& closestIntersection, bool& hit);
+        float SphereDistance(int sphere, const vec3& start, const vec3& dir);
+        void IntersectQuads(int first, int count, const vec4& start, const vec4& dir, Intersection& closestIntersection, bool& hit);
+        void IntersectBoxes(int first, int count, const vec4& start, const vec4& dir, Intersection& closestIntersection, bool& hit);
+        float EntryDistance(int entry, const vec3& start, const vec3& dir);
+        int EntryShape(int entry);
+        bool Occluded(vec4 start, vec4 dir, float tmax, bool passTransparent, bool& transparentOnly, int cacheSlot);
+        bool TraceClosest(const vec4& start, const vec4& dir, Intersection& closestIntersection);
+        void TraceInstances(const vec4& start, const vec4& dir, Intersection& closestIntersection, bool& hit);
+        void IntersectInstance(int instance, const vec4& start, const vec4& dir, Intersection& closestIntersection, bool& hit);
+        bool AnyHit(const vec4& start, const vec4& dir, float tEnd, bool passTransparent, bool& blocked, int& blocker, bool& blockerFound);
+        bool AnyInstanceHit(const vec4& start, const vec4& dir, float tEnd, bool passTransparent, bool& blocked);
+        static float PacketEntry(const AABB& box, const vec3& start, float invDir[3][RAY_PACKET_SIZE], float tmax[], int n, bool coherent, const vec3& invLower, const vec3& invUpper);
+
+    public:
+        // CONSTRUCTOR
+        // An empty scene, to be filled by LoadCache or assigned a built one
+        Scene();
+        // binnedBuild trades some trace speed for a much faster, parallel BVH build
+        Scene(vector<Shape *> shapes, bool binnedBuild);
+        Scene(vector<Shape *> shapes, vector<Mesh *> meshes, bool binnedBuild);
+        // The instanced scenes must outlive this one
+        Scene(vector<Shape *> shapes, vector<Mesh *> meshes, vector<SceneInstance> instances, bool binnedBuild);
+
+        // Closest intersection of a ray or photon travelling from start along dir
+        bool closestIntersection(vec4 start, vec4 dir, Intersection& closestIntersection);
+
+        // Closest intersection of every ray in the packet, tracing them
+        // together. hits[r] is set if ray r hit anything
+        void closestIntersections(RayPacket& packet, Intersection closestIntersections[], bool hits[]);
+
+        // Any-hit query for shadow rays: true if a shape lies along dir within
+        // tmax of start, measured in the same units as start. Returns at the
+        // first blocker found without building a hit record
+        bool occluded(vec4 start, vec4 dir, float tmax);
+
+        // As above, but the search only stops early at an opaque blocker.
+        // transparentOnly is set if every blocker found was transparent
+        bool occluded(vec4 start, vec4 dir, float tmax, bool& transparentOnly);
+
+        // As above, first trying the blocker that last stopped a shadow ray
+        // in the same cache slot on this thread, usually one per light.
+        // Neighbouring points tend to be shadowed by the same shape, so this
+        // mostly saves walking the BVH at all
+        bool occluded(vec4 start, vec4 dir, float tmax, bool& transparentOnly, int cacheSlot);
+
+        // Turn the occluder cache on or off, on by default
+        void useOccluderCache(bool enabled);
+
+        // Shadow rays that found a blocker cached and tried it, over every
+        // thread and scene, and how many it stopped
+        static void getOccluderCacheCounts(long& tests, long& hits);
+        static void resetOccluderCacheCounts();
+
+        // Direct lighting asks these whether a point is plainly lit or in
+        // shadow before taking shadow rays. Null, the default, always takes
+        // them. The photons must outlive their use by the scene
+        void useShadowPhotons(ShadowPhotons * shadowPhotons);
+        ShadowPhotons * getShadowPhotons();
+
+        // Trace single rays and photons through an 8 wide BVH with 8 bit
+        // quantised child boxes, collapsed from the binary one, or go back
+        // to the binary BVH
+        void useWideBVH(bool wide);
+
+        // DYNAMIC SCENES
+        // Records that a shape has moved or changed shape.
+        // Its material must stay the same
+        void shapeChanged(int shape);
+
+        // Moves an instance. Instances of a scene that was itself updated
+        // need setting again for their bounds to follow
+        void setInstanceTransform(int instance, mat4 transform);
+
+        // Brings the BVHs up to date with the changes recorded since the last
+        // update by refitting the bounds of the leaves holding them, so the
+        // cost scales with what moved rather than the size of the scene. A
+        // BVH is rebuilt instead once refitting has raised its SAH cost
+        // BVH_REFIT_REBUILD_RATIO times over the cost as built. Returns true
+        // if anything was rebuilt
+        bool Update();
+
+        // Bytes held by the acceleration structure and per primitive tables.
+        // Instanced scenes are shared, so are not counted
+        size_t getMemoryUsage();
+
+        // Add the type, geometry and material of every shape to the hash, for
+        // keying the scene cache by what the scene is built from
+        static void HashShapes(vector<Shape *>& shapes, ContentHash& hash);
+        static void HashMaterial(Material material, ContentHash& hash);
+
+        // Writes the laid out scene (material tables, BVH, triangle packets,
+        // spheres, quads and boxes) to a binary file tagged with key. Returns false if it could
+        // not be written, or if the scene has instances
+        bool SaveCache(string path, uint64_t key);
+
+        // Replaces the scene with the one cached at path if it was saved with
+        // the same key, so nothing is parsed or built. shapes must be the
+        // shapes the cache was built from. Returns false, leaving the scene
+        // as it was, if the file is missing, stale or damaged, including any
+        // index in it that points outside the table it indexes
+        bool LoadCache(string path, uint64_t key, vector<Shape *> shapes);
+
+        // GETTERS
+        vector<Shape *>& getShapes();
+        // Only primitives below getShapes().size() are shapes
+        Shape * getShape(int index);
+        Material& getMaterial(int primitive);
+        // One over the radius for spheres, 0 for every flat primitive
+        float getCurvature(int primitive);
+        BVH& getBVH();
+        // Primitives of the scene's own and of every instance
+        int getNumPrimitives();
+        // Bounds of everything in the scene, in its own space
+        AABB getBounds();
+};
+
+#endif
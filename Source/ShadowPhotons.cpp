@@ -0,0 +1,91 @@
+#include "ShadowPhotons.h"
+
+// CONSTRUCTOR
+ShadowPhotons::ShadowPhotons() {
+    resolution[0] = resolution[1] = resolution[2] = 0;
+    cellSize = SHADOW_PHOTON_CELL;
+    numPhotons = 0;
+    numSources = 0;
+}
+
+ShadowPhotons::ShadowPhotons(vector<Photon>& photons, int numSources) {
+    this->numSources = numSources;
+    numPhotons = 0;
+    for (int i = 0 ; i < photons.size() ; i++) {
+        if (photons[i].getFlag() == PHOTON_DIRECT || photons[i].getFlag() == PHOTON_SHADOW) {
+            bounds.grow(vec3(photons[i].getPosition()));
+            numPhotons++;
+        }
+    }
+    resolution[0] = resolution[1] = resolution[2] = 0;
+    cellSize = SHADOW_PHOTON_CELL;
+    if (!isUsable()) return;
+
+    //Cells grow past SHADOW_PHOTON_CELL in scenes too large for the grid
+    vec3 extent = bounds.upper - bounds.lower;
+    float largest = glm::max(extent.x, glm::max(extent.y, extent.z));
+    cellSize = glm::max(cellSize, largest / (MAX_SHADOW_PHOTON_CELLS - 1));
+    for (int k = 0 ; k < 3 ; k++) {
+        resolution[k] = (int) (extent[k] / cellSize) + 1;
+    }
+    directCounts.assign(resolution[0] * resolution[1] * resolution[2], 0);
+    shadowCounts.assign(resolution[0] * resolution[1] * resolution[2], 0);
+
+    for (int i = 0 ; i < photons.size() ; i++) {
+        short flag = photons[i].getFlag();
+        if (flag != PHOTON_DIRECT && flag != PHOTON_SHADOW) continue;
+        vec3 cell = (vec3(photons[i].getPosition()) - bounds.lower) / cellSize;
+        int x = glm::min((int) cell.x, resolution[0] - 1);
+        int y = glm::min((int) cell.y, resolution[1] - 1);
+        int z = glm::min((int) cell.z, resolution[2] - 1);
+        int index = (z * resolution[1] + y) * resolution[0] + x;
+        if (flag == PHOTON_DIRECT) {
+            directCounts[index]++;
+        } else {
+            shadowCounts[index]++;
+        }
+    }
+}
+
+//The eight cells are the two along each axis whose centres are nearest the
+//point, a cube one cell wide either side of it. Too few photons nearby to go
+//by counts as unknown, as does a mix of both kinds
+int ShadowPhotons::Visibility(vec4 position) {
+    if (!isUsable()) return VISIBILITY_UNKNOWN;
+
+    vec3 cell = (vec3(position) - bounds.lower) / cellSize - vec3(0.5f);
+    int base[3] = {(int) floor(cell.x), (int) floor(cell.y), (int) floor(cell.z)};
+    int direct = 0;
+    int shadow = 0;
+    for (int dz = 0 ; dz < 2 ; dz++) {
+        int z = base[2] + dz;
+        if (z < 0 || z >= resolution[2]) continue;
+        for (int dy = 0 ; dy < 2 ; dy++) {
+            int y = base[1] + dy;
+            if (y < 0 || y >= resolution[1]) continue;
+            for (int dx = 0 ; dx < 2 ; dx++) {
+                int x = base[0] + dx;
+                if (x < 0 || x >= resolution[0]) continue;
+                int index = (z * resolution[1] + y) * resolution[0] + x;
+                direct += directCounts[index];
+                shadow += shadowCounts[index];
+            }
+        }
+    }
+
+    if (direct + shadow < SHADOW_PHOTON_COUNT) return VISIBILITY_UNKNOWN;
+    if (shadow == 0) return VISIBILITY_LIT;
+    if (direct == 0) return VISIBILITY_SHADOWED;
+    return VISIBILITY_UNKNOWN;
+}
+
+// GETTERS
+int ShadowPhotons::getNumPhotons() {
+    return numPhotons;
+}
+
+//Counts from several lights would pass a point lit by one of them as lit by
+//the rest, or a point shadowed from one as shadowed from the rest
+bool ShadowPhotons::isUsable() {
+    return numPhotons > 0 && numSources == 1;
+}
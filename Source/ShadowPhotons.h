@@ -0,0 +1,67 @@
+#ifndef SHADOW_PHOTONS_H
+#define SHADOW_PHOTONS_H
+
+#include <glm/glm.hpp>
+#include <vector>
+#include "Photon.h"
+#include "AABB.h"
+
+using namespace std;
+using glm::vec3;
+using glm::mat3;
+using glm::vec4;
+using glm::mat4;
+
+// What a point's nearby direct and shadow photons say about whether the
+// lights reach it
+#define VISIBILITY_UNKNOWN 0
+#define VISIBILITY_LIT 1
+#define VISIBILITY_SHADOWED 2
+
+// Side of the grid cells photons are counted in, and the fewest photons
+// around a point worth going by
+#define SHADOW_PHOTON_CELL 0.05f
+#define SHADOW_PHOTON_COUNT 8
+
+// Most cells along each side of the grid
+#define MAX_SHADOW_PHOTON_CELLS 256
+
+// The direct and shadow photons of a photon map, after Jensen's shadow
+// photons. Where the photons around a point are all direct the point is lit,
+// where they are all shadow photons it is in shadow, and only in between,
+// in the penumbrae, does it take shadow rays to tell. The photons are only
+// counted, per cell of a uniform grid over them, so asking costs a handful
+// of lookups. The photons do not record which light they came from, so a
+// point lit by one light could pass for lit by all of them; with more than
+// one light source the grid is not built and every point is left unknown
+class ShadowPhotons {
+
+    private:
+        AABB bounds;
+        int resolution[3];
+        float cellSize;
+        vector<int> directCounts;
+        vector<int> shadowCounts;
+        int numPhotons;
+        int numSources;
+
+    public:
+        // CONSTRUCTOR
+        ShadowPhotons();
+        // Counts the direct and shadow photons among photons, sent out by
+        // numSources light spheres and emissive shapes
+        ShadowPhotons(vector<Photon>& photons, int numSources);
+
+        // VISIBILITY_LIT or VISIBILITY_SHADOWED if the photons in the eight
+        // cells nearest position all agree and there are at least
+        // SHADOW_PHOTON_COUNT of them, otherwise VISIBILITY_UNKNOWN. Always
+        // VISIBILITY_UNKNOWN unless there is a single light source
+        int Visibility(vec4 position);
+
+        // GETTERS
+        int getNumPhotons();
+        // Whether Visibility can tell anything, with a single light source
+        bool isUsable();
+};
+
+#endif
@@ -5,6 +5,14 @@ Shape::Shape(Material material) {
     setMaterial(material);
 }
 
+bool Shape::intersects(Ray * ray, Intersection & intersection, int index) {
+    return intersects(ray->getStart(), ray->getDirection(), intersection, index);
+}
+
+bool Shape::intersects(Photon * photon, Intersection & intersection, int index) {
+    return intersects(photon->getPosition(), photon->getDirection(), intersection, index);
+}
+
 // Getters
 Material Shape::getMaterial() {
     return material;
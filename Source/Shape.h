@@ -5,6 +5,7 @@
 #include "Material.h"
 #include "Ray.h"
 #include "Photon.h"
+#include "AABB.h"
 
 using namespace std;
 using glm::vec3;
@@ -18,11 +19,17 @@ class Shape {
         // Constructor
         Shape(Material material);
 
-        // Tests whether the shape intersects a ray
-        virtual bool intersects(Ray * ray, Intersection & intersection, int index)=0;
+        // Tests whether the shape intersects a ray or photon travelling from start along dir
+        virtual bool intersects(vec4 start, vec4 dir, Intersection & intersection, int index)=0;
 
         // Tests whether the shape intersects a ray
-        virtual bool intersects(Photon * photon, Intersection & intersection, int index)=0;
+        bool intersects(Ray * ray, Intersection & intersection, int index);
+
+        // Tests whether the shape intersects a photon
+        bool intersects(Photon * photon, Intersection & intersection, int index);
+
+        // Box enclosing the shape, used to build the BVH
+        virtual AABB getBoundingBox()=0;
 
         // Getters
         Material getMaterial();
@@ -29,10 +29,11 @@ bool Sphere::solveQuadratic(const float &a, const float &b, const float &c, floa
     return true;
 }
 
-bool Sphere::intersects(Ray * ray, Intersection & intersection, int index) {
+//Check if a ray or photon intersects with sphere
+bool Sphere::intersects(vec4 start4, vec4 dir4, Intersection & intersection, int index) {
     bool returnVal = false;
-    vec3 start = vec3(ray->getStart());
-    vec3 dir = vec3(ray->getDirection()) * (float)SCREEN_HEIGHT;
+    vec3 start = vec3(start4);
+    vec3 dir = vec3(dir4) * (float)SCREEN_HEIGHT;
 
     float t0, t1;
 
@@ -54,7 +55,7 @@ bool Sphere::intersects(Ray * ray, Intersection & intersection, int index) {
         if (t0 >= 0) {
             if (t0 < intersection.distance && t0 > 0) {
                 returnVal = true;
-                intersection.position = ray->getStart() + t0 * vec4(dir, 1);
+                intersection.position = start4 + t0 * vec4(dir, 1);
                 intersection.distance = t0;
                 intersection.index = index;
                 vec3 normal = normalize((start + t0 * dir) - centre);
@@ -65,41 +66,10 @@ bool Sphere::intersects(Ray * ray, Intersection & intersection, int index) {
     return returnVal;
 }
 
-//Check if a photon intersects with sphere
-bool Sphere::intersects(Photon * photon, Intersection & intersection, int index) {
-    bool returnVal = false;
-    vec3 start = vec3(photon->getPosition());
-    vec3 dir = vec3(photon->getDirection()) * (float)SCREEN_HEIGHT;
-
-    float t0, t1;
-
-    float r = getRadius();
-    vec3 centre = vec3(getCentre());
-
-    vec3 L = start - centre;
-    float a = dot(dir, dir);
-    float b = 2 * dot(dir, L);
-    float c = dot(L, L) - r * r;
-
-    if (solveQuadratic(a, b, c, t0, t1)) {
-        if (t0 > t1) {
-            swap(t0, t1);
-        }
-        if (t0 < 0) {
-            t0 = t1; // if t0 is negative, let's use t1 instead
-        }
-        if (t0 >= 0) {
-            if (t0 < intersection.distance && t0 > 0) {
-                returnVal = true;
-                intersection.position = photon->getPosition() + t0 * vec4(dir, 1);
-                intersection.distance = t0;
-                intersection.index = index;
-                vec3 normal = normalize((start + t0 * dir) - centre);
-                intersection.normal = vec4(normal, 1);
-            }
-        }
-    }
-    return returnVal;
+AABB Sphere::getBoundingBox() {
+    vec3 c = vec3(getCentre());
+    vec3 r = vec3(getRadius());
+    return AABB(c - r, c + r);
 }
 
 // Getters
@@ -13,9 +13,10 @@ class Sphere : public Shape {
         // Constructor
         Sphere(vec4 centre, float radius, Material material);
 
-        bool solveQuadratic(const float &a, const float &b, const float &c, float &x0, float &x1);
-        bool intersects(Ray * ray, Intersection & intersection, int index);
-        bool intersects(Photon * photon, Intersection & intersection, int index);
+        static bool solveQuadratic(const float &a, const float &b, const float &c, float &x0, float &x1);
+        using Shape::intersects;
+        bool intersects(vec4 start, vec4 dir, Intersection & intersection, int index);
+        AABB getBoundingBox();
 
         // Getters
         vec4 getCentre();
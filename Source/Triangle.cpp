@@ -10,11 +10,9 @@ Triangle::Triangle(vec4 v0, vec4 v1, vec4 v2, Material material) : Shape(materia
     computeAndSetNormal();
 }
 
-// Tests whether the triangle intersects a ray
-bool Triangle::intersects(Ray * ray, Intersection & intersection, int index) {
+// Tests whether the triangle intersects a ray or photon
+bool Triangle::intersects(vec4 start, vec4 dir, Intersection & intersection, int index) {
     bool returnVal = false;
-    vec4 start = ray->getStart();
-    vec4 dir = ray->getDirection();
 
     dir = vec4(vec3(dir) * (float)SCREEN_HEIGHT, 1);
 
@@ -44,38 +42,12 @@ bool Triangle::intersects(Ray * ray, Intersection & intersection, int index) {
     return returnVal;
 }
 
-// Tests whether the triangle intersects a photon
-bool Triangle::intersects(Photon * photon, Intersection & intersection, int index) {
-    bool returnVal = false;
-    vec4 start = photon->getPosition();
-    vec4 dir = photon->getDirection();
-
-    dir = vec4(vec3(dir) * (float)SCREEN_HEIGHT, 1);
-
-    vec4 v0 = getV0();
-    vec4 v1 = getV1();
-    vec4 v2 = getV2();
-
-    vec3 e1 = vec3(v1.x - v0.x, v1.y - v0.y, v1.z - v0.z);
-    vec3 e2 = vec3(v2.x - v0.x, v2.y - v0.y, v2.z - v0.z);
-    vec3 b = vec3(start.x - v0.x, start.y - v0.y, start.z - v0.z);
-
-    mat3 A(vec3(-dir), e1, e2);
-
-    vec3 solution;
-
-    bool crmr = cramer(A, b, solution);
-
-    if (crmr && solution.x >= 0.0f && solution.y >= 0.0f && solution.z >= 0.0f && solution.y + solution.z <= 1.0f) {
-        if (solution.x < intersection.distance) {
-            intersection.position = start + solution.x * dir;
-            intersection.distance = solution.x;
-            intersection.index = index;
-            intersection.normal = normal;
-            returnVal = true;
-        }
-    }
-    return returnVal;
+AABB Triangle::getBoundingBox() {
+    AABB box;
+    box.grow(vec3(v0));
+    box.grow(vec3(v1));
+    box.grow(vec3(v2));
+    return box;
 }
 
 // Cramer
@@ -17,11 +17,11 @@ class Triangle : public Shape {
         // Constructor
         Triangle(vec4 v0, vec4 v1, vec4 v2, Material material);
 
-        // Tests whether a triangle intersects a ray
-        bool intersects(Ray * ray, Intersection & intersection, int index);
+        // Tests whether a triangle intersects a ray or photon
+        using Shape::intersects;
+        bool intersects(vec4 start, vec4 dir, Intersection & intersection, int index);
 
-        //Test whether a photon intersects a ray
-        bool intersects(Photon * photon, Intersection & intersection, int index);
+        AABB getBoundingBox();
 
         // Cramer
         bool cramer(mat3 A, vec3 b, vec3& solution);
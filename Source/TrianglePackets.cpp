@@ -0,0 +1,143 @@
+#include "TrianglePackets.h"
+
+#include <limits>
+
+// CONSTRUCTOR
+TrianglePackets::TrianglePackets() {
+}
+
+int TrianglePackets::AddRun(vector<vec3>& vertices, vector<int>& shapeIndices) {
+    int firstSlot = this->shapeIndices.size();
+    for (int k = 0 ; k < shapeIndices.size() ; k++) {
+        //Unused lanes of the last packet have zero edges, so never hit
+        int slot = this->shapeIndices.size();
+        if (slot % TRIANGLE_PACKET_WIDTH == 0) {
+            packets.push_back(TrianglePacket());
+        }
+        this->shapeIndices.push_back(shapeIndices[k]);
+        SetTriangle(slot, vertices[3 * k], vertices[3 * k + 1], vertices[3 * k + 2]);
+    }
+    return firstSlot;
+}
+
+void TrianglePackets::SetTriangle(int slot, vec3 v0, vec3 v1, vec3 v2) {
+    TrianglePacket& packet = packets[slot / TRIANGLE_PACKET_WIDTH];
+    int lane = slot % TRIANGLE_PACKET_WIDTH;
+    vec3 e1 = v1 - v0;
+    vec3 e2 = v2 - v0;
+    for (int a = 0 ; a < 3 ; a++) {
+        packet.v0[a][lane] = v0[a];
+        packet.e1[a][lane] = e1[a];
+        packet.e2[a][lane] = e2[a];
+    }
+}
+
+//Moller-Trumbore solves the same system as Triangle::cramer,
+//[-dir e1 e2] (t u v) = start - v0, with triple products that share the
+//cross products between t, u and v
+void TrianglePackets::LaneDistances(const TrianglePacket& packet, const vec4& start, const vec4& dir, float tLane[TRIANGLE_PACKET_WIDTH]) {
+    const float ox = start.x, oy = start.y, oz = start.z;
+    const float dx = dir.x, dy = dir.y, dz = dir.z;
+
+    #pragma omp simd
+    for (int lane = 0 ; lane < TRIANGLE_PACKET_WIDTH ; lane++) {
+        float e1x = packet.e1[0][lane], e1y = packet.e1[1][lane], e1z = packet.e1[2][lane];
+        float e2x = packet.e2[0][lane], e2y = packet.e2[1][lane], e2z = packet.e2[2][lane];
+
+        // pvec = dir x e2
+        float px = dy * e2z - dz * e2y;
+        float py = dz * e2x - dx * e2z;
+        float pz = dx * e2y - dy * e2x;
+        float det = e1x * px + e1y * py + e1z * pz;
+        float invDet = det != 0.0f ? 1.0f / det : 0.0f;
+
+        // tvec = start - v0, qvec = tvec x e1
+        float tx = ox - packet.v0[0][lane];
+        float ty = oy - packet.v0[1][lane];
+        float tz = oz - packet.v0[2][lane];
+        float qx = ty * e1z - tz * e1y;
+        float qy = tz * e1x - tx * e1z;
+        float qz = tx * e1y - ty * e1x;
+
+        float u = (tx * px + ty * py + tz * pz) * invDet;
+        float v = (dx * qx + dy * qy + dz * qz) * invDet;
+        float t = (e2x * qx + e2y * qy + e2z * qz) * invDet;
+
+        bool hit = det != 0.0f && t >= 0.0f && u >= 0.0f && v >= 0.0f && u + v <= 1.0f;
+        tLane[lane] = hit ? t : numeric_limits<float>::max();
+    }
+}
+
+//Runs need not start on a packet boundary, so lanes outside the run are
+//computed but ignored
+bool TrianglePackets::Intersect(int first, int count, const vec4& start, const vec4& dir, Intersection& closestIntersection) {
+    bool returnVal = false;
+    int end = first + count;
+    for (int p = first / TRIANGLE_PACKET_WIDTH ; p * TRIANGLE_PACKET_WIDTH < end ; p++) {
+        float tLane[TRIANGLE_PACKET_WIDTH];
+        LaneDistances(packets[p], start, dir, tLane);
+
+        //Lanes are taken in order so ties resolve as in the scalar loop
+        for (int lane = 0 ; lane < TRIANGLE_PACKET_WIDTH ; lane++) {
+            int slot = p * TRIANGLE_PACKET_WIDTH + lane;
+            if (slot >= first && slot < end && tLane[lane] < closestIntersection.distance) {
+                closestIntersection.position = start + tLane[lane] * dir;
+                closestIntersection.distance = tLane[lane];
+                closestIntersection.index = shapeIndices[slot];
+                //As Triangle::computeAndSetNormal
+                const TrianglePacket& packet = packets[p];
+                vec3 e1(packet.e1[0][lane], packet.e1[1][lane], packet.e1[2][lane]);
+                vec3 e2(packet.e2[0][lane], packet.e2[1][lane], packet.e2[2][lane]);
+                closestIntersection.normal = vec4(normalize(cross(e2, e1)), 1.0f);
+                returnVal = true;
+            }
+        }
+    }
+    return returnVal;
+}
+
+int TrianglePackets::PacketHits(int packet, int first, int count, const vec4& start, const vec4& dir, float tmax) {
+    float tLane[TRIANGLE_PACKET_WIDTH];
+    LaneDistances(packets[packet], start, dir, tLane);
+
+    int mask = 0;
+    for (int lane = 0 ; lane < TRIANGLE_PACKET_WIDTH ; lane++) {
+        int slot = packet * TRIANGLE_PACKET_WIDTH + lane;
+        if (slot >= first && slot < first + count && tLane[lane] < tmax) mask |= 1 << lane;
+    }
+    return mask;
+}
+
+AABB TrianglePackets::getBounds(int slot) {
+    const TrianglePacket& packet = packets[slot / TRIANGLE_PACKET_WIDTH];
+    int lane = slot % TRIANGLE_PACKET_WIDTH;
+    vec3 v0(packet.v0[0][lane], packet.v0[1][lane], packet.v0[2][lane]);
+    vec3 e1(packet.e1[0][lane], packet.e1[1][lane], packet.e1[2][lane]);
+    vec3 e2(packet.e2[0][lane], packet.e2[1][lane], packet.e2[2][lane]);
+    AABB box;
+    box.grow(v0);
+    box.grow(v0 + e1);
+    box.grow(v0 + e2);
+    return box;
+}
+
+size_t TrianglePackets::getMemoryUsage() {
+    return packets.size() * sizeof(TrianglePacket) + shapeIndices.size() * sizeof(int);
+}
+
+// GETTERS
+int TrianglePackets::getNumPackets() {
+    return packets.size();
+}
+
+int TrianglePackets::getShapeIndex(int slot) {
+    return shapeIndices[slot];
+}
+
+vector<TrianglePacket>& TrianglePackets::getPackets() {
+    return packets;
+}
+
+vector<int>& TrianglePackets::getShapeIndices() {
+    return shapeIndices;
+}
@@ -0,0 +1,72 @@
+#ifndef TRIANGLE_PACKETS_H
+#define TRIANGLE_PACKETS_H
+
+#include <glm/glm.hpp>
+#include <vector>
+#include "Ray.h"
+#include "AABB.h"
+
+using namespace std;
+using glm::vec3;
+using glm::mat3;
+using glm::vec4;
+using glm::mat4;
+
+// Number of triangles tested against one ray at once, one per SIMD lane
+#define TRIANGLE_PACKET_WIDTH 4
+
+// Precomputed Moller-Trumbore records for TRIANGLE_PACKET_WIDTH triangles,
+// stored by component so each lane of the kernel reads its own float
+struct alignas(16) TrianglePacket {
+    float v0[3][TRIANGLE_PACKET_WIDTH];
+    float e1[3][TRIANGLE_PACKET_WIDTH];
+    float e2[3][TRIANGLE_PACKET_WIDTH];
+};
+
+class TrianglePackets {
+
+    private:
+        vector<TrianglePacket> packets;
+
+        // Per slot (packet * TRIANGLE_PACKET_WIDTH + lane) primitive index.
+        // Normals are rebuilt from the edges on a hit rather than stored
+        vector<int> shapeIndices;
+
+        // Distance to each lane's triangle along dir, or the largest float on a miss
+        static void LaneDistances(const TrianglePacket& packet, const vec4& start, const vec4& dir, float tLane[TRIANGLE_PACKET_WIDTH]);
+
+    public:
+        // CONSTRUCTOR
+        TrianglePackets();
+
+        // Appends a run of triangles, given as three vertices each, to the
+        // next free slots. Returns the slot of the first triangle
+        int AddRun(vector<vec3>& vertices, vector<int>& shapeIndices);
+
+        // Tests the ray against the triangles in slots [first, first + count),
+        // keeping the closest hit nearer than closestIntersection.distance.
+        // dir must already be scaled by SCREEN_HEIGHT like the shapes' own
+        // intersection tests
+        bool Intersect(int first, int count, const vec4& start, const vec4& dir, Intersection& closestIntersection);
+
+        // Replaces the triangle in a slot, keeping its primitive index
+        void SetTriangle(int slot, vec3 v0, vec3 v1, vec3 v2);
+
+        // Box around the triangle in a slot
+        AABB getBounds(int slot);
+
+        // Bit mask of the lanes in the packet whose triangle lies in slots
+        // [first, first + count) and is hit closer than tmax
+        int PacketHits(int packet, int first, int count, const vec4& start, const vec4& dir, float tmax);
+
+        // Bytes held by the packets and slot indices
+        size_t getMemoryUsage();
+
+        // GETTERS
+        int getNumPackets();
+        int getShapeIndex(int slot);
+        vector<TrianglePacket>& getPackets();
+        vector<int>& getShapeIndices();
+};
+
+#endif
@@ -0,0 +1,181 @@
+#include "WideBVH.h"
+
+#include <algorithm>
+#include <cstring>
+#include <cmath>
+#include <iostream>
+#include <limits>
+
+static_assert(sizeof(WideBVHNode) == 80, "WideBVHNode should pack into 80 bytes");
+
+// CONSTRUCTOR
+WideBVH::WideBVH() : stackSize(0) {
+}
+
+bool WideBVH::Build(BVH& binary) {
+    Clear();
+    if (binary.getNumNodes() == 0) return true;
+
+    bounds = binary.getNodes()[0].bounds;
+    nodes.push_back(WideBVHNode());
+    Collapse(0, 0, binary, 0);
+
+    if (stackSize > WIDE_BVH_STACK_SIZE) {
+        cout << "Wide BVH walks need " << stackSize << " stack entries, more than " << WIDE_BVH_STACK_SIZE << endl;
+        Clear();
+        return false;
+    }
+    return true;
+}
+
+void WideBVH::Clear() {
+    nodes.clear();
+    primitiveIndices.clear();
+    stackSize = 0;
+}
+
+//2^exponent as a float, built from its bits
+static float ExponentScale(int8_t exponent) {
+    uint32_t bits = (uint32_t)(exponent + 127) << 23;
+    float scale;
+    memcpy(&scale, &bits, sizeof(float));
+    return scale;
+}
+
+//Opens the largest inner node among the children until there are eight, so
+//the children of a wide node are the binary nodes a ray is most likely to
+//reach. Inner children are given consecutive nodes before any is filled.
+//pending is the most entries that can be left on a walk's stack when it
+//reaches the node, which then pushes at most one entry per child
+void WideBVH::Collapse(int node, int binaryNode, BVH& binary, int pending) {
+    vector<BVHNode>& binaryNodes = binary.getNodes();
+    vector<int>& binaryIndices = binary.getPrimitiveIndices();
+
+    vector<int> children;
+    if (binaryNodes[binaryNode].count > 0) {
+        children.push_back(binaryNode);
+    } else {
+        children.push_back(binaryNodes[binaryNode].leftFirst);
+        children.push_back(binaryNodes[binaryNode].leftFirst + 1);
+    }
+    while (children.size() < WIDE_BVH_WIDTH) {
+        int largest = -1;
+        float largestArea = -1.0f;
+        for (int k = 0 ; k < children.size() ; k++) {
+            const BVHNode& child = binaryNodes[children[k]];
+            if (child.count == 0 && child.bounds.surfaceArea() > largestArea) {
+                largest = k;
+                largestArea = child.bounds.surfaceArea();
+            }
+        }
+        if (largest < 0) break;
+        int opened = children[largest];
+        children[largest] = binaryNodes[opened].leftFirst;
+        children.push_back(binaryNodes[opened].leftFirst + 1);
+    }
+
+    WideBVHNode wide;
+    memset(&wide, 0, sizeof(wide));
+    //The grid has 255 steps across the node on each axis, a power of two each
+    AABB bounds = binaryNodes[binaryNode].bounds;
+    vec3 scale;
+    for (int a = 0 ; a < 3 ; a++) {
+        float extent = bounds.upper[a] - bounds.lower[a];
+        int exponent = extent > 0 ? (int)ceil(log2(extent / 255.0f)) : -100;
+        exponent = glm::clamp(exponent, -100, 100);
+        wide.origin[a] = bounds.lower[a];
+        wide.exponent[a] = exponent;
+        scale[a] = ExponentScale(exponent);
+    }
+
+    vector<int> innerChildren;
+    wide.childBase = nodes.size();
+    wide.primitiveBase = primitiveIndices.size();
+    for (int k = 0 ; k < WIDE_BVH_WIDTH ; k++) {
+        if (k >= children.size()) {
+            //An inverted box no ray can enter
+            for (int a = 0 ; a < 3 ; a++) {
+                wide.lower[a][k] = 255;
+                wide.upper[a][k] = 0;
+            }
+            continue;
+        }
+
+        const BVHNode& child = binaryNodes[children[k]];
+        for (int a = 0 ; a < 3 ; a++) {
+            float lower = floor((child.bounds.lower[a] - wide.origin[a]) / scale[a]);
+            float upper = ceil((child.bounds.upper[a] - wide.origin[a]) / scale[a]);
+            wide.lower[a][k] = (uint8_t)glm::clamp(lower, 0.0f, 255.0f);
+            wide.upper[a][k] = (uint8_t)glm::clamp(upper, 0.0f, 255.0f);
+        }
+        if (child.count > 0) {
+            wide.meta[k] = child.count;
+            primitiveIndices.insert(primitiveIndices.end(), binaryIndices.begin() + child.leftFirst, binaryIndices.begin() + child.leftFirst + child.count);
+        } else {
+            wide.innerMask |= 1 << k;
+            innerChildren.push_back(children[k]);
+        }
+    }
+
+    nodes[node] = wide;
+    nodes.resize(nodes.size() + innerChildren.size());
+    stackSize = max(stackSize, pending + (int)children.size());
+    for (int j = 0 ; j < innerChildren.size() ; j++) {
+        Collapse(wide.childBase + j, innerChildren[j], binary, pending + (int)children.size() - 1);
+    }
+}
+
+//Entry and exit along each axis are origin + q * scale planes, so with the
+//ray's offset and inverse direction folded in each is one multiply add on
+//the 8 bit coordinate. The near plane is the lower one unless the ray runs
+//backwards along the axis
+void WideBVH::ChildDistances(const WideBVHNode& node, const vec3& start, const vec3& invDir, float tmax, float tEnter[WIDE_BVH_WIDTH]) {
+    float offset[3];
+    float step[3];
+    const uint8_t * nearPlane[3];
+    const uint8_t * farPlane[3];
+    for (int a = 0 ; a < 3 ; a++) {
+        offset[a] = (node.origin[a] - start[a]) * invDir[a];
+        step[a] = ExponentScale(node.exponent[a]) * invDir[a];
+        nearPlane[a] = invDir[a] >= 0 ? node.lower[a] : node.upper[a];
+        farPlane[a] = invDir[a] >= 0 ? node.upper[a] : node.lower[a];
+    }
+
+    #pragma omp simd
+    for (int k = 0 ; k < WIDE_BVH_WIDTH ; k++) {
+        float nearX = offset[0] + nearPlane[0][k] * step[0];
+        float nearY = offset[1] + nearPlane[1][k] * step[1];
+        float nearZ = offset[2] + nearPlane[2][k] * step[2];
+        float farX = offset[0] + farPlane[0][k] * step[0];
+        float farY = offset[1] + farPlane[1][k] * step[1];
+        float farZ = offset[2] + farPlane[2][k] * step[2];
+        float tNear = glm::max(glm::max(nearX, nearY), glm::max(nearZ, 0.0f));
+        float tFar = glm::min(glm::min(farX, farY), glm::min(farZ, tmax));
+        tEnter[k] = tNear <= tFar ? tNear : numeric_limits<float>::max();
+    }
+}
+
+size_t WideBVH::getMemoryUsage() {
+    return nodes.size() * sizeof(WideBVHNode) + primitiveIndices.size() * sizeof(int);
+}
+
+// GETTERS
+int WideBVH::getNumNodes() {
+    return nodes.size();
+}
+
+int WideBVH::getStackSize() {
+    return stackSize;
+}
+
+AABB& WideBVH::getBounds() {
+    return bounds;
+}
+
+vector<WideBVHNode>& WideBVH::getNodes() {
+    return nodes;
+}
+
+vector<int>& WideBVH::getPrimitiveIndices() {
+    return primitiveIndices;
+}
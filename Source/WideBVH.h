@@ -0,0 +1,76 @@
+#ifndef WIDE_BVH_H
+#define WIDE_BVH_H
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <cstdint>
+#include "AABB.h"
+#include "BVH.h"
+
+using namespace std;
+using glm::vec3;
+using glm::mat3;
+using glm::vec4;
+using glm::mat4;
+
+#define WIDE_BVH_WIDTH 8
+#define WIDE_BVH_STACK_SIZE 256
+
+// Eight children in 80 bytes. Child boxes are stored as 8 bit coordinates on
+// a grid over the node's own box, from origin in steps of 2^exponent on each
+// axis, rounded outwards so they always contain the child. Inner children
+// are consecutive nodes from childBase. Leaf children hold meta[k] entries
+// each, one leaf after another from primitiveBase, so leaf k starts after
+// the entries of the leaves before it. Unused children have meta[k] 0
+struct alignas(16) WideBVHNode {
+    float origin[3];
+    int8_t exponent[3];
+    uint8_t innerMask;
+    int childBase;
+    int primitiveBase;
+    uint8_t meta[WIDE_BVH_WIDTH];
+    uint8_t lower[3][WIDE_BVH_WIDTH];
+    uint8_t upper[3][WIDE_BVH_WIDTH];
+};
+
+class WideBVH {
+
+    private:
+        vector<WideBVHNode> nodes;
+        vector<int> primitiveIndices;
+        // The root's own box, as nodes only hold their children's
+        AABB bounds;
+        // Most entries a walk over the tree can hold on its stack at once
+        int stackSize;
+
+        void Collapse(int node, int binaryNode, BVH& binary, int pending);
+
+    public:
+        // CONSTRUCTOR
+        WideBVH();
+
+        // Collapses a built binary BVH, each wide node taking the eight
+        // largest binary nodes below it as children. Leaf entries are
+        // copied from the binary tree's primitive indices unchanged. Returns
+        // false, leaving the tree empty, if walking it could take more than
+        // WIDE_BVH_STACK_SIZE stack entries
+        bool Build(BVH& binary);
+        void Clear();
+
+        // Distance at which the ray enters each child's box, or the largest
+        // float if it misses the box or only enters it beyond tmax. The
+        // eight boxes are tested together, one per SIMD lane
+        static void ChildDistances(const WideBVHNode& node, const vec3& start, const vec3& invDir, float tmax, float tEnter[WIDE_BVH_WIDTH]);
+
+        // Bytes held by the nodes and leaf entries
+        size_t getMemoryUsage();
+
+        // GETTERS
+        int getNumNodes();
+        int getStackSize();
+        AABB& getBounds();
+        vector<WideBVHNode>& getNodes();
+        vector<int>& getPrimitiveIndices();
+};
+
+#endif
@@ -13,12 +13,22 @@
 #include "Ray.h"
 #include "ImageBuffer.h"
 #include "LightSphere.h"
+#include "LightTree.h"
+#include "EmissiveShapes.h"
 #include "Material.h"
 #include "Triangle.h"
 #include "Sphere.h"
+#include "Quad.h"
+#include "Box.h"
 #include "PhotonMap.h"
+#include "IrradianceCache.h"
 #include "LightsAndMaterials.h"
 #include "KDTree.h"
+#include "Scene.h"
+#include "TrianglePackets.h"
+#include "Mesh.h"
+#include "ContentHash.h"
+#include "Benchmarks.h"
 
 using namespace std;
 using glm::vec3;
@@ -39,7 +49,7 @@ screen* screen,
 Camera& camera,
 LightSphere& ls,
 PhotonMap pmap,
-vector<Shape *> shapes,
+Scene& scene,
 KDTree * globalTracedPointer,
 vector<Photon> nearestPhotonsPointer,
 vec4 testPosition
@@ -47,7 +57,52 @@ vec4 testPosition
 
 void loadShapes(
 vector<Triangle>& triangles,
-vector<Sphere>& spheres
+vector<Sphere>& spheres,
+vector<Quad>& quads,
+vector<Box>& boxes,
+bool analytic
+);
+
+void DrawWavefront(
+screen* screen,
+Camera& camera,
+LightSphere& ls,
+PhotonMap& pmap,
+Scene& scene,
+ImageBuffer& imBuffer
+);
+
+void FillTilePacket(
+int tile,
+int tilesY,
+Camera& camera,
+const vec3& right,
+const vec3& up,
+const vec3& forward,
+RayPacket& packet,
+int packetX[],
+int packetY[]
+);
+
+vec4 PrimaryRayDirection(
+int x,
+int y,
+const vec3& right,
+const vec3& up,
+const vec3& forward
+);
+
+void ShadePrimaryHit(
+screen* screen,
+ImageBuffer& imBuffer,
+int x,
+int y,
+bool hit,
+Intersection& closestIntersection,
+Camera& camera,
+LightSphere& ls,
+PhotonMap& pmap,
+Scene& scene
 );
 
 
@@ -56,10 +111,34 @@ vector<Sphere>& spheres
 
 #define NUM_PHOTONS 1000
 #define NUM_NEAREST_PHOTONS 5
+#define ADAPTIVE_NEAREST_PHOTONS false
+#define MIN_NEAREST_PHOTONS 3
+#define MAX_NEAREST_PHOTONS 20
+#define DENSITY_RADIUS 0.05f
+#define GATHER_EPSILON 0.0f
+#define SECONDARY_GATHER_EPSILON 0.0f
 #define FULLSCREEN_MODE true
 #define FOCAL_LENGTH SCREEN_HEIGHT
 #define DRAW_ITERATIONS 3
 #define ANTI_ALIASING true
+#define RUN_BENCHMARKS false
+#define BINNED_BVH_BUILD true
+#define PRIMARY_RAY_PACKETS true
+#define WAVEFRONT_SECONDARY_RAYS true
+#define WIDE_BVH true
+#define ANALYTIC_PRIMITIVES true
+#define OCCLUDER_CACHE true
+#define SHADOW_PHOTONS false
+#define PATH_CUTOFF 0.001f
+#define RUSSIAN_ROULETTE false
+#define RAY_CONES true
+#define IRRADIANCE_CACHE false
+#define IRRADIANCE_CACHE_ACCURACY 0.3f
+#define IRRADIANCE_CACHE_GRADIENTS true
+#define FINAL_GATHER_RAYS 0
+#define MESH_PATH ""
+#define USE_SCENE_CACHE true
+#define SCENE_CACHE_PATH "scene.cache"
 
 /* ----------------------------------------------------------------------------*/
 /* BEGIN PROGRAM                                                               */
@@ -68,6 +147,18 @@ vector<Sphere>& spheres
 int main (int argc, char* argv[]) {
 
     omp_set_num_threads(6);
+
+    if (RUN_BENCHMARKS) {
+        BenchmarkSettings settings;
+        settings.binnedBuild = BINNED_BVH_BUILD;
+        settings.wideBVH = WIDE_BVH;
+        settings.analytic = ANALYTIC_PRIMITIVES;
+        settings.numPhotons = NUM_PHOTONS;
+        settings.numNearestPhotons = NUM_NEAREST_PHOTONS;
+        settings.focalLength = FOCAL_LENGTH;
+        RunBenchmarks(settings);
+        return 0;
+    }
     
     screen *screen = InitializeSDL(SCREEN_WIDTH, SCREEN_HEIGHT, FULLSCREEN_MODE);
 
@@ -75,8 +166,10 @@ int main (int argc, char* argv[]) {
     // cornell room
     vector<Triangle> triangles;
     vector<Sphere> spheres;
+    vector<Quad> quads;
+    vector<Box> boxes;
 
-    loadShapes(triangles, spheres);
+    loadShapes(triangles, spheres, quads, boxes, ANALYTIC_PRIMITIVES);
 
     vector<Shape *> shapes;
     for (int i = 0 ; i < triangles.size(); i++) {
@@ -89,6 +182,54 @@ int main (int argc, char* argv[]) {
         shapes.push_back(sptr);
     }
 
+    for (int i = 0 ; i < quads.size(); i++) {
+        shapes.push_back(&quads[i]);
+    }
+
+    for (int i = 0 ; i < boxes.size(); i++) {
+        shapes.push_back(&boxes[i]);
+    }
+
+    // Optionally stand a mesh loaded from an OBJ or PLY file in the middle of
+    // the room. Files are y up, the room is y down
+    mat4 flipY(1.0f);
+    flipY[1][1] = -1;
+    AABB meshBox(vec3(-0.4f, 0.2f, -0.4f), vec3(0.4f, 1.0f, 0.4f));
+    vector<Mesh *> meshes;
+    Mesh mesh(defaultWhite);
+
+    // The built scene is cached under a hash of everything it is built from,
+    // so the mesh is only parsed and the BVH only built when one changes.
+    // The room on its own builds in well under a millisecond, so only
+    // scenes with a mesh are cached
+    bool useSceneCache = USE_SCENE_CACHE && string(MESH_PATH) != "";
+    ContentHash sceneHash;
+    Scene::HashShapes(shapes, sceneHash);
+    sceneHash.Add(BINNED_BVH_BUILD);
+    if (string(MESH_PATH) != "") {
+        sceneHash.Add(string(MESH_PATH).c_str(), string(MESH_PATH).size());
+        sceneHash.AddFile(MESH_PATH);
+        sceneHash.Add(flipY);
+        sceneHash.Add(meshBox);
+        Scene::HashMaterial(defaultWhite, sceneHash);
+    }
+
+    Scene scene;
+    if (!useSceneCache || !scene.LoadCache(SCENE_CACHE_PATH, sceneHash.getValue(), shapes)) {
+        if (string(MESH_PATH) != "" && mesh.Load(MESH_PATH)) {
+            mesh.Transform(flipY);
+            mesh.FitToBox(meshBox);
+            meshes.push_back(&mesh);
+        }
+        scene = Scene(shapes, meshes, BINNED_BVH_BUILD);
+        if (useSceneCache) {
+            scene.SaveCache(SCENE_CACHE_PATH, sceneHash.getValue());
+        }
+    }
+
+    scene.useWideBVH(WIDE_BVH);
+    scene.useOccluderCache(OCCLUDER_CACHE);
+
     cout << "REACHED IN MAIN" << endl;
 
     // Create a new camera
@@ -98,17 +239,42 @@ int main (int argc, char* argv[]) {
     vector<Photon> nearestPhotons;
 
 
-    PhotonMap pmap(ls, NUM_PHOTONS, NUM_NEAREST_PHOTONS, shapes);
+    // Shapes with an emitted colour send photons alongside the light sphere
+    LightTree lights(vector<LightSphere>(1, ls));
+    EmissiveShapes emitters(scene, lights.getNumLights());
+    PhotonMap pmap(lights, emitters, NUM_PHOTONS, NUM_NEAREST_PHOTONS, scene, SHADOW_PHOTONS);
+    if (SHADOW_PHOTONS) {
+        scene.useShadowPhotons(&pmap.getShadowPhotons());
+    }
+    pmap.setGatherEpsilon(GATHER_EPSILON, SECONDARY_GATHER_EPSILON);
+    pmap.setPathCutoff(PATH_CUTOFF, RUSSIAN_ROULETTE);
+    if (RAY_CONES) {
+        //A camera ray's cone spreads by a pixel's width per focal length
+        pmap.setRayCones(1.0f / FOCAL_LENGTH);
+    }
+    if (ADAPTIVE_NEAREST_PHOTONS) {
+        pmap.setAdaptiveNearestPhotons(MIN_NEAREST_PHOTONS, MAX_NEAREST_PHOTONS, DENSITY_RADIUS);
+    }
+    //Kept across frames, as the photon map is
+    IrradianceCache irradianceCache(IRRADIANCE_CACHE_ACCURACY, IRRADIANCE_CACHE_GRADIENTS);
+    if (IRRADIANCE_CACHE) {
+        pmap.useIrradianceCache(&irradianceCache);
+    }
+    pmap.setFinalGather(FINAL_GATHER_RAYS);
     KDTree * globalTracedPointer = pmap.GetGlobalPhotonsPointer();
 
     int i = 1;
     while (NoQuitMessageSDL() && i < DRAW_ITERATIONS) {
         i++;
         Update(camera, ls);
-        Draw(screen, camera, ls, pmap, shapes, globalTracedPointer, nearestPhotons, testPosition);
+        Draw(screen, camera, ls, pmap, scene, globalTracedPointer, nearestPhotons, testPosition);
         SDL_Renderframe(screen);
     }
 
+    if (IRRADIANCE_CACHE) {
+        cout << "Irradiance cache: " << irradianceCache.getNumRecords() << " records, " << 100 * irradianceCache.getHitRate() << "% of lookups hit" << endl;
+    }
+
     SDL_SaveImage(screen, "screenshot.bmp");
     KillSDL(screen);
 
@@ -118,7 +284,7 @@ int main (int argc, char* argv[]) {
 }
 
 /*Place your drawing here*/
-void Draw (screen* screen, Camera& camera, LightSphere& ls, PhotonMap pmap, vector<Shape *> shapes, KDTree* globalTracedPointer, vector<Photon> nearestPhotons, vec4 testPosition) {
+void Draw (screen* screen, Camera& camera, LightSphere& ls, PhotonMap pmap, Scene& scene, KDTree* globalTracedPointer, vector<Photon> nearestPhotons, vec4 testPosition) {
 
     /* Clear buffer */
     memset(screen->buffer, 0, screen->height*screen->width*sizeof(uint32_t));
@@ -127,55 +293,68 @@ void Draw (screen* screen, Camera& camera, LightSphere& ls, PhotonMap pmap, vect
     vector<vec3> buffer(SCREEN_HEIGHT*SCREEN_WIDTH);
     ImageBuffer imBuffer(buffer);
 
+    if (WAVEFRONT_SECONDARY_RAYS) {
+        DrawWavefront(screen, camera, ls, pmap, scene, imBuffer);
+        return;
+    }
+
     /******Ray Casting******/
     int pixels = 0;
     int threads = omp_get_num_threads();
-    #pragma omp parallel for //schedule(dynamic, (int)(SCREEN_WIDTH/threads))
-    for (int x = 0 ; x < SCREEN_WIDTH ; x++) {
-        for (int y = 0 ; y < SCREEN_HEIGHT ; y++) {
+    if (PRIMARY_RAY_PACKETS) {
+        //Trace square tiles of pixels as packets sharing the camera basis
+        vec3 right, up, forward;
+        camera.getBasis(right, up, forward);
+        int tilesX = (SCREEN_WIDTH + RAY_PACKET_WIDTH - 1) / RAY_PACKET_WIDTH;
+        int tilesY = (SCREEN_HEIGHT + RAY_PACKET_WIDTH - 1) / RAY_PACKET_WIDTH;
+
+        #pragma omp parallel for schedule(dynamic)
+        for (int tile = 0 ; tile < tilesX * tilesY ; tile++) {
+            RayPacket packet;
+            int packetX[RAY_PACKET_SIZE];
+            int packetY[RAY_PACKET_SIZE];
+            FillTilePacket(tile, tilesY, camera, right, up, forward, packet, packetX, packetY);
+
+            Intersection closestIntersections[RAY_PACKET_SIZE];
+            bool hits[RAY_PACKET_SIZE];
+            scene.closestIntersections(packet, closestIntersections, hits);
+
+            for (int r = 0 ; r < packet.count ; r++) {
+                ShadePrimaryHit(screen, imBuffer, packetX[r], packetY[r], hits[r], closestIntersections[r], camera, ls, pmap, scene);
+            }
+
             # pragma omp critical
             {
-                pixels++;
+                pixels += packet.count;
                 float pct = (float) pixels / (SCREEN_HEIGHT * SCREEN_WIDTH) * 100;
                 cout << pct << "%\r";
             }
+        }
+    }
+    else {
+        #pragma omp parallel for //schedule(dynamic, (int)(SCREEN_WIDTH/threads))
+        for (int x = 0 ; x < SCREEN_WIDTH ; x++) {
+            for (int y = 0 ; y < SCREEN_HEIGHT ; y++) {
+                # pragma omp critical
+                {
+                    pixels++;
+                    float pct = (float) pixels / (SCREEN_HEIGHT * SCREEN_WIDTH) * 100;
+                    cout << pct << "%\r";
+                }
 
-            // Change the ray's direction to work for the current pixel (pixel space -> Camera space)
-            vec4 dir((x - SCREEN_WIDTH / 2) , (y - SCREEN_HEIGHT / 2) , FOCAL_LENGTH , 1);
-
-            // Create a ray that we will change the direction for below
-            Ray ray(camera.getPosition(), dir);
-            ray.rotateRay(camera.getYaw());
-
-            // Initialise the closest intersection - will be updated in the for loop
-            Intersection closestIntersection;
-
-            //if (ray.closestIntersection(triangles, closestIntersection)) {
-            if (ray.closestIntersection(shapes, closestIntersection)) {
-
-                vec4 pos = camera.getPosition();
-                vec3 incidentDir(
-                        closestIntersection.position.x - pos.x,
-                        closestIntersection.position.y - pos.y,
-                        closestIntersection.position.z - pos.z
-                );
-
-                vec4 incidentDir4(normalize(incidentDir), 1);
-
-                Ray incidentRay(closestIntersection.position, incidentDir4);
+                // Change the ray's direction to work for the current pixel (pixel space -> Camera space)
+                vec4 dir((x - SCREEN_WIDTH / 2) , (y - SCREEN_HEIGHT / 2) , FOCAL_LENGTH , 1);
 
+                // Create a ray that we will change the direction for below
+                Ray ray(camera.getPosition(), dir);
+                ray.rotateRay(camera.getYaw());
 
-                vec3 finalColour = pmap.RadianceEstimate(NUM_NEAREST_PHOTONS, closestIntersection, shapes, incidentRay, camera, ls);
+                // Initialise the closest intersection - will be updated in the for loop
+                Intersection closestIntersection;
 
-                imBuffer.image[((SCREEN_WIDTH*x) + y)] = finalColour;
-                PutPixelSDL(screen, x, y, finalColour);
-            }
-            else {
-                imBuffer.image[((SCREEN_WIDTH*x) + y)] = vec3(0,0,0);
-                PutPixelSDL(screen, x, y, vec3(0,0,0));
+                bool hit = ray.closestIntersection(scene, closestIntersection);
+                ShadePrimaryHit(screen, imBuffer, x, y, hit, closestIntersection, camera, ls, pmap, scene);
             }
-
-        Intersection testIntersection;
         }
     }
 
@@ -216,7 +395,7 @@ void Draw (screen* screen, Camera& camera, LightSphere& ls, PhotonMap pmap, vect
             for(int i = 0; i < samples; i++){
 
                 Intersection closestIntersection;
-                if (AArays[i].closestIntersection(shapes, closestIntersection)) {
+                if (AArays[i].closestIntersection(scene, closestIntersection)) {
                     vec4 pos = camera.getPosition();
                     vec4 incidentDir(
                         closestIntersection.position.x - pos.x,
@@ -226,7 +405,9 @@ void Draw (screen* screen, Camera& camera, LightSphere& ls, PhotonMap pmap, vect
                         );
 
                     Ray incidentRay(closestIntersection.position, incidentDir);
-                    colourValues[i] = pmap.RadianceEstimate(NUM_NEAREST_PHOTONS, closestIntersection, shapes, incidentRay, camera, ls);
+                    float eyeDistance = length(vec3(incidentDir));
+                    incidentRay.setCone(eyeDistance / FOCAL_LENGTH, 1.0f / FOCAL_LENGTH, eyeDistance);
+                    colourValues[i] = pmap.RadianceEstimate(NUM_NEAREST_PHOTONS, closestIntersection, scene, incidentRay, camera, ls);
                 }
                 else{
                     colourValues[i] = vec3(0.0f,0.0f,0.0f);
@@ -247,6 +428,149 @@ void Draw (screen* screen, Camera& camera, LightSphere& ls, PhotonMap pmap, vect
 }
 
 
+//Draw's work done a stage at a time over the whole frame. Every primary ray
+//is traced first, in packets, then all the hits are shaded together through
+//PhotonMap::RadianceEstimates, and the same again for the anti aliasing
+//samples of every edge pixel
+void DrawWavefront(screen* screen, Camera& camera, LightSphere& ls, PhotonMap& pmap, Scene& scene, ImageBuffer& imBuffer) {
+    vec3 right, up, forward;
+    camera.getBasis(right, up, forward);
+    int tilesX = (SCREEN_WIDTH + RAY_PACKET_WIDTH - 1) / RAY_PACKET_WIDTH;
+    int tilesY = (SCREEN_HEIGHT + RAY_PACKET_WIDTH - 1) / RAY_PACKET_WIDTH;
+
+    vector<Intersection> primaryHits(SCREEN_WIDTH * SCREEN_HEIGHT);
+    vector<char> primaryHit(SCREEN_WIDTH * SCREEN_HEIGHT, false);
+    #pragma omp parallel for schedule(dynamic)
+    for (int tile = 0 ; tile < tilesX * tilesY ; tile++) {
+        RayPacket packet;
+        int packetX[RAY_PACKET_SIZE];
+        int packetY[RAY_PACKET_SIZE];
+        FillTilePacket(tile, tilesY, camera, right, up, forward, packet, packetX, packetY);
+
+        Intersection closestIntersections[RAY_PACKET_SIZE];
+        bool hits[RAY_PACKET_SIZE];
+        scene.closestIntersections(packet, closestIntersections, hits);
+        for (int r = 0 ; r < packet.count ; r++) {
+            int pixel = SCREEN_WIDTH * packetX[r] + packetY[r];
+            primaryHits[pixel] = closestIntersections[r];
+            primaryHit[pixel] = hits[r];
+        }
+    }
+
+    //As ShadePrimaryHit
+    vector<PathStart> starts;
+    vec4 pos = camera.getPosition();
+    for (int pixel = 0 ; pixel < SCREEN_WIDTH * SCREEN_HEIGHT ; pixel++) {
+        if (!primaryHit[pixel]) continue;
+        vec3 incidentDir = vec3(primaryHits[pixel].position - pos);
+        Ray incidentRay(primaryHits[pixel].position, vec4(normalize(incidentDir), 1));
+        float eyeDistance = length(incidentDir);
+        incidentRay.setCone(eyeDistance / FOCAL_LENGTH, 1.0f / FOCAL_LENGTH, eyeDistance);
+        starts.push_back({primaryHits[pixel], incidentRay, pixel, 1.0f});
+    }
+    vector<vec3> colours(SCREEN_WIDTH * SCREEN_HEIGHT, vec3(0));
+    pmap.RadianceEstimates(NUM_NEAREST_PHOTONS, starts, scene, camera, ls, colours);
+    for (int x = 0 ; x < SCREEN_WIDTH ; x++) {
+        for (int y = 0 ; y < SCREEN_HEIGHT ; y++) {
+            imBuffer.image[SCREEN_WIDTH * x + y] = colours[SCREEN_WIDTH * x + y];
+            PutPixelSDL(screen, x, y, colours[SCREEN_WIDTH * x + y]);
+        }
+    }
+
+    cout << "Anti Aliasing" << endl;
+    if (!ANTI_ALIASING) return;
+    int samples = 12;
+    vector<vec2> gradientImage;
+    imBuffer.SobelGradient(gradientImage);
+
+    //Each edge pixel averages its samples, so each is weighted 1 / samples
+    vector<Ray> sampleRays;
+    for (int i = 0 ; i < gradientImage.size() ; i++) {
+        int x = (int)gradientImage[i].x;
+        int y = (int)gradientImage[i].y;
+        Ray ray(camera.getPosition(), vec4(0, 0, 0, 0));
+        vec4 dir((x - SCREEN_WIDTH / 2) , (y - SCREEN_HEIGHT / 2) , FOCAL_LENGTH , 1);
+        ray.setDirection(dir);
+        ray.rotateRay(camera.getYaw());
+        vector<Ray> pixelRays = ray.SuperSamplePixel(samples);
+        sampleRays.insert(sampleRays.end(), pixelRays.begin(), pixelRays.end());
+    }
+
+    vector<Intersection> sampleHits(sampleRays.size());
+    vector<char> sampleHit(sampleRays.size());
+    #pragma omp parallel for schedule(dynamic, 64)
+    for (int s = 0 ; s < sampleRays.size() ; s++) {
+        sampleHit[s] = sampleRays[s].closestIntersection(scene, sampleHits[s]);
+    }
+
+    starts.clear();
+    for (int s = 0 ; s < sampleRays.size() ; s++) {
+        if (!sampleHit[s]) continue;
+        vec3 incidentDir = vec3(sampleHits[s].position - pos);
+        Ray incidentRay(sampleHits[s].position, vec4(incidentDir, 1));
+        float eyeDistance = length(incidentDir);
+        incidentRay.setCone(eyeDistance / FOCAL_LENGTH, 1.0f / FOCAL_LENGTH, eyeDistance);
+        starts.push_back({sampleHits[s], incidentRay, s / samples, 1.0f / samples});
+    }
+    vector<vec3> edgeColours(gradientImage.size(), vec3(0));
+    pmap.RadianceEstimates(NUM_NEAREST_PHOTONS, starts, scene, camera, ls, edgeColours);
+    for (int i = 0 ; i < gradientImage.size() ; i++) {
+        PutPixelSDL(screen, (int)gradientImage[i].x, (int)gradientImage[i].y, edgeColours[i]);
+    }
+}
+
+//Fills a packet with the primary rays of the pixels in one square tile, along
+//with each ray's pixel
+void FillTilePacket(int tile, int tilesY, Camera& camera, const vec3& right, const vec3& up, const vec3& forward, RayPacket& packet, int packetX[], int packetY[]) {
+    packet.start = camera.getPosition();
+    packet.count = 0;
+    for (int dx = 0 ; dx < RAY_PACKET_WIDTH ; dx++) {
+        for (int dy = 0 ; dy < RAY_PACKET_WIDTH ; dy++) {
+            int x = (tile / tilesY) * RAY_PACKET_WIDTH + dx;
+            int y = (tile % tilesY) * RAY_PACKET_WIDTH + dy;
+            if (x >= SCREEN_WIDTH || y >= SCREEN_HEIGHT) continue;
+            packet.dir[packet.count] = PrimaryRayDirection(x, y, right, up, forward);
+            packetX[packet.count] = x;
+            packetY[packet.count] = y;
+            packet.count++;
+        }
+    }
+}
+
+//Direction of the primary ray through pixel (x, y), the same direction
+//Ray::rotateRay gives without building a rotation per pixel
+vec4 PrimaryRayDirection(int x, int y, const vec3& right, const vec3& up, const vec3& forward) {
+    vec3 dir = (float)(x - SCREEN_WIDTH / 2) * right + (float)(y - SCREEN_HEIGHT / 2) * up + (float)FOCAL_LENGTH * forward;
+    return vec4(normalize(dir), 1);
+}
+
+//Colours pixel (x, y) from its primary ray's closest intersection
+void ShadePrimaryHit(screen* screen, ImageBuffer& imBuffer, int x, int y, bool hit, Intersection& closestIntersection, Camera& camera, LightSphere& ls, PhotonMap& pmap, Scene& scene) {
+    if (hit) {
+        vec4 pos = camera.getPosition();
+        vec3 incidentDir(
+                closestIntersection.position.x - pos.x,
+                closestIntersection.position.y - pos.y,
+                closestIntersection.position.z - pos.z
+        );
+
+        vec4 incidentDir4(normalize(incidentDir), 1);
+
+        Ray incidentRay(closestIntersection.position, incidentDir4);
+        float eyeDistance = length(incidentDir);
+        incidentRay.setCone(eyeDistance / FOCAL_LENGTH, 1.0f / FOCAL_LENGTH, eyeDistance);
+
+        vec3 finalColour = pmap.RadianceEstimate(NUM_NEAREST_PHOTONS, closestIntersection, scene, incidentRay, camera, ls);
+
+        imBuffer.image[((SCREEN_WIDTH*x) + y)] = finalColour;
+        PutPixelSDL(screen, x, y, finalColour);
+    }
+    else {
+        imBuffer.image[((SCREEN_WIDTH*x) + y)] = vec3(0,0,0);
+        PutPixelSDL(screen, x, y, vec3(0,0,0));
+    }
+}
+
 /*Place updates of parameters here*/
 void Update(Camera& camera, LightSphere& light) {
     static int t = SDL_GetTicks();
@@ -294,125 +618,110 @@ void Update(Camera& camera, LightSphere& light) {
 }
 
 
-void loadShapes(vector<Triangle>& triangles, vector<Sphere>& spheres) {
+void loadShapes(vector<Triangle>& triangles, vector<Sphere>& spheres, vector<Quad>& quads, vector<Box>& boxes, bool analytic) {
     
     // ---------------------------------------------------------------------------
     // Room
 
     float l = 555;			// Length of Cornell Box side.
 
-    vec4 A(l,0,0,1);
-    vec4 B(0,0,0,1);
-    vec4 C(l,0,l,1);
-    vec4 D(0,0,l,1);
-
-    vec4 E(l,l,0,1);
-    vec4 F(0,l,0,1);
-    vec4 G(l,l,l,1);
-    vec4 H(0,l,l,1);
-
-    // Triangles now take a material as an argument rather than a colour
-    // Floor:
-    Triangle flrTri1 = Triangle(C, B, A, specularWhite);
-    triangles.push_back(flrTri1);
-
-    Triangle flrTri2 = Triangle(C, D, B, specularWhite);
-    triangles.push_back(flrTri2);
-
-    // Left wall
-    Triangle lftWall1 = Triangle(A, E, C, leftWall);
-    triangles.push_back(lftWall1);
-
-    Triangle lftWall2 = Triangle(C, E, G, leftWall);
-    triangles.push_back(lftWall2);
-
-    // Right wall
-    Triangle rghtWall1 = Triangle(F, B, D, rightWall);
-    triangles.push_back(rghtWall1);
-
-    Triangle rghtWall2 = Triangle(H, F, D, rightWall);
-    triangles.push_back(rghtWall2);
-
-    // Ceiling
-    Triangle clng1 = Triangle(E, F, G, topWall);
-    triangles.push_back(clng1);
-
-    Triangle clng2 = Triangle(F, H, G, topWall);
-    triangles.push_back(clng2);
-
-    // Back wall
-    Triangle bckWall1 = Triangle(G, D, C, backWall);
-    triangles.push_back(bckWall1);
-
-    Triangle bckWall2 = Triangle(G, H, D, backWall);
-    triangles.push_back(bckWall2);
-
-    // ---------------------------------------------------------------------------
-    // Short block
-
-    A = vec4(240,0,234,1);  //+120 in z -50 in x
-    B = vec4( 80,0,185,1);
-    C = vec4(190,0,392,1);
-    D = vec4( 32,0,345,1);
-
-    E = vec4(240,165,234,1);
-    F = vec4( 80,165,185,1);
-    G = vec4(190,165,392,1);
-    H = vec4( 32,165,345,1);
-
-    // Front
-    triangles.push_back(Triangle(E,B,A,defaultBlue));
-    triangles.push_back(Triangle(E,F,B,defaultBlue));
-
-    // Front
-    triangles.push_back(Triangle(F,D,B,defaultBlue));
-    triangles.push_back(Triangle(F,H,D,defaultBlue));
-
-    // BACK
-    triangles.push_back(Triangle(H,C,D,defaultBlue));
-    triangles.push_back(Triangle(H,G,C,defaultBlue));
-
-    // LEFT
-    triangles.push_back(Triangle(G,E,C,defaultBlue));
-    triangles.push_back(Triangle(E,A,C,defaultBlue));
-
-    // TOP
-    triangles.push_back(Triangle(G,F,E,defaultBlue));
-    triangles.push_back(Triangle(G,H,F,defaultBlue));
+    // Scale to the volume [-1,1]^3, flipping x and y
+    auto toVolume = [l](vec4 v) {
+        v = v * (2 / l) - vec4(1,1,1,1);
+        return vec4(-v.x, -v.y, v.z, 1.0);
+    };
+
+    vec4 A = toVolume(vec4(l,0,0,1));
+    vec4 B = toVolume(vec4(0,0,0,1));
+    vec4 C = toVolume(vec4(l,0,l,1));
+    vec4 D = toVolume(vec4(0,0,l,1));
+
+    vec4 E = toVolume(vec4(l,l,0,1));
+    vec4 F = toVolume(vec4(0,l,0,1));
+    vec4 G = toVolume(vec4(l,l,l,1));
+    vec4 H = toVolume(vec4(0,l,l,1));
+
+    // Each wall is one quad, or the two triangles that make it up. The quad
+    // takes the triangle with the right angle, that corner first
+    if (analytic) {
+        quads.push_back(Quad(D, B, C, specularWhite));  // Floor
+        quads.push_back(Quad(A, E, C, leftWall));       // Left wall
+        quads.push_back(Quad(B, D, F, rightWall));      // Right wall
+        quads.push_back(Quad(E, F, G, topWall));        // Ceiling
+        quads.push_back(Quad(C, G, D, backWall));       // Back wall
+    } else {
+        // Triangles now take a material as an argument rather than a colour
+        // Floor:
+        triangles.push_back(Triangle(C, B, A, specularWhite));
+        triangles.push_back(Triangle(C, D, B, specularWhite));
+
+        // Left wall
+        triangles.push_back(Triangle(A, E, C, leftWall));
+        triangles.push_back(Triangle(C, E, G, leftWall));
+
+        // Right wall
+        triangles.push_back(Triangle(F, B, D, rightWall));
+        triangles.push_back(Triangle(H, F, D, rightWall));
+
+        // Ceiling
+        triangles.push_back(Triangle(E, F, G, topWall));
+        triangles.push_back(Triangle(F, H, G, topWall));
+
+        // Back wall
+        triangles.push_back(Triangle(G, D, C, backWall));
+        triangles.push_back(Triangle(G, H, D, backWall));
+    }
 
     // ---------------------------------------------------------------------------
-    // Tall block
-
-    A = vec4(443,0,247,1);
-    B = vec4(285,0,296,1);
-    C = vec4(492,0,406,1);
-    D = vec4(334,0,456,1);
-
-    E = vec4(443,330,247,1);
-    F = vec4(285,330,296,1);
-    G = vec4(492,330,406,1);
-    H = vec4(334,330,456,1);
+    // Blocks
+
+    // Corners of the short block, then the tall block. The original corners
+    // are only nearly a box, so the box takes A and its edges to B, C and E
+    vec4 blocks[2][8] = {
+        {vec4(240,0,234,1), vec4( 80,0,185,1), vec4(190,0,392,1), vec4( 32,0,345,1),    //+120 in z -50 in x
+         vec4(240,165,234,1), vec4( 80,165,185,1), vec4(190,165,392,1), vec4( 32,165,345,1)},
+        {vec4(443,0,247,1), vec4(285,0,296,1), vec4(492,0,406,1), vec4(334,0,456,1),
+         vec4(443,330,247,1), vec4(285,330,296,1), vec4(492,330,406,1), vec4(334,330,456,1)}
+    };
+    Material blockMaterials[2] = {defaultBlue, fresnelWhite};
+
+    for (int b = 0 ; b < 2 ; b++) {
+        A = toVolume(blocks[b][0]);
+        B = toVolume(blocks[b][1]);
+        C = toVolume(blocks[b][2]);
+        D = toVolume(blocks[b][3]);
+
+        E = toVolume(blocks[b][4]);
+        F = toVolume(blocks[b][5]);
+        G = toVolume(blocks[b][6]);
+        H = toVolume(blocks[b][7]);
+
+        Material material = blockMaterials[b];
+        if (analytic) {
+            boxes.push_back(Box(A, B, C, E, material));
+            continue;
+        }
 
-    // Front
-   
-    triangles.push_back(Triangle(E,B,A,fresnelWhite));
-    triangles.push_back(Triangle(E,F,B,fresnelWhite));
+        // Front
+        triangles.push_back(Triangle(E,B,A,material));
+        triangles.push_back(Triangle(E,F,B,material));
 
-    // Front
-    triangles.push_back(Triangle(F,D,B,fresnelWhite));
-    triangles.push_back(Triangle(F,H,D,fresnelWhite));
+        // Front
+        triangles.push_back(Triangle(F,D,B,material));
+        triangles.push_back(Triangle(F,H,D,material));
 
-    // BACK
-    triangles.push_back(Triangle(H,C,D,fresnelWhite));
-    triangles.push_back(Triangle(H,G,C,fresnelWhite));
+        // BACK
+        triangles.push_back(Triangle(H,C,D,material));
+        triangles.push_back(Triangle(H,G,C,material));
 
-    // LEFT
-    triangles.push_back(Triangle(G,E,C,fresnelWhite));
-    triangles.push_back(Triangle(E,A,C,fresnelWhite));
+        // LEFT
+        triangles.push_back(Triangle(G,E,C,material));
+        triangles.push_back(Triangle(E,A,C,material));
 
-    // TOP
-    triangles.push_back(Triangle(G,F,E,fresnelWhite));
-    triangles.push_back(Triangle(G,H,F,fresnelWhite));
+        // TOP
+        triangles.push_back(Triangle(G,F,E,material));
+        triangles.push_back(Triangle(G,H,F,material));
+    }
 
     // ---------------------------------------------------------------------------
     // Sphere
@@ -425,37 +734,4 @@ void loadShapes(vector<Triangle>& triangles, vector<Sphere>& spheres) {
 
     //Left diffuse phere
     spheres.push_back(Sphere(vec4(-0.2, 0.85, -0.6, 1), 0.19, specularPink));
-
-    // ----------------------------------------------
-    // Scale to the volume [-1,1]^3
-
-    for (size_t i = 0 ; i < triangles.size() ; ++i) {
-        triangles[i].setV0(triangles[i].getV0() * (2 / l));
-        triangles[i].setV1(triangles[i].getV1() * (2 / l));
-        triangles[i].setV2(triangles[i].getV2() * (2 / l));
-
-        triangles[i].setV0(triangles[i].getV0() - vec4(1,1,1,1));
-        triangles[i].setV1(triangles[i].getV1() - vec4(1,1,1,1));
-        triangles[i].setV2(triangles[i].getV2() - vec4(1,1,1,1));
-
-        vec4 newV0 = triangles[i].getV0();
-        newV0.x *= -1;
-        newV0.y *= -1;
-        newV0.w = 1.0;
-        triangles[i].setV0(newV0);
-
-        vec4 newV1 = triangles[i].getV1();
-        newV1.x *= -1;
-        newV1.y *= -1;
-        newV1.w = 1.0;
-        triangles[i].setV1(newV1);
-
-        vec4 newV2 = triangles[i].getV2();
-        newV2.x *= -1;
-        newV2.y *= -1;
-        newV2.w = 1.0;
-        triangles[i].setV2(newV2);
-
-        triangles[i].computeAndSetNormal();
-    }
 }